@@ -0,0 +1,61 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <uv.h>
+
+#include "clock.h"
+
+static uint64_t origin_ns;     // 时间原点（单调时钟纳秒）
+static double origin_wall_ms;  // 时间原点对应的墙钟毫秒
+static pthread_once_t origin_once = PTHREAD_ONCE_INIT;
+
+// 当前线程的粗粒度时钟来源
+static __thread uv_loop_t *bound_loop = NULL;
+
+static void init_time_origin(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  origin_ns = winterq_clock_hrtime();
+  origin_wall_ms = (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1e6;
+}
+
+uint64_t winterq_clock_hrtime(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+uint64_t winterq_clock_coarse_ms(void) {
+  if (bound_loop)
+    return uv_now(bound_loop);
+  return winterq_clock_hrtime() / 1000000;
+}
+
+double winterq_clock_now_ms(void) {
+#if WINTERQ_CLOCK_COARSE
+  if (bound_loop)
+    return (double)uv_now(bound_loop);
+#endif
+  return (double)winterq_clock_hrtime() / 1e6;
+}
+
+double winterq_clock_since_origin_ms(void) {
+  pthread_once(&origin_once, init_time_origin);
+  return winterq_clock_now_ms() - (double)origin_ns / 1e6;
+}
+
+double winterq_clock_time_origin(void) {
+  pthread_once(&origin_once, init_time_origin);
+  return origin_wall_ms;
+}
+
+void winterq_clock_bind_loop(uv_loop_t *loop) {
+  pthread_once(&origin_once, init_time_origin);
+  bound_loop = loop;
+}
+
+void winterq_clock_unbind_loop(uv_loop_t *loop) {
+  if (bound_loop == loop)
+    bound_loop = NULL;
+}
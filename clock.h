@@ -0,0 +1,58 @@
+#ifndef WINTERQ_CLOCK_H
+#define WINTERQ_CLOCK_H
+
+#include <stdint.h>
+
+#include <uv.h>
+
+// 设为 1 时 winterq_clock_now_ms() 改用每轮事件循环缓存的粗粒度时钟（毫秒精度），
+// 以精度换取热路径上的读取开销（可在编译时通过 -DWINTERQ_CLOCK_COARSE=1 开启）
+#ifndef WINTERQ_CLOCK_COARSE
+#define WINTERQ_CLOCK_COARSE 0
+#endif
+
+/**
+ * 单调高精度时钟
+ *
+ * @return 单调时钟的纳秒时间戳，与 uv_hrtime() 同一时间基准
+ */
+uint64_t winterq_clock_hrtime(void);
+
+/**
+ * 粗粒度时钟，读取当前线程绑定的事件循环缓存的 uv_now()，
+ * 每轮循环更新一次；线程未绑定事件循环时退化为高精度时钟
+ *
+ * @return 单调时钟的毫秒时间戳
+ */
+uint64_t winterq_clock_coarse_ms(void);
+
+/**
+ * 热路径使用的默认时钟，精度由 WINTERQ_CLOCK_COARSE 决定
+ *
+ * @return 单调时钟的毫秒时间戳
+ */
+double winterq_clock_now_ms(void);
+
+/**
+ * 距离进程时间原点的毫秒数，用于 performance.now() 和 Event.timeStamp
+ */
+double winterq_clock_since_origin_ms(void);
+
+/**
+ * 时间原点对应的 Unix 墙钟时间（毫秒），用于 performance.timeOrigin
+ */
+double winterq_clock_time_origin(void);
+
+/**
+ * 将当前线程的粗粒度时钟绑定到事件循环，传入 NULL 解除绑定
+ *
+ * @param loop 当前线程运行的事件循环
+ */
+void winterq_clock_bind_loop(uv_loop_t *loop);
+
+/**
+ * 若当前线程绑定的是 loop，则解除绑定
+ */
+void winterq_clock_unbind_loop(uv_loop_t *loop);
+
+#endif /* WINTERQ_CLOCK_H */
@@ -15,13 +15,18 @@
 #define WINTERQ_LOG_LEVEL WINTERQ_LOG_LEVEL_WARNING
 #endif
 
-// 获取当前时间字符串
+// 获取当前时间字符串，每个线程缓存格式化结果，秒数变化时才重新格式化
 static inline const char *winterq_log_timestamp()
 {
-  static char buffer[20];
+  static __thread char buffer[20];
+  static __thread time_t cached_sec = -1;
   time_t t = time(NULL);
-  struct tm *tm_info = localtime(&t);
-  strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", tm_info);
+  if (t != cached_sec) {
+    struct tm tm_info;
+    localtime_r(&t, &tm_info);
+    strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", &tm_info);
+    cached_sec = t;
+  }
   return buffer;
 }
 
@@ -1,7 +1,10 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <quickjs.h>
 
+#include "../clock.h"
 #include "console.h"
 
 #define countof(x) (sizeof(x) / sizeof((x)[0]))
@@ -102,36 +105,163 @@ static JSValue js_console_debug(JSContext *ctx, JSValueConst this_val, int argc,
 }
 
 // Console time tracking
-typedef struct {
-  uint64_t start_time;
+typedef struct ConsoleTimer {
+  double start_time; // 距离时间原点的毫秒数，与 performance.now() 同一时钟
   char *label;
+  struct ConsoleTimer *next;
 } ConsoleTimer;
 
+// 每个上下文的 console 状态，保存在 console 对象的 opaque 中
+typedef struct {
+  ConsoleTimer *timers;
+} ConsoleState;
+
+static JSClassID js_console_class_id = 0;
+
+static ConsoleState *get_console_state(JSContext *ctx, JSValueConst this_val) {
+  ConsoleState *state = JS_GetOpaque(this_val, js_console_class_id);
+  if (!state) {
+    // 以解构等方式调用时 this 不是 console，退回到全局 console
+    JSValue global_obj = JS_GetGlobalObject(ctx);
+    JSValue console = JS_GetPropertyStr(ctx, global_obj, "console");
+    state = JS_GetOpaque(console, js_console_class_id);
+    JS_FreeValue(ctx, console);
+    JS_FreeValue(ctx, global_obj);
+  }
+  return state;
+}
+
+static ConsoleTimer **find_console_timer(ConsoleState *state, const char *label) {
+  ConsoleTimer **pp = &state->timers;
+  while (*pp) {
+    if (!strcmp((*pp)->label, label))
+      return pp;
+    pp = &(*pp)->next;
+  }
+  return NULL;
+}
+
+// 未传入标签时返回 NULL，调用方使用 "default"
+static const char *get_timer_label(JSContext *ctx, int argc, JSValueConst *argv) {
+  if (argc < 1 || JS_IsUndefined(argv[0]))
+    return NULL;
+  return JS_ToCString(ctx, argv[0]);
+}
+
 static JSValue js_console_time(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-  // Implementation for console.time
-  // Add timer functionality
+  ConsoleState *state = get_console_state(ctx, this_val);
+  if (!state)
+    return JS_UNDEFINED;
+
+  const char *label = get_timer_label(ctx, argc, argv);
+  if (argc > 0 && !JS_IsUndefined(argv[0]) && !label)
+    return JS_EXCEPTION;
+  const char *name = label ? label : "default";
+
+  if (find_console_timer(state, name)) {
+    fprintf(stderr, "%sWARN: Timer '%s' already exists%s\n", ANSI_COLOR_YELLOW, name, ANSI_COLOR_RESET);
+  } else {
+    ConsoleTimer *timer = calloc(1, sizeof(ConsoleTimer));
+    if (timer) {
+      timer->label = strdup(name);
+      timer->start_time = winterq_clock_since_origin_ms();
+      timer->next = state->timers;
+      state->timers = timer;
+    }
+  }
+
+  if (label)
+    JS_FreeCString(ctx, label);
   return JS_UNDEFINED;
 }
 
-static JSValue js_console_timeEnd(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-  // Implementation for console.timeEnd
-  // Add timer end functionality
+// timeLog 和 timeEnd 的公共实现，magic 为 1 时结束计时器
+static JSValue js_console_time_log(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv, int magic) {
+  double now = winterq_clock_since_origin_ms();
+  ConsoleState *state = get_console_state(ctx, this_val);
+  if (!state)
+    return JS_UNDEFINED;
+
+  const char *label = get_timer_label(ctx, argc, argv);
+  if (argc > 0 && !JS_IsUndefined(argv[0]) && !label)
+    return JS_EXCEPTION;
+  const char *name = label ? label : "default";
+
+  ConsoleTimer **pp = find_console_timer(state, name);
+  if (!pp) {
+    fprintf(stderr, "%sWARN: Timer '%s' does not exist%s\n", ANSI_COLOR_YELLOW, name, ANSI_COLOR_RESET);
+    if (label)
+      JS_FreeCString(ctx, label);
+    return JS_UNDEFINED;
+  }
+
+  ConsoleTimer *timer = *pp;
+  fprintf(stderr, "%s: %.3f ms", name, now - timer->start_time);
+
+  // timeLog 附加的数据
+  for (int i = 1; !magic && i < argc; i++) {
+    const char *str = JS_ToCString(ctx, argv[i]);
+    if (str) {
+      fprintf(stderr, " %s", str);
+      JS_FreeCString(ctx, str);
+    }
+  }
+  fprintf(stderr, "\n");
+
+  if (magic) {
+    *pp = timer->next;
+    free(timer->label);
+    free(timer);
+  }
+
+  if (label)
+    JS_FreeCString(ctx, label);
   return JS_UNDEFINED;
 }
 
+static void js_console_finalizer(JSRuntime *rt, JSValue val) {
+  ConsoleState *state = JS_GetOpaque(val, js_console_class_id);
+  if (state) {
+    ConsoleTimer *timer = state->timers;
+    while (timer) {
+      ConsoleTimer *next = timer->next;
+      free(timer->label);
+      free(timer);
+      timer = next;
+    }
+    free(state);
+  }
+}
+
+static JSClassDef js_console_class_def = {
+    "Console",
+    .finalizer = js_console_finalizer,
+};
+
 static const JSCFunctionListEntry console_funcs[] = {
     JS_CFUNC_DEF("log", 1, js_console_log),
     JS_CFUNC_DEF("info", 1, js_console_info),
     JS_CFUNC_DEF("warn", 1, js_console_warn),
     JS_CFUNC_DEF("error", 1, js_console_error),
     JS_CFUNC_DEF("debug", 1, js_console_debug),
-    JS_CFUNC_DEF("time", 1, js_console_time),
-    JS_CFUNC_DEF("timeEnd", 1, js_console_timeEnd),
+    JS_CFUNC_DEF("time", 0, js_console_time),
+    JS_CFUNC_MAGIC_DEF("timeLog", 0, js_console_time_log, 0),
+    JS_CFUNC_MAGIC_DEF("timeEnd", 0, js_console_time_log, 1),
 };
 
 void js_init_console(JSContext *ctx) {
+  JSRuntime *rt = JS_GetRuntime(ctx);
+
+  if (js_console_class_id == 0) {
+    JS_NewClassID(&js_console_class_id);
+  }
+  if (!JS_IsRegisteredClass(rt, js_console_class_id)) {
+    JS_NewClass(rt, js_console_class_id, &js_console_class_def);
+  }
+
   JSValue global_obj = JS_GetGlobalObject(ctx);
-  JSValue console = JS_NewObject(ctx);
+  JSValue console = JS_NewObjectClass(ctx, js_console_class_id);
+  JS_SetOpaque(console, calloc(1, sizeof(ConsoleState)));
 
   JS_SetPropertyFunctionList(ctx, console, console_funcs, countof(console_funcs));
   JS_SetPropertyStr(ctx, global_obj, "console", console);
@@ -1,10 +1,10 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
 
 #include "quickjs.h"
 
+#include "../clock.h"
 #include "event.h"
 
 JSClassID js_event_class_id = 0;
@@ -90,7 +90,7 @@ static JSValue js_event_constructor(JSContext *ctx, JSValueConst new_target, int
   event->bubbles = bubbles;
   event->cancelable = cancelable;
   event->composed = composed;
-  event->timeStamp = clock();
+  event->timeStamp = winterq_clock_since_origin_ms();
   event->eventPhase = EVENT_NONE;
   event->target = JS_NULL;
   event->currentTarget = JS_NULL;
@@ -0,0 +1,328 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <quickjs.h>
+
+#include "../clock.h"
+#include "performance.h"
+
+static JSClassID js_performance_class_id = 0;
+
+static const char *entry_type_names[] = {"", "mark", "measure"};
+
+// 方法必须以 performance 对象为 this 调用，与浏览器一致
+static PerformanceTimeline *get_timeline(JSContext *ctx, JSValueConst this_val) {
+  return JS_GetOpaque(this_val, js_performance_class_id);
+}
+
+PerformanceTimeline *js_performance_timeline(JSValueConst performance) {
+  return JS_GetOpaque(performance, js_performance_class_id);
+}
+
+int performance_timeline_copy(const PerformanceTimeline *timeline, PerformanceEntry *out, int max) {
+  int n = 0;
+  if (!timeline || !timeline->entries)
+    return 0;
+
+  for (uint32_t i = 0; i < timeline->count && n < max; i++) {
+    const PerformanceEntry *entry = &timeline->entries[(timeline->head + i) % PERFORMANCE_BUFFER_SIZE];
+    if (entry->type != PERFORMANCE_ENTRY_NONE)
+      out[n++] = *entry;
+  }
+  return n;
+}
+
+// 追加条目，缓冲区满时覆盖最早的条目
+static PerformanceEntry *timeline_append(JSContext *ctx, PerformanceTimeline *timeline) {
+  if (!timeline->entries) {
+    timeline->entries = calloc(PERFORMANCE_BUFFER_SIZE, sizeof(PerformanceEntry));
+    if (!timeline->entries) {
+      JS_ThrowOutOfMemory(ctx);
+      return NULL;
+    }
+  }
+
+  PerformanceEntry *entry;
+  if (timeline->count < PERFORMANCE_BUFFER_SIZE) {
+    entry = &timeline->entries[(timeline->head + timeline->count) % PERFORMANCE_BUFFER_SIZE];
+    timeline->count++;
+  } else {
+    entry = &timeline->entries[timeline->head];
+    timeline->head = (timeline->head + 1) % PERFORMANCE_BUFFER_SIZE;
+  }
+  return entry;
+}
+
+// 查找指定名称的最新一条 mark
+static const PerformanceEntry *timeline_find_mark(const PerformanceTimeline *timeline, const char *name) {
+  if (!timeline->entries)
+    return NULL;
+
+  for (uint32_t i = timeline->count; i > 0; i--) {
+    const PerformanceEntry *entry = &timeline->entries[(timeline->head + i - 1) % PERFORMANCE_BUFFER_SIZE];
+    if (entry->type == PERFORMANCE_ENTRY_MARK && !strncmp(entry->name, name, PERFORMANCE_NAME_MAX - 1))
+      return entry;
+  }
+  return NULL;
+}
+
+static JSValue new_entry_object(JSContext *ctx, const PerformanceEntry *entry) {
+  JSValue obj = JS_NewObject(ctx);
+  if (JS_IsException(obj))
+    return obj;
+
+  JS_SetPropertyStr(ctx, obj, "name", JS_NewString(ctx, entry->name));
+  JS_SetPropertyStr(ctx, obj, "entryType", JS_NewString(ctx, entry_type_names[entry->type]));
+  JS_SetPropertyStr(ctx, obj, "startTime", JS_NewFloat64(ctx, entry->start_time));
+  JS_SetPropertyStr(ctx, obj, "duration", JS_NewFloat64(ctx, entry->duration));
+  return obj;
+}
+
+// 将 mark 名称或数字解析为时间戳
+static int resolve_timestamp(JSContext *ctx, PerformanceTimeline *timeline, JSValueConst val, double *out) {
+  if (JS_IsString(val)) {
+    const char *name = JS_ToCString(ctx, val);
+    if (!name)
+      return -1;
+    const PerformanceEntry *mark = timeline_find_mark(timeline, name);
+    if (!mark) {
+      JS_ThrowSyntaxError(ctx, "The mark '%s' does not exist", name);
+      JS_FreeCString(ctx, name);
+      return -1;
+    }
+    JS_FreeCString(ctx, name);
+    *out = mark->start_time;
+    return 0;
+  }
+  return JS_ToFloat64(ctx, out, val);
+}
+
+// performance.now()：距离时间原点的毫秒数
+static JSValue js_performance_now(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+  return JS_NewFloat64(ctx, winterq_clock_since_origin_ms());
+}
+
+// performance.mark(name, { startTime })
+static JSValue js_performance_mark(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+  PerformanceTimeline *timeline = get_timeline(ctx, this_val);
+  if (!timeline)
+    return JS_ThrowTypeError(ctx, "Illegal invocation");
+  if (argc < 1)
+    return JS_ThrowTypeError(ctx, "1 argument required, but only 0 present");
+
+  double start_time = winterq_clock_since_origin_ms();
+  if (argc > 1 && JS_IsObject(argv[1])) {
+    JSValue start_val = JS_GetPropertyStr(ctx, argv[1], "startTime");
+    if (!JS_IsUndefined(start_val) && JS_ToFloat64(ctx, &start_time, start_val)) {
+      JS_FreeValue(ctx, start_val);
+      return JS_EXCEPTION;
+    }
+    JS_FreeValue(ctx, start_val);
+  }
+
+  const char *name = JS_ToCString(ctx, argv[0]);
+  if (!name)
+    return JS_EXCEPTION;
+
+  PerformanceEntry *entry = timeline_append(ctx, timeline);
+  if (!entry) {
+    JS_FreeCString(ctx, name);
+    return JS_EXCEPTION;
+  }
+
+  snprintf(entry->name, PERFORMANCE_NAME_MAX, "%s", name);
+  entry->type = PERFORMANCE_ENTRY_MARK;
+  entry->start_time = start_time;
+  entry->duration = 0;
+  JS_FreeCString(ctx, name);
+
+  return new_entry_object(ctx, entry);
+}
+
+// performance.measure(name, startMark?, endMark?) 或 performance.measure(name, { start, end, duration })
+static JSValue js_performance_measure(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+  PerformanceTimeline *timeline = get_timeline(ctx, this_val);
+  if (!timeline)
+    return JS_ThrowTypeError(ctx, "Illegal invocation");
+  if (argc < 1)
+    return JS_ThrowTypeError(ctx, "1 argument required, but only 0 present");
+
+  double now = winterq_clock_since_origin_ms();
+  double start_time = 0;
+  double end_time = now;
+
+  if (argc > 1 && JS_IsObject(argv[1])) {
+    JSValue start_val = JS_GetPropertyStr(ctx, argv[1], "start");
+    JSValue end_val = JS_GetPropertyStr(ctx, argv[1], "end");
+    JSValue duration_val = JS_GetPropertyStr(ctx, argv[1], "duration");
+    int ret = 0;
+    double duration = 0;
+
+    if (!JS_IsUndefined(start_val))
+      ret = resolve_timestamp(ctx, timeline, start_val, &start_time);
+    if (!ret && !JS_IsUndefined(end_val))
+      ret = resolve_timestamp(ctx, timeline, end_val, &end_time);
+    if (!ret && !JS_IsUndefined(duration_val)) {
+      ret = JS_ToFloat64(ctx, &duration, duration_val);
+      if (!ret && JS_IsUndefined(end_val))
+        end_time = start_time + duration;
+      else if (!ret && JS_IsUndefined(start_val))
+        start_time = end_time - duration;
+    }
+
+    JS_FreeValue(ctx, start_val);
+    JS_FreeValue(ctx, end_val);
+    JS_FreeValue(ctx, duration_val);
+    if (ret)
+      return JS_EXCEPTION;
+  } else {
+    if (argc > 1 && !JS_IsUndefined(argv[1]) && resolve_timestamp(ctx, timeline, argv[1], &start_time))
+      return JS_EXCEPTION;
+    if (argc > 2 && !JS_IsUndefined(argv[2]) && resolve_timestamp(ctx, timeline, argv[2], &end_time))
+      return JS_EXCEPTION;
+  }
+
+  const char *name = JS_ToCString(ctx, argv[0]);
+  if (!name)
+    return JS_EXCEPTION;
+
+  PerformanceEntry *entry = timeline_append(ctx, timeline);
+  if (!entry) {
+    JS_FreeCString(ctx, name);
+    return JS_EXCEPTION;
+  }
+
+  snprintf(entry->name, PERFORMANCE_NAME_MAX, "%s", name);
+  entry->type = PERFORMANCE_ENTRY_MEASURE;
+  entry->start_time = start_time;
+  entry->duration = end_time - start_time;
+  JS_FreeCString(ctx, name);
+
+  return new_entry_object(ctx, entry);
+}
+
+// getEntries / getEntriesByName / getEntriesByType 的公共实现
+// magic: 0 = getEntries, 1 = getEntriesByName, 2 = getEntriesByType
+static JSValue js_performance_get_entries(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv, int magic) {
+  PerformanceTimeline *timeline = get_timeline(ctx, this_val);
+  if (!timeline)
+    return JS_ThrowTypeError(ctx, "Illegal invocation");
+
+  const char *name = NULL;
+  const char *type = NULL;
+  if (magic == 1 && argc > 0) {
+    name = JS_ToCString(ctx, argv[0]);
+    if (!name)
+      return JS_EXCEPTION;
+    if (argc > 1 && !JS_IsUndefined(argv[1]))
+      type = JS_ToCString(ctx, argv[1]);
+  } else if (magic == 2 && argc > 0) {
+    type = JS_ToCString(ctx, argv[0]);
+    if (!type)
+      return JS_EXCEPTION;
+  }
+
+  JSValue result = JS_NewArray(ctx);
+  uint32_t index = 0;
+
+  for (uint32_t i = 0; timeline->entries && i < timeline->count; i++) {
+    const PerformanceEntry *entry = &timeline->entries[(timeline->head + i) % PERFORMANCE_BUFFER_SIZE];
+    if (entry->type == PERFORMANCE_ENTRY_NONE)
+      continue;
+    if (name && strncmp(entry->name, name, PERFORMANCE_NAME_MAX - 1))
+      continue;
+    if (type && strcmp(entry_type_names[entry->type], type))
+      continue;
+    JS_SetPropertyUint32(ctx, result, index++, new_entry_object(ctx, entry));
+  }
+
+  if (name)
+    JS_FreeCString(ctx, name);
+  if (type)
+    JS_FreeCString(ctx, type);
+
+  return result;
+}
+
+// clearMarks / clearMeasures，magic 为要清除的条目类型
+static JSValue js_performance_clear(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv, int magic) {
+  PerformanceTimeline *timeline = get_timeline(ctx, this_val);
+  if (!timeline)
+    return JS_ThrowTypeError(ctx, "Illegal invocation");
+
+  const char *name = NULL;
+  if (argc > 0 && !JS_IsUndefined(argv[0])) {
+    name = JS_ToCString(ctx, argv[0]);
+    if (!name)
+      return JS_EXCEPTION;
+  }
+
+  for (uint32_t i = 0; timeline->entries && i < timeline->count; i++) {
+    PerformanceEntry *entry = &timeline->entries[(timeline->head + i) % PERFORMANCE_BUFFER_SIZE];
+    if (entry->type == (PerformanceEntryTypeEnum)magic && (!name || !strncmp(entry->name, name, PERFORMANCE_NAME_MAX - 1)))
+      entry->type = PERFORMANCE_ENTRY_NONE;
+  }
+
+  if (name)
+    JS_FreeCString(ctx, name);
+  return JS_UNDEFINED;
+}
+
+static JSValue js_performance_get_time_origin(JSContext *ctx, JSValueConst this_val) {
+  return JS_NewFloat64(ctx, winterq_clock_time_origin());
+}
+
+static void js_performance_finalizer(JSRuntime *rt, JSValue val) {
+  PerformanceTimeline *timeline = JS_GetOpaque(val, js_performance_class_id);
+  if (timeline) {
+    free(timeline->entries);
+    free(timeline);
+  }
+}
+
+static JSClassDef js_performance_class_def = {
+    "Performance",
+    .finalizer = js_performance_finalizer,
+};
+
+static const JSCFunctionListEntry js_performance_funcs[] = {
+    JS_CFUNC_DEF("now", 0, js_performance_now),
+    JS_CGETSET_DEF("timeOrigin", js_performance_get_time_origin, NULL),
+    JS_CFUNC_DEF("mark", 1, js_performance_mark),
+    JS_CFUNC_DEF("measure", 1, js_performance_measure),
+    JS_CFUNC_MAGIC_DEF("getEntries", 0, js_performance_get_entries, 0),
+    JS_CFUNC_MAGIC_DEF("getEntriesByName", 1, js_performance_get_entries, 1),
+    JS_CFUNC_MAGIC_DEF("getEntriesByType", 1, js_performance_get_entries, 2),
+    JS_CFUNC_MAGIC_DEF("clearMarks", 0, js_performance_clear, PERFORMANCE_ENTRY_MARK),
+    JS_CFUNC_MAGIC_DEF("clearMeasures", 0, js_performance_clear, PERFORMANCE_ENTRY_MEASURE),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "Performance", JS_PROP_CONFIGURABLE),
+};
+
+JSValue js_init_performance(JSContext *ctx) {
+  JSRuntime *rt = JS_GetRuntime(ctx);
+
+  if (js_performance_class_id == 0) {
+    JS_NewClassID(&js_performance_class_id);
+  }
+  if (!JS_IsRegisteredClass(rt, js_performance_class_id)) {
+    JS_NewClass(rt, js_performance_class_id, &js_performance_class_def);
+  }
+
+  PerformanceTimeline *timeline = calloc(1, sizeof(PerformanceTimeline));
+  if (!timeline)
+    return JS_UNDEFINED;
+
+  JSValue performance = JS_NewObjectClass(ctx, js_performance_class_id);
+  if (JS_IsException(performance)) {
+    free(timeline);
+    return JS_UNDEFINED;
+  }
+  JS_SetOpaque(performance, timeline);
+  JS_SetPropertyFunctionList(ctx, performance, js_performance_funcs, countof(js_performance_funcs));
+
+  JSValue global_obj = JS_GetGlobalObject(ctx);
+  JS_SetPropertyStr(ctx, global_obj, "performance", JS_DupValue(ctx, performance));
+  JS_FreeValue(ctx, global_obj);
+  return performance;
+}
@@ -0,0 +1,61 @@
+#ifndef WINTERQ_PERFORMANCE_H
+#define WINTERQ_PERFORMANCE_H
+
+#include <stdint.h>
+
+#include "quickjs.h"
+
+// 每个上下文最多保留的性能条目数，超出后覆盖最早的条目
+#define PERFORMANCE_BUFFER_SIZE 256
+// 条目名称最大长度（含结尾的 '\0'），过长的名称会被截断
+#define PERFORMANCE_NAME_MAX 48
+
+typedef enum PerformanceEntryTypeEnum {
+  PERFORMANCE_ENTRY_NONE, // 已被 clearMarks / clearMeasures 清除
+  PERFORMANCE_ENTRY_MARK,
+  PERFORMANCE_ENTRY_MEASURE,
+} PerformanceEntryTypeEnum;
+
+// 性能条目，时间均为距离时间原点的毫秒数
+typedef struct PerformanceEntry {
+  char name[PERFORMANCE_NAME_MAX];
+  PerformanceEntryTypeEnum type;
+  double start_time;
+  double duration;
+} PerformanceEntry;
+
+// 每个上下文的性能条目环形缓冲区，在第一次 mark/measure 时分配
+typedef struct PerformanceTimeline {
+  PerformanceEntry *entries;
+  uint32_t head;  // 最早条目的下标
+  uint32_t count; // 缓冲区中的条目数
+} PerformanceTimeline;
+
+/**
+ * 在全局对象上安装 performance
+ *
+ * @param ctx JS 上下文
+ * @return performance 对象的一个引用，调用方持有它以保证时间线在上下文释放前有效；
+ *         失败返回 JS_UNDEFINED
+ */
+JSValue js_init_performance(JSContext *ctx);
+
+/**
+ * 获取 performance 对象的性能时间线，不访问全局对象、不执行 JS
+ *
+ * @param performance js_init_performance 返回的对象
+ * @return 时间线指针，不是 performance 对象时返回 NULL
+ */
+PerformanceTimeline *js_performance_timeline(JSValueConst performance);
+
+/**
+ * 按时间顺序复制时间线中的有效条目
+ *
+ * @param timeline 性能时间线
+ * @param out 输出数组
+ * @param max 输出数组容量
+ * @return 复制的条目数
+ */
+int performance_timeline_copy(const PerformanceTimeline *timeline, PerformanceEntry *out, int max);
+
+#endif // WINTERQ_PERFORMANCE_H
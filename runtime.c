@@ -1,14 +1,18 @@
 #include <quickjs.h>
 #include <uv.h>
 
+#include "clock.h"
 #include "log.h"
 #include "mcwp/console.h"
 #include "mcwp/event.h"
 #include "mcwp/headers.h"
+#include "mcwp/performance.h"
 #include "mcwp/url.h"
 #include "runtime.h"
 
 #define MAX_MICROTASK_ITERATIONS 1000
+// 每次 idle 回调最多执行的调度任务时长，超出后让出事件循环处理定时器和 I/O
+#define SCHEDULER_SLICE_NS (5 * 1000 * 1000)
 
 // clang-format off
 #define SAFE_FREE(ptr) do { if (ptr) { free(ptr); ptr = NULL; } } while (0)
@@ -28,6 +32,22 @@ typedef struct {
   int delay;
 } timer_data_t;
 
+// scheduler.postTask / scheduler.yield 提交的任务
+struct scheduler_task {
+  WorkerContext *wctx;
+  JSContext *ctx;
+  JSValue callback; // yield 续体为 JS_UNDEFINED
+  JSValue resolve;
+  JSValue reject;
+  JSValue signal;
+  JSValue abort_listener; // 注册在 signal 上的 abort 监听器
+  int id;
+  SchedulerPriority priority;
+  int is_continuation;
+  uv_timer_t *delay_timer; // 仅在等待 delay 时非空
+  scheduler_task *next;
+};
+
 // Forward declarations
 static WorkerContext *get_worker_context(JSContext *ctx);
 static void execute_microtask_timer(JSContext *ctx);
@@ -39,6 +59,12 @@ static uv_timer_t *find_timer_by_id(WorkerRuntime *wrt, int timer_id);
 static void remove_timer_from_table(WorkerRuntime *wrt, int timer_id);
 static void close_all_handles_walk_cb(uv_handle_t *handle, void *arg);
 static void count_handles_walk_cb(uv_handle_t *handle, void *arg);
+static int context_has_pending_work(WorkerContext *wctx);
+static void init_scheduler(WorkerRuntime *wrt);
+static void cleanup_scheduler(WorkerRuntime *wrt);
+static void collect_performance_entries(WorkerContext *wctx);
+static void scheduler_idle_callback(uv_idle_t *handle);
+static int worker_interrupt_handler(JSRuntime *rt, void *opaque);
 
 WorkerRuntime *Worker_NewRuntime(int max_contexts) {
   if (max_contexts <= 0) {
@@ -76,11 +102,19 @@ WorkerRuntime *Worker_NewRuntime(int max_contexts) {
 
   uv_mutex_init(&wrt->context_mutex);
 
+  // 执行中的任务被取消时中断脚本
+  JS_SetInterruptHandler(rt, worker_interrupt_handler, wrt);
+
   // Initialize the timer table for faster lookups
   init_timer_table(wrt);
 
+  init_scheduler(wrt);
+
   uv_run(wrt->loop, UV_RUN_NOWAIT);
 
+  // 当前线程的粗粒度时钟跟随该事件循环的 uv_now()
+  winterq_clock_bind_loop(wrt->loop);
+
   // Register class ID for worker context if not already done
   if (js_worker_context_class_id == 0) {
     JS_NewClassID(&js_worker_context_class_id);
@@ -93,6 +127,9 @@ void Worker_FreeRuntime(WorkerRuntime *wrt) {
   if (!wrt)
     return;
 
+  // 调度器的句柄和 JS 值需要在通用的句柄清理之前单独释放
+  cleanup_scheduler(wrt);
+
   // Close all active handles in the loop
   uv_walk(wrt->loop, close_all_handles_walk_cb, NULL);
 
@@ -140,6 +177,7 @@ void Worker_FreeRuntime(WorkerRuntime *wrt) {
   // JS_DumpMemoryUsage(stdout, &s, wrt->js_runtime);
   JS_FreeRuntime(wrt->js_runtime);
   wrt->js_runtime = NULL;
+  winterq_clock_unbind_loop(wrt->loop);
   SAFE_FREE(wrt->loop);
   SAFE_FREE(wrt);
 }
@@ -150,6 +188,7 @@ void Worker_FreeContext(WorkerContext *wctx) {
 
   // Cancel all pending timers associated with this context
   Worker_CancelContextTimers(wctx);
+  Worker_CancelContextTasks(wctx);
 
   // 保存回调信息，因为我们将在释放 wctx 之后调用它
   void (*callback)(void *) = wctx->callback;
@@ -174,6 +213,12 @@ void Worker_FreeContext(WorkerContext *wctx) {
   }
   wrt->context_count--;
   uv_mutex_unlock(&wrt->context_mutex);
+
+  // 在释放 JS 上下文之前把 performance 条目交给宿主
+  if (wrt->perf_observer)
+    collect_performance_entries(wctx);
+  JS_FreeValue(wctx->js_context, wctx->performance);
+
   JS_FreeContext(wctx->js_context);
   SAFE_FREE(wctx);
 
@@ -182,6 +227,46 @@ void Worker_FreeContext(WorkerContext *wctx) {
     callback(callback_arg);
 }
 
+static void collect_performance_entries(WorkerContext *wctx) {
+  WorkerRuntime *wrt = wctx->runtime;
+  PerformanceTimeline *timeline = wctx->perf_timeline;
+  if (!timeline || timeline->count == 0)
+    return;
+
+  PerformanceEntry *entries = malloc(timeline->count * sizeof(PerformanceEntry));
+  if (!entries) {
+    WINTERQ_LOG_ERROR("Failed to allocate memory for performance entries");
+    return;
+  }
+
+  int count = performance_timeline_copy(timeline, entries, timeline->count);
+  if (count > 0)
+    wrt->perf_observer(wctx->callback_arg, entries, count, wrt->perf_observer_opaque);
+  SAFE_FREE(entries);
+}
+
+void Worker_SetPerformanceObserver(WorkerRuntime *wrt, WorkerPerformanceObserver observer, void *opaque) {
+  if (!wrt)
+    return;
+  wrt->perf_observer = observer;
+  wrt->perf_observer_opaque = opaque;
+}
+
+// 上下文的取消标志是否已置位
+static int context_cancelled(WorkerContext *wctx) {
+  return wctx->io && wctx->io->cancel && atomic_load(wctx->io->cancel);
+}
+
+// QuickJS 在执行过程中定期调用，返回非零时中断当前执行
+static int worker_interrupt_handler(JSRuntime *rt, void *opaque) {
+  WorkerRuntime *wrt = (WorkerRuntime *)opaque;
+  WorkerContext *wctx = wrt->current;
+  if (!wctx || !context_cancelled(wctx))
+    return 0;
+  wctx->io->cancelled = 1;
+  return 1;
+}
+
 static WorkerContext *get_worker_context(JSContext *ctx) {
   if (!ctx) {
     WINTERQ_LOG_ERROR("NULL context passed to get_worker_context");
@@ -218,6 +303,12 @@ static void execute_microtask_timer(JSContext *ctx) {
     return;
   }
 
+  WorkerContext *wctx = get_worker_context(current_ctx);
+  WorkerRuntime *wrt = wctx ? wctx->runtime : NULL;
+  WorkerContext *prev = wrt ? wrt->current : NULL;
+  if (wrt)
+    wrt->current = wctx;
+
   // 执行所有待处理的任务，但限制最大执行次数以避免无限循环
   int pending_jobs = 0;
   int count = 0;
@@ -226,14 +317,15 @@ static void execute_microtask_timer(JSContext *ctx) {
     count++;
   } while (pending_jobs > 0 && count < MAX_MICROTASK_ITERATIONS);
 
+  if (wrt)
+    wrt->current = prev;
+
   if (count >= MAX_MICROTASK_ITERATIONS && pending_jobs > 0) {
     WINTERQ_LOG_WARNING("Reached maximum microtask iterations (%d)", MAX_MICROTASK_ITERATIONS);
   }
 
-  WorkerContext *wctx = get_worker_context(current_ctx);
-
   // 检查是否可以释放上下文
-  if (wctx && wctx->active_timers == 0 && wctx->pending_free) {
+  if (wctx && !context_has_pending_work(wctx) && wctx->pending_free) {
     Worker_FreeContext(wctx);
   }
 }
@@ -271,7 +363,7 @@ static void close_timer_callback(uv_handle_t *handle) {
   wctx->active_timers--;
 
   // 判断是否是最后一个定时器关闭
-  if (wctx->active_timers == 0) {
+  if (!context_has_pending_work(wctx)) {
     // 当没有定时器时，将上下文标记为可释放
     wctx->pending_free = 1;
     execute_microtask_timer(ctx);
@@ -297,7 +389,10 @@ static void timer_callback(uv_timer_t *handle) {
   }
 
   // 调用JS回调函数
+  WorkerContext *prev = wctx->runtime->current;
+  wctx->runtime->current = wctx;
   JSValue ret = JS_Call(ctx, timer_data->callback, JS_UNDEFINED, 0, NULL);
+  wctx->runtime->current = prev;
   if (JS_IsException(ret)) {
     JSValue exception = JS_GetException(ctx);
     const char *str = JS_ToCString(ctx, exception);
@@ -320,7 +415,7 @@ static void timer_callback(uv_timer_t *handle) {
   uv_close((uv_handle_t *)handle, close_timer_callback);
 
   // 当这是最后一个定时器时，考虑释放上下文
-  if (wctx->active_timers == 1) // 减1后将变为0
+  if (wctx->active_timers == 1 && wctx->pending_tasks == 0) // 减1后将变为0
   {
     wctx->pending_free = 1; // 标记为可释放
   }
@@ -604,6 +699,706 @@ void js_init_timer(JSContext *ctx) {
   JS_FreeValue(ctx, global_obj);
 }
 
+// 上下文是否还有未完成的异步工作（定时器或调度任务）
+static int context_has_pending_work(WorkerContext *wctx) {
+  return wctx->active_timers > 0 || wctx->pending_tasks > 0;
+}
+
+static void init_scheduler(WorkerRuntime *wrt) {
+  if (!wrt)
+    return;
+
+  wrt->scheduler = calloc(1, sizeof(task_scheduler));
+  if (!wrt->scheduler) {
+    WINTERQ_LOG_ERROR("Failed to allocate memory for task scheduler");
+    return;
+  }
+
+  uv_idle_init(wrt->loop, &wrt->scheduler->idle);
+  wrt->scheduler->idle.data = wrt;
+  wrt->scheduler->current_priority = SCHEDULER_PRIORITY_USER_VISIBLE;
+}
+
+static void free_scheduler_task(scheduler_task *task) {
+  JSContext *ctx = task->ctx;
+  SAFE_JS_FREEVALUE(ctx, task->callback);
+  SAFE_JS_FREEVALUE(ctx, task->resolve);
+  SAFE_JS_FREEVALUE(ctx, task->reject);
+  SAFE_JS_FREEVALUE(ctx, task->signal);
+  SAFE_JS_FREEVALUE(ctx, task->abort_listener);
+  SAFE_FREE(task);
+}
+
+static void close_delay_timer_callback(uv_handle_t *handle) { SAFE_FREE(handle); }
+
+static void scheduler_enqueue(task_scheduler *sched, scheduler_task *task) {
+  scheduler_queue *queue = &sched->queues[task->priority][task->is_continuation ? 0 : 1];
+
+  task->next = NULL;
+  if (queue->tail) {
+    queue->tail->next = task;
+  } else {
+    queue->head = task;
+  }
+  queue->tail = task;
+
+  if (!uv_is_active((uv_handle_t *)&sched->idle)) {
+    uv_idle_start(&sched->idle, scheduler_idle_callback);
+  }
+}
+
+// 按优先级取出下一个任务：同一优先级内续体先于普通任务
+static scheduler_task *scheduler_dequeue(task_scheduler *sched) {
+  for (int p = 0; p < SCHEDULER_PRIORITY_COUNT; p++) {
+    for (int k = 0; k < 2; k++) {
+      scheduler_queue *queue = &sched->queues[p][k];
+      scheduler_task *task = queue->head;
+      if (task) {
+        queue->head = task->next;
+        if (!queue->head)
+          queue->tail = NULL;
+        task->next = NULL;
+        return task;
+      }
+    }
+  }
+  return NULL;
+}
+
+// 从延迟链表中摘除任务
+static void scheduler_unlink_delayed(task_scheduler *sched, scheduler_task *task) {
+  scheduler_task **pp = &sched->delayed;
+  while (*pp) {
+    if (*pp == task) {
+      *pp = task->next;
+      task->next = NULL;
+      return;
+    }
+    pp = &(*pp)->next;
+  }
+}
+
+static void scheduler_delay_callback(uv_timer_t *handle) {
+  scheduler_task *task = (scheduler_task *)handle->data;
+  WorkerRuntime *wrt = task->wctx->runtime;
+
+  task->delay_timer = NULL;
+  handle->data = NULL;
+  uv_close((uv_handle_t *)handle, close_delay_timer_callback);
+
+  scheduler_unlink_delayed(wrt->scheduler, task);
+  scheduler_enqueue(wrt->scheduler, task);
+}
+
+// signal.reason，未设置时为 AbortError
+static JSValue scheduler_abort_reason(JSContext *ctx, JSValueConst signal) {
+  JSValue reason = JS_GetPropertyStr(ctx, signal, "reason");
+  if (JS_IsUndefined(reason) || JS_IsException(reason)) {
+    reason = JS_NewError(ctx);
+    JS_SetPropertyStr(ctx, reason, "name", JS_NewString(ctx, "AbortError"));
+    JS_SetPropertyStr(ctx, reason, "message", JS_NewString(ctx, "The task was aborted"));
+  }
+  return reason;
+}
+
+// 检查 signal 是否已中止，若已中止返回 1 并通过 reason 输出拒绝原因
+static int scheduler_signal_aborted(JSContext *ctx, JSValueConst signal, JSValue *reason) {
+  if (!JS_IsObject(signal))
+    return 0;
+
+  JSValue aborted_val = JS_GetPropertyStr(ctx, signal, "aborted");
+  int aborted = JS_ToBool(ctx, aborted_val);
+  JS_FreeValue(ctx, aborted_val);
+  if (aborted <= 0)
+    return 0;
+
+  *reason = scheduler_abort_reason(ctx, signal);
+  return 1;
+}
+
+// 调用 signal 上的 addEventListener / removeEventListener("abort", listener)
+static void scheduler_signal_listen(JSContext *ctx, JSValueConst signal, const char *method, JSValueConst listener) {
+  JSValue func = JS_GetPropertyStr(ctx, signal, method);
+  if (JS_IsFunction(ctx, func)) {
+    JSValue args[2] = {JS_NewString(ctx, "abort"), JS_DupValue(ctx, listener)};
+    JSValue ret = JS_Call(ctx, func, signal, 2, args);
+    if (JS_IsException(ret))
+      JS_FreeValue(ctx, JS_GetException(ctx));
+    JS_FreeValue(ctx, ret);
+    JS_FreeValue(ctx, args[0]);
+    JS_FreeValue(ctx, args[1]);
+  } else if (JS_IsException(func)) {
+    JS_FreeValue(ctx, JS_GetException(ctx));
+  }
+  JS_FreeValue(ctx, func);
+}
+
+// 任务开始执行或被中止后不再需要监听 signal
+static void scheduler_detach_abort(scheduler_task *task) {
+  if (JS_IsUndefined(task->abort_listener))
+    return;
+  scheduler_signal_listen(task->ctx, task->signal, "removeEventListener", task->abort_listener);
+  JS_FreeValue(task->ctx, task->abort_listener);
+  task->abort_listener = JS_UNDEFINED;
+}
+
+// 按编号从就绪队列或延迟链表中摘除任务，已经执行或被取消时返回 NULL
+static scheduler_task *scheduler_take_task(task_scheduler *sched, int id) {
+  for (int p = 0; p < SCHEDULER_PRIORITY_COUNT; p++) {
+    for (int k = 0; k < 2; k++) {
+      scheduler_queue *queue = &sched->queues[p][k];
+      scheduler_task *prev = NULL;
+      for (scheduler_task *task = queue->head; task; prev = task, task = task->next) {
+        if (task->id != id)
+          continue;
+        if (prev)
+          prev->next = task->next;
+        else
+          queue->head = task->next;
+        if (queue->tail == task)
+          queue->tail = prev;
+        task->next = NULL;
+        return task;
+      }
+    }
+  }
+
+  for (scheduler_task *task = sched->delayed; task; task = task->next) {
+    if (task->id != id)
+      continue;
+    scheduler_unlink_delayed(sched, task);
+    uv_timer_stop(task->delay_timer);
+    task->delay_timer->data = NULL;
+    uv_close((uv_handle_t *)task->delay_timer, close_delay_timer_callback);
+    task->delay_timer = NULL;
+    return task;
+  }
+  return NULL;
+}
+
+static void settle_promise(JSContext *ctx, JSValueConst func, JSValueConst value) {
+  JSValue ret = JS_Call(ctx, func, JS_UNDEFINED, 1, &value);
+  SAFE_JS_FREEVALUE(ctx, ret);
+}
+
+// 执行一个调度任务，执行完毕后释放任务并在需要时释放上下文
+static void run_scheduler_task(task_scheduler *sched, scheduler_task *task) {
+  WorkerContext *wctx = task->wctx;
+  JSContext *ctx = task->ctx;
+  JSValue reason;
+
+  sched->pending--;
+  sched->current_priority = task->priority;
+
+  WorkerContext *prev = wctx->runtime->current;
+  wctx->runtime->current = wctx;
+  scheduler_detach_abort(task);
+  if (scheduler_signal_aborted(ctx, task->signal, &reason)) {
+    settle_promise(ctx, task->reject, reason);
+    JS_FreeValue(ctx, reason);
+  } else if (task->is_continuation) {
+    settle_promise(ctx, task->resolve, JS_UNDEFINED);
+  } else {
+    JSValue ret = JS_Call(ctx, task->callback, JS_UNDEFINED, 0, NULL);
+    if (JS_IsException(ret)) {
+      JSValue exception = JS_GetException(ctx);
+      settle_promise(ctx, task->reject, exception);
+      JS_FreeValue(ctx, exception);
+    } else {
+      settle_promise(ctx, task->resolve, ret);
+      JS_FreeValue(ctx, ret);
+    }
+  }
+  wctx->runtime->current = prev;
+
+  free_scheduler_task(task);
+
+  wctx->pending_tasks--;
+  if (!context_has_pending_work(wctx)) {
+    wctx->pending_free = 1;
+  }
+
+  // 处理任务产生的微任务（包括 await scheduler.yield() 之后的续体）
+  execute_microtask_timer(ctx);
+
+  sched->current_priority = SCHEDULER_PRIORITY_USER_VISIBLE;
+}
+
+static void scheduler_idle_callback(uv_idle_t *handle) {
+  WorkerRuntime *wrt = (WorkerRuntime *)handle->data;
+  task_scheduler *sched = wrt->scheduler;
+  uint64_t deadline = uv_hrtime() + SCHEDULER_SLICE_NS;
+  scheduler_task *task;
+
+  while ((task = scheduler_dequeue(sched)) != NULL) {
+    run_scheduler_task(sched, task);
+    if (uv_hrtime() >= deadline)
+      break;
+  }
+
+  // 队列为空时停止 idle 句柄，让事件循环可以阻塞等待
+  for (int p = 0; p < SCHEDULER_PRIORITY_COUNT; p++) {
+    if (sched->queues[p][0].head || sched->queues[p][1].head)
+      return;
+  }
+  uv_idle_stop(handle);
+}
+
+static void close_scheduler_callback(uv_handle_t *handle) {
+  task_scheduler *sched = (task_scheduler *)handle->data;
+  SAFE_FREE(sched);
+}
+
+static void cleanup_scheduler(WorkerRuntime *wrt) {
+  if (!wrt || !wrt->scheduler)
+    return;
+
+  task_scheduler *sched = wrt->scheduler;
+  scheduler_task *task;
+
+  while ((task = scheduler_dequeue(sched)) != NULL) {
+    task->wctx->pending_tasks--;
+    free_scheduler_task(task);
+  }
+
+  while ((task = sched->delayed) != NULL) {
+    sched->delayed = task->next;
+    uv_timer_stop(task->delay_timer);
+    task->delay_timer->data = NULL;
+    uv_close((uv_handle_t *)task->delay_timer, close_delay_timer_callback);
+    task->wctx->pending_tasks--;
+    free_scheduler_task(task);
+  }
+
+  // idle 句柄内嵌在调度器结构体中，在关闭回调里一并释放
+  uv_idle_stop(&sched->idle);
+  sched->idle.data = sched;
+  uv_close((uv_handle_t *)&sched->idle, close_scheduler_callback);
+  wrt->scheduler = NULL;
+}
+
+// 从队列中移除属于指定上下文的任务
+static void scheduler_remove_context_tasks(scheduler_task **head, scheduler_task **tail, WorkerContext *wctx, int *removed) {
+  scheduler_task **pp = head;
+  scheduler_task *prev = NULL;
+
+  while (*pp) {
+    scheduler_task *task = *pp;
+    if (task->wctx == wctx) {
+      *pp = task->next;
+      if (task->delay_timer) {
+        uv_timer_stop(task->delay_timer);
+        task->delay_timer->data = NULL;
+        uv_close((uv_handle_t *)task->delay_timer, close_delay_timer_callback);
+      }
+      free_scheduler_task(task);
+      (*removed)++;
+    } else {
+      prev = task;
+      pp = &task->next;
+    }
+  }
+
+  if (tail)
+    *tail = prev;
+}
+
+// Cancel all scheduler tasks for a context
+void Worker_CancelContextTasks(WorkerContext *wctx) {
+  if (!wctx || !wctx->runtime || !wctx->runtime->scheduler || wctx->pending_tasks == 0)
+    return;
+
+  task_scheduler *sched = wctx->runtime->scheduler;
+  int removed = 0;
+
+  for (int p = 0; p < SCHEDULER_PRIORITY_COUNT; p++) {
+    for (int k = 0; k < 2; k++) {
+      scheduler_queue *queue = &sched->queues[p][k];
+      scheduler_remove_context_tasks(&queue->head, &queue->tail, wctx, &removed);
+    }
+  }
+  scheduler_remove_context_tasks(&sched->delayed, NULL, wctx, &removed);
+
+  sched->pending -= removed;
+  wctx->pending_tasks = 0;
+}
+
+static int parse_scheduler_priority(JSContext *ctx, JSValueConst val, SchedulerPriority *priority) {
+  static const char *names[SCHEDULER_PRIORITY_COUNT] = {"user-blocking", "user-visible", "background"};
+
+  const char *str = JS_ToCString(ctx, val);
+  if (!str)
+    return -1;
+
+  for (int i = 0; i < SCHEDULER_PRIORITY_COUNT; i++) {
+    if (!strcmp(str, names[i])) {
+      *priority = (SchedulerPriority)i;
+      JS_FreeCString(ctx, str);
+      return 0;
+    }
+  }
+
+  JS_ThrowTypeError(ctx, "Invalid task priority: '%s'", str);
+  JS_FreeCString(ctx, str);
+  return -1;
+}
+
+// signal 的 abort 监听器：任务仍在等待时立即移出队列并拒绝，不必等到 delay 到期或轮到执行
+static JSValue scheduler_abort_listener(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv, int magic, JSValue *func_data) {
+  WorkerContext *wctx = get_worker_context(ctx);
+  if (!wctx || !wctx->runtime->scheduler)
+    return JS_UNDEFINED;
+
+  int id;
+  if (JS_ToInt32(ctx, &id, func_data[0]))
+    return JS_EXCEPTION;
+
+  task_scheduler *sched = wctx->runtime->scheduler;
+  scheduler_task *task = scheduler_take_task(sched, id);
+  if (!task)
+    return JS_UNDEFINED;
+
+  sched->pending--;
+  scheduler_detach_abort(task);
+  JSValue reason = scheduler_abort_reason(ctx, task->signal);
+  settle_promise(ctx, task->reject, reason);
+  JS_FreeValue(ctx, reason);
+
+  WorkerContext *owner = task->wctx;
+  free_scheduler_task(task);
+  // 由当前正在执行的回调结束后释放上下文
+  owner->pending_tasks--;
+  if (!context_has_pending_work(owner)) {
+    owner->pending_free = 1;
+  }
+  return JS_UNDEFINED;
+}
+
+// 创建任务及其 Promise，返回 Promise；失败返回 JS_EXCEPTION
+static JSValue scheduler_post(JSContext *ctx, JSValueConst callback, SchedulerPriority priority, int64_t delay, JSValueConst signal) {
+  WorkerContext *wctx = get_worker_context(ctx);
+  if (!wctx || !wctx->runtime->scheduler) {
+    return JS_ThrowInternalError(ctx, "Worker context not found");
+  }
+  WorkerRuntime *wrt = wctx->runtime;
+
+  JSValue resolving_funcs[2];
+  JSValue promise = JS_NewPromiseCapability(ctx, resolving_funcs);
+  if (JS_IsException(promise))
+    return promise;
+
+  // signal 已经中止时直接拒绝，不进入队列
+  JSValue reason;
+  if (scheduler_signal_aborted(ctx, signal, &reason)) {
+    settle_promise(ctx, resolving_funcs[1], reason);
+    JS_FreeValue(ctx, reason);
+    JS_FreeValue(ctx, resolving_funcs[0]);
+    JS_FreeValue(ctx, resolving_funcs[1]);
+    return promise;
+  }
+
+  scheduler_task *task = calloc(1, sizeof(scheduler_task));
+  if (!task) {
+    JS_FreeValue(ctx, resolving_funcs[0]);
+    JS_FreeValue(ctx, resolving_funcs[1]);
+    JS_FreeValue(ctx, promise);
+    return JS_ThrowOutOfMemory(ctx);
+  }
+
+  task->wctx = wctx;
+  task->ctx = ctx;
+  task->callback = JS_IsUndefined(callback) ? JS_UNDEFINED : JS_DupValue(ctx, callback);
+  task->resolve = resolving_funcs[0];
+  task->reject = resolving_funcs[1];
+  task->signal = JS_IsObject(signal) ? JS_DupValue(ctx, signal) : JS_UNDEFINED;
+  task->abort_listener = JS_UNDEFINED;
+  task->id = ++wrt->scheduler->next_id;
+  task->priority = priority;
+  task->is_continuation = JS_IsUndefined(callback);
+
+  wrt->scheduler->pending++;
+  wctx->pending_tasks++;
+
+  // 监听 signal 的 abort 事件，等待中的任务被中止时立即拒绝
+  if (JS_IsObject(signal)) {
+    JSValue id = JS_NewInt32(ctx, task->id);
+    JSValue listener = JS_NewCFunctionData(ctx, scheduler_abort_listener, 1, 0, 1, &id);
+    if (!JS_IsException(listener)) {
+      task->abort_listener = listener;
+      scheduler_signal_listen(ctx, signal, "addEventListener", listener);
+    } else {
+      JS_FreeValue(ctx, JS_GetException(ctx));
+    }
+  }
+
+  if (delay > 0) {
+    task->delay_timer = malloc(sizeof(uv_timer_t));
+    if (task->delay_timer) {
+      uv_timer_init(wrt->loop, task->delay_timer);
+      task->delay_timer->data = task;
+      task->next = wrt->scheduler->delayed;
+      wrt->scheduler->delayed = task;
+      uv_timer_start(task->delay_timer, scheduler_delay_callback, delay, 0);
+      return promise;
+    }
+    // 分配失败时退化为立即调度
+  }
+
+  scheduler_enqueue(wrt->scheduler, task);
+  return promise;
+}
+
+// scheduler.postTask(callback, { priority, delay, signal })
+static JSValue js_scheduler_post_task(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+  if (argc < 1 || !JS_IsFunction(ctx, argv[0])) {
+    return JS_ThrowTypeError(ctx, "scheduler.postTask requires a function");
+  }
+
+  SchedulerPriority priority = SCHEDULER_PRIORITY_USER_VISIBLE;
+  int64_t delay = 0;
+  JSValue signal = JS_UNDEFINED;
+
+  if (argc > 1 && JS_IsObject(argv[1])) {
+    signal = JS_GetPropertyStr(ctx, argv[1], "signal");
+
+    JSValue priority_val = JS_GetPropertyStr(ctx, argv[1], "priority");
+    // 未指定 priority 时使用 TaskSignal 上的优先级
+    if (JS_IsUndefined(priority_val) && JS_IsObject(signal)) {
+      priority_val = JS_GetPropertyStr(ctx, signal, "priority");
+    }
+    if (!JS_IsUndefined(priority_val) && parse_scheduler_priority(ctx, priority_val, &priority) < 0) {
+      JS_FreeValue(ctx, priority_val);
+      JS_FreeValue(ctx, signal);
+      return JS_EXCEPTION;
+    }
+    JS_FreeValue(ctx, priority_val);
+
+    JSValue delay_val = JS_GetPropertyStr(ctx, argv[1], "delay");
+    if (!JS_IsUndefined(delay_val) && JS_ToInt64(ctx, &delay, delay_val)) {
+      JS_FreeValue(ctx, delay_val);
+      JS_FreeValue(ctx, signal);
+      return JS_EXCEPTION;
+    }
+    JS_FreeValue(ctx, delay_val);
+  }
+
+  JSValue promise = scheduler_post(ctx, argv[0], priority, delay, signal);
+  JS_FreeValue(ctx, signal);
+  return promise;
+}
+
+// scheduler.yield()：续体继承当前任务的优先级，并排在同优先级普通任务之前
+static JSValue js_scheduler_yield(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+  WorkerContext *wctx = get_worker_context(ctx);
+  if (!wctx || !wctx->runtime->scheduler) {
+    return JS_ThrowInternalError(ctx, "Worker context not found");
+  }
+
+  return scheduler_post(ctx, JS_UNDEFINED, wctx->runtime->scheduler->current_priority, 0, JS_UNDEFINED);
+}
+
+static const JSCFunctionListEntry js_scheduler_funcs[] = {
+    JS_CFUNC_DEF("postTask", 1, js_scheduler_post_task),
+    JS_CFUNC_DEF("yield", 0, js_scheduler_yield),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "Scheduler", JS_PROP_CONFIGURABLE),
+};
+
+void js_init_scheduler(JSContext *ctx) {
+  if (!ctx) {
+    WINTERQ_LOG_ERROR("NULL context passed to js_init_scheduler");
+    return;
+  }
+  JSValue global_obj = JS_GetGlobalObject(ctx);
+  JSValue scheduler = JS_NewObject(ctx);
+
+  JS_SetPropertyFunctionList(ctx, scheduler, js_scheduler_funcs, countof(js_scheduler_funcs));
+  JS_SetPropertyStr(ctx, global_obj, "scheduler", scheduler);
+
+  JS_FreeValue(ctx, global_obj);
+}
+
+// winterq.setOutput(value)：value 为 ArrayBuffer、TypedArray 或字符串（UTF-8），内容被复制
+static JSValue js_winterq_set_output(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+  WorkerContext *wctx = get_worker_context(ctx);
+  if (!wctx) {
+    return JS_ThrowInternalError(ctx, "Worker context not found");
+  }
+  if (!wctx->io) {
+    return JS_ThrowTypeError(ctx, "This task has no output");
+  }
+  if (argc < 1) {
+    return JS_ThrowTypeError(ctx, "setOutput requires 1 argument");
+  }
+
+  const uint8_t *data = NULL;
+  size_t len = 0;
+  const char *str = NULL;
+  JSValue buffer = JS_UNDEFINED;
+
+  if (JS_IsString(argv[0])) {
+    str = JS_ToCStringLen(ctx, &len, argv[0]);
+    if (!str)
+      return JS_EXCEPTION;
+    data = (const uint8_t *)str;
+  } else {
+    size_t offset = 0, bytes_per_element = 0;
+    buffer = JS_GetTypedArrayBuffer(ctx, argv[0], &offset, &len, &bytes_per_element);
+    if (JS_IsException(buffer)) {
+      // 不是 TypedArray，按 ArrayBuffer 处理
+      JS_FreeValue(ctx, JS_GetException(ctx));
+      buffer = JS_UNDEFINED;
+      data = JS_GetArrayBuffer(ctx, &len, argv[0]);
+      if (!data)
+        return JS_EXCEPTION;
+    } else {
+      size_t buffer_len = 0;
+      uint8_t *base = JS_GetArrayBuffer(ctx, &buffer_len, buffer);
+      if (!base) {
+        JS_FreeValue(ctx, buffer);
+        return JS_EXCEPTION;
+      }
+      data = base + offset;
+    }
+  }
+
+  uint8_t *output = malloc(len > 0 ? len : 1);
+  if (output)
+    memcpy(output, data, len);
+  if (str)
+    JS_FreeCString(ctx, str);
+  SAFE_JS_FREEVALUE(ctx, buffer);
+  if (!output) {
+    return JS_ThrowOutOfMemory(ctx);
+  }
+
+  free(wctx->io->output);
+  wctx->io->output = output;
+  wctx->io->output_len = len;
+  return JS_UNDEFINED;
+}
+
+static const JSCFunctionListEntry js_winterq_funcs[] = {
+    JS_CFUNC_DEF("setOutput", 1, js_winterq_set_output),
+};
+
+// 全局对象 winterq，inputs 在执行前由 set_task_inputs 填充
+static void js_init_winterq(JSContext *ctx) {
+  JSValue global_obj = JS_GetGlobalObject(ctx);
+  JSValue winterq = JS_NewObject(ctx);
+
+  JS_SetPropertyFunctionList(ctx, winterq, js_winterq_funcs, countof(js_winterq_funcs));
+  JS_SetPropertyStr(ctx, winterq, "inputs", JS_NewArray(ctx));
+  JS_SetPropertyStr(ctx, global_obj, "winterq", winterq);
+
+  JS_FreeValue(ctx, global_obj);
+}
+
+WorkerSharedBuffer *Worker_NewSharedBuffer(const void *data, size_t len, const char *content_type) {
+  if (!data && len > 0)
+    return NULL;
+
+  // 结构体、内容和内容类型一次分配
+  size_t type_len = content_type ? strlen(content_type) + 1 : 0;
+  WorkerSharedBuffer *buf = malloc(sizeof(WorkerSharedBuffer) + len + type_len);
+  if (!buf) {
+    WINTERQ_LOG_ERROR("Failed to allocate memory for shared buffer");
+    return NULL;
+  }
+  atomic_init(&buf->refs, 1);
+  buf->data = (uint8_t *)(buf + 1);
+  buf->len = len;
+  if (len > 0)
+    memcpy(buf->data, data, len);
+  buf->content_type = NULL;
+  if (content_type) {
+    buf->content_type = (char *)buf->data + len;
+    memcpy(buf->content_type, content_type, type_len);
+  }
+  buf->free_func = NULL;
+  buf->opaque = NULL;
+  return buf;
+}
+
+WorkerSharedBuffer *Worker_WrapSharedBuffer(uint8_t *data, size_t len, const char *content_type,
+                                            void (*free_func)(void *opaque, uint8_t *data), void *opaque) {
+  if ((!data && len > 0) || !free_func)
+    return NULL;
+
+  size_t type_len = content_type ? strlen(content_type) + 1 : 0;
+  WorkerSharedBuffer *buf = malloc(sizeof(WorkerSharedBuffer) + type_len);
+  if (!buf) {
+    WINTERQ_LOG_ERROR("Failed to allocate memory for shared buffer");
+    return NULL;
+  }
+  atomic_init(&buf->refs, 1);
+  buf->data = data;
+  buf->len = len;
+  buf->content_type = NULL;
+  if (content_type) {
+    buf->content_type = (char *)(buf + 1);
+    memcpy(buf->content_type, content_type, type_len);
+  }
+  buf->free_func = free_func;
+  buf->opaque = opaque;
+  return buf;
+}
+
+WorkerSharedBuffer *Worker_RetainSharedBuffer(WorkerSharedBuffer *buf) {
+  if (buf)
+    atomic_fetch_add(&buf->refs, 1);
+  return buf;
+}
+
+void Worker_ReleaseSharedBuffer(WorkerSharedBuffer *buf) {
+  if (!buf || atomic_fetch_sub(&buf->refs, 1) != 1)
+    return;
+  if (buf->free_func)
+    buf->free_func(buf->opaque, buf->data);
+  SAFE_FREE(buf);
+}
+
+// ArrayBuffer 被回收时释放它持有的负载引用
+static void js_shared_buffer_free(JSRuntime *rt, void *opaque, void *ptr) {
+  Worker_ReleaseSharedBuffer((WorkerSharedBuffer *)opaque);
+}
+
+// 把任务输入复制为 winterq.inputs 中的 ArrayBuffer，负载不复制直接交给脚本
+static void set_task_inputs(WorkerContext *wctx, WorkerTaskIO *io) {
+  wctx->io = io;
+  if (!io || (io->input_count <= 0 && !io->payload))
+    return;
+
+  JSContext *ctx = wctx->js_context;
+  JSValue global_obj = JS_GetGlobalObject(ctx);
+  JSValue winterq = JS_GetPropertyStr(ctx, global_obj, "winterq");
+
+  if (io->input_count > 0) {
+    JSValue inputs = JS_NewArray(ctx);
+    for (int i = 0; i < io->input_count; i++) {
+      const WorkerBuffer *input = &io->inputs[i];
+      JS_SetPropertyUint32(ctx, inputs, i, JS_NewArrayBufferCopy(ctx, input->data, input->len));
+    }
+    JS_SetPropertyStr(ctx, winterq, "inputs", inputs);
+  }
+
+  if (io->payload) {
+    WorkerSharedBuffer *payload = Worker_RetainSharedBuffer(io->payload);
+    JSValue buffer = JS_NewArrayBuffer(ctx, payload->data, payload->len, js_shared_buffer_free, payload, 0);
+    if (JS_IsException(buffer)) {
+      // 创建失败时不会调用释放函数
+      Worker_ReleaseSharedBuffer(payload);
+      JS_FreeValue(ctx, JS_GetException(ctx));
+    } else {
+      JS_SetPropertyStr(ctx, winterq, "payload", buffer);
+    }
+    if (payload->content_type)
+      JS_SetPropertyStr(ctx, winterq, "contentType", JS_NewString(ctx, payload->content_type));
+  }
+
+  JS_FreeValue(ctx, winterq);
+  JS_FreeValue(ctx, global_obj);
+}
+
 WorkerContext *Worker_NewContext(WorkerRuntime *wrt) {
   if (!wrt) {
     WINTERQ_LOG_ERROR("NULL runtime passed to Worker_NewContext");
@@ -636,8 +1431,10 @@ WorkerContext *Worker_NewContext(WorkerRuntime *wrt) {
   wrt->context_count++;
   wctx->js_context = ctx;
   wctx->active_timers = 0;
+  wctx->pending_tasks = 0;
   wctx->runtime = wrt;
   wctx->pending_free = 0;
+  wctx->performance = JS_UNDEFINED;
 
   wctx->next = wrt->context_list;
   wrt->context_list = wctx;
@@ -652,9 +1449,13 @@ WorkerContext *Worker_NewContext(WorkerRuntime *wrt) {
 
   js_init_console(ctx);
   js_init_timer(ctx);
+  js_init_scheduler(ctx);
   js_init_headers(ctx);
   js_init_url(ctx);
   js_init_event(ctx);
+  wctx->performance = js_init_performance(ctx);
+  wctx->perf_timeline = js_performance_timeline(wctx->performance);
+  js_init_winterq(ctx);
 
   SAFE_JS_FREEVALUE(ctx, global);
 
@@ -662,24 +1463,37 @@ WorkerContext *Worker_NewContext(WorkerRuntime *wrt) {
 }
 
 int Worker_Eval_JS(WorkerRuntime *wrt, const char *script, void (*callback)(void *), void *callback_arg) {
+  return Worker_Eval_JS_IO(wrt, script, NULL, callback, callback_arg);
+}
+
+int Worker_Eval_JS_IO(WorkerRuntime *wrt, const char *script, WorkerTaskIO *io, void (*callback)(void *), void *callback_arg) {
   if (!wrt) {
     WINTERQ_LOG_ERROR("NULL runtime passed to Worker_Eval_JS");
-    return 1;
+    return -1;
   }
   if (!script) {
     WINTERQ_LOG_ERROR("NULL script passed to Worker_Eval_JS");
-    return 1;
+    return -1;
   }
 
   WorkerContext *wctx = Worker_NewContext(wrt);
+  if (!wctx) {
+    WINTERQ_LOG_ERROR("Failed to create new context");
+    return -1;
+  }
   JSContext *ctx = wctx->js_context;
 
   // 存储回调函数和参数
   wctx->callback = callback;
   wctx->callback_arg = callback_arg;
+  set_task_inputs(wctx, io);
 
+  wrt->current = wctx;
   JSValue result = JS_Eval(ctx, script, strlen(script), "<input>", JS_EVAL_TYPE_GLOBAL);
+  wrt->current = NULL;
   if (JS_IsException(result)) {
+    if (io)
+      io->error = 1;
     JSValue exc = JS_GetException(ctx);
     const char *str = JS_ToCString(ctx, exc);
     if (str) {
@@ -705,7 +1519,7 @@ int Worker_Eval_JS(WorkerRuntime *wrt, const char *script, void (*callback)(void
   execute_microtask_timer(ctx);
 
   // Only run GC when necessary, not on every evaluation
-  if (wctx->active_timers == 0) {
+  if (!context_has_pending_work(wctx)) {
     JS_RunGC(wrt->js_runtime);
     // 脚本执行完毕且没有活跃定时器，可以安全释放
     Worker_RequestContextFree(wctx);
@@ -715,19 +1529,23 @@ int Worker_Eval_JS(WorkerRuntime *wrt, const char *script, void (*callback)(void
 }
 
 int Worker_Eval_Bytecode(WorkerRuntime *wrt, uint8_t *bytecode, size_t bytecode_len, void (*callback)(void *), void *callback_arg) {
+  return Worker_Eval_Bytecode_IO(wrt, bytecode, bytecode_len, NULL, callback, callback_arg);
+}
+
+int Worker_Eval_Bytecode_IO(WorkerRuntime *wrt, uint8_t *bytecode, size_t bytecode_len, WorkerTaskIO *io, void (*callback)(void *), void *callback_arg) {
   if (!wrt) {
     WINTERQ_LOG_ERROR("NULL runtime passed to Worker_Eval_Bytecode");
-    return 1;
+    return -1;
   }
   if (!bytecode || bytecode_len == 0) {
     WINTERQ_LOG_ERROR("Invalid bytecode data passed to Worker_Eval_Bytecode");
-    return 1;
+    return -1;
   }
 
   WorkerContext *wctx = Worker_NewContext(wrt);
   if (!wctx) {
     WINTERQ_LOG_ERROR("Failed to create new context");
-    return 1;
+    return -1;
   }
 
   // 存储回调函数和参数
@@ -735,10 +1553,13 @@ int Worker_Eval_Bytecode(WorkerRuntime *wrt, uint8_t *bytecode, size_t bytecode_
   wctx->callback_arg = callback_arg;
 
   JSContext *ctx = wctx->js_context;
+  set_task_inputs(wctx, io);
 
   // Load bytecode
   JSValue loadedVal = JS_ReadObject(ctx, bytecode, bytecode_len, JS_READ_OBJ_BYTECODE);
   if (JS_IsException(loadedVal)) {
+    if (io)
+      io->error = 1;
     JSValue exc = JS_GetException(ctx);
     const char *str = JS_ToCString(ctx, exc);
     if (str) {
@@ -757,8 +1578,12 @@ int Worker_Eval_Bytecode(WorkerRuntime *wrt, uint8_t *bytecode, size_t bytecode_
   }
 
   // Execute loaded bytecode
+  wrt->current = wctx;
   JSValue result = JS_EvalFunction(ctx, loadedVal);
+  wrt->current = NULL;
   if (JS_IsException(result)) {
+    if (io)
+      io->error = 1;
     JSValue exc = JS_GetException(ctx);
     const char *str = JS_ToCString(ctx, exc);
     if (str) {
@@ -780,7 +1605,7 @@ int Worker_Eval_Bytecode(WorkerRuntime *wrt, uint8_t *bytecode, size_t bytecode_
   execute_microtask_timer(ctx);
 
   // Only run GC when necessary, not on every evaluation
-  if (wctx->active_timers == 0) {
+  if (!context_has_pending_work(wctx)) {
     JS_RunGC(wrt->js_runtime);
     // 脚本执行完毕且没有活跃定时器，可以安全释放
     Worker_RequestContextFree(wctx);
@@ -814,11 +1639,26 @@ void Worker_RequestContextFree(WorkerContext *wctx) {
   wctx->pending_free = 1;
 
   // If there are no active timers, free immediately
-  if (wctx->active_timers == 0) {
+  if (!context_has_pending_work(wctx)) {
     Worker_FreeContext(wctx);
   }
 }
 
+void Worker_ReapCancelledContexts(WorkerRuntime *wrt) {
+  if (!wrt)
+    return;
+
+  WorkerContext *wctx = wrt->context_list;
+  while (wctx) {
+    WorkerContext *next = wctx->next;
+    if (context_cancelled(wctx)) {
+      wctx->io->cancelled = 1;
+      Worker_FreeContext(wctx);
+    }
+    wctx = next;
+  }
+}
+
 // Get runtime statistics
 void Worker_GetRuntimeStats(WorkerRuntime *wrt, WorkerRuntimeStats *stats) {
   if (!wrt || !stats)
@@ -1,11 +1,14 @@
 #ifndef WINTERQ_RUNTIME_H
 #define WINTERQ_RUNTIME_H
 
+#include <stdatomic.h>
 #include <stdint.h>
 
 #include <quickjs.h>
 #include <uv.h>
 
+#include "mcwp/performance.h"
+
 typedef struct WorkerContext WorkerContext;
 typedef struct WorkerRuntime WorkerRuntime;
 
@@ -22,6 +25,71 @@ typedef struct {
   uv_mutex_t mutex;
 } timer_table;
 
+// scheduler.postTask 的优先级，数值越小越优先
+typedef enum {
+  SCHEDULER_PRIORITY_USER_BLOCKING,
+  SCHEDULER_PRIORITY_USER_VISIBLE,
+  SCHEDULER_PRIORITY_BACKGROUND,
+  SCHEDULER_PRIORITY_COUNT
+} SchedulerPriority;
+
+typedef struct scheduler_task scheduler_task;
+
+typedef struct {
+  scheduler_task *head;
+  scheduler_task *tail;
+} scheduler_queue;
+
+// Per-runtime task scheduler, driven by an idle handle on the uv loop
+typedef struct {
+  // 每个优先级两条队列：[0] 为 scheduler.yield 的续体，[1] 为普通任务
+  scheduler_queue queues[SCHEDULER_PRIORITY_COUNT][2];
+  scheduler_task *delayed; // 等待 delay 到期的任务
+  uv_idle_t idle;          // 队列非空时启动，保证事件循环不阻塞
+  int pending;             // 已提交但尚未执行的任务数
+  int next_id;             // 任务编号，abort 监听器按编号查找任务
+  SchedulerPriority current_priority;
+} task_scheduler;
+
+// 上下文结束时接收其 performance 条目的回调，callback_arg 为执行时传入的回调参数
+typedef void (*WorkerPerformanceObserver)(void *callback_arg, const PerformanceEntry *entries, int count, void *opaque);
+
+// 任务的一个二进制缓冲区
+typedef struct WorkerBuffer {
+  const uint8_t *data;
+  size_t len;
+} WorkerBuffer;
+
+// 引用计数的二进制负载，不复制地作为 ArrayBuffer 交给脚本；
+// ArrayBuffer 持有一个引用，被 GC 回收时释放
+typedef struct WorkerSharedBuffer {
+  atomic_int refs;    // 引用计数
+  uint8_t *data;      // 内容
+  size_t len;         // 内容长度
+  char *content_type; // 内容类型，例如 "application/json"，可以为 NULL
+
+  // 最后一个引用释放时释放 data，NULL 表示 data 与结构体一起分配
+  void (*free_func)(void *opaque, uint8_t *data);
+  void *opaque;
+} WorkerSharedBuffer;
+
+// 任务的二进制输入输出，脚本通过全局对象 winterq 访问：
+// winterq.inputs 为输入的 ArrayBuffer 数组，winterq.payload 为负载（没有时为 undefined），
+// winterq.contentType 为负载的内容类型，winterq.setOutput(value) 设置输出
+typedef struct WorkerTaskIO {
+  const WorkerBuffer *inputs; // 输入缓冲区，执行期间保持有效
+  int input_count;            // 输入个数
+  WorkerSharedBuffer *payload; // 输入负载，可以为 NULL
+  uint8_t *output;            // setOutput 设置的输出（malloc 分配，由调用方释放），未设置时为 NULL
+  size_t output_len;          // 输出长度
+  int error;                  // 脚本同步执行时抛出了未捕获的异常
+
+  // 取消标志，可以由其他线程置位：正在执行的脚本被中断，
+  // 之后由 Worker_ReapCancelledContexts 释放上下文
+  const atomic_bool *cancel;
+  int cancelled; // 执行因取消被中断或上下文被提前释放
+} WorkerTaskIO;
+
 // Runtime statistics structure
 typedef struct {
   int active_contexts;
@@ -42,6 +110,13 @@ typedef struct WorkerRuntime {
   int next_timer_id;
 
   timer_table *timer_table;
+
+  task_scheduler *scheduler;
+
+  WorkerPerformanceObserver perf_observer;
+  void *perf_observer_opaque;
+
+  WorkerContext *current; // 正在执行 JS 的上下文，用于中断检查
 } WorkerRuntime;
 
 typedef struct WorkerContext {
@@ -52,8 +127,15 @@ typedef struct WorkerContext {
   void *callback_arg;
 
   int active_timers;
+  int pending_tasks; // scheduler.postTask / yield 尚未执行的任务数
   int pending_free;
 
+  WorkerTaskIO *io; // 任务输入输出，没有时为 NULL
+
+  // 上下文自己的 performance 对象，脚本重新赋值全局 performance 不影响条目收集
+  JSValue performance;
+  PerformanceTimeline *perf_timeline;
+
   WorkerContext *next; // Next context in the list
 } WorkerContext;
 
@@ -94,7 +176,7 @@ void Worker_FreeContext(WorkerContext *wctx);
  * @param script JavaScript 代码字符串
  * @param callback 执行完成后的回调函数
  * @param callback_arg 回调函数的参数
- * @return 成功返回 0，失败返回非零值
+ * @return 成功返回 0，脚本执行出错返回 1；未能创建上下文时返回 -1，此时回调不会被调用
  */
 int Worker_Eval_JS(WorkerRuntime *wrt, const char *script,
                    void (*callback)(void *), void *callback_arg);
@@ -107,12 +189,82 @@ int Worker_Eval_JS(WorkerRuntime *wrt, const char *script,
  * @param bytecode_len JavaScript Bytecode length
  * @param callback 执行完成后的回调函数
  * @param callback_arg 回调函数的参数
- * @return 成功返回 0，失败返回非零值
+ * @return 成功返回 0，字节码加载或执行出错返回 1；未能创建上下文时返回 -1，此时回调不会被调用
  */
 int Worker_Eval_Bytecode(WorkerRuntime *wrt, uint8_t *bytecode,
                          size_t bytecode_len, void (*callback)(void *),
                          void *callback_arg);
 
+/**
+ * 执行带二进制输入输出的 JavaScript 代码
+ *
+ * 输出在回调被调用之前写入 io，io 必须在回调之前保持有效
+ *
+ * @param wrt 运行时环境
+ * @param script JavaScript 代码字符串
+ * @param io 输入输出，可以为 NULL
+ * @param callback 执行完成后的回调函数
+ * @param callback_arg 回调函数的参数
+ * @return 与 Worker_Eval_JS 相同
+ */
+int Worker_Eval_JS_IO(WorkerRuntime *wrt, const char *script, WorkerTaskIO *io,
+                      void (*callback)(void *), void *callback_arg);
+
+/**
+ * 执行带二进制输入输出的 JavaScript Bytecode
+ *
+ * @param wrt 运行时环境
+ * @param bytecode JavaScript Bytecode
+ * @param bytecode_len JavaScript Bytecode length
+ * @param io 输入输出，可以为 NULL
+ * @param callback 执行完成后的回调函数
+ * @param callback_arg 回调函数的参数
+ * @return 与 Worker_Eval_Bytecode 相同
+ */
+int Worker_Eval_Bytecode_IO(WorkerRuntime *wrt, uint8_t *bytecode,
+                            size_t bytecode_len, WorkerTaskIO *io,
+                            void (*callback)(void *), void *callback_arg);
+
+/**
+ * 创建负载，复制一次内容
+ *
+ * @param data 内容
+ * @param len 内容长度
+ * @param content_type 内容类型，可以为 NULL
+ * @return 引用计数为 1 的负载，失败返回 NULL
+ */
+WorkerSharedBuffer *Worker_NewSharedBuffer(const void *data, size_t len, const char *content_type);
+
+/**
+ * 不复制地包装宿主的缓冲区，最后一个引用释放时调用 free_func(opaque, data)
+ *
+ * 脚本可以写入 ArrayBuffer，多个任务共享同一个负载时脚本应只读访问
+ *
+ * @param data 内容，之后由负载持有
+ * @param len 内容长度
+ * @param content_type 内容类型，可以为 NULL
+ * @param free_func 释放函数
+ * @param opaque 传给释放函数的参数
+ * @return 引用计数为 1 的负载，失败返回 NULL（此时不会调用 free_func）
+ */
+WorkerSharedBuffer *Worker_WrapSharedBuffer(uint8_t *data, size_t len, const char *content_type,
+                                            void (*free_func)(void *opaque, uint8_t *data), void *opaque);
+
+/**
+ * 增加负载的引用计数
+ *
+ * @param buf 负载
+ * @return 传入的负载
+ */
+WorkerSharedBuffer *Worker_RetainSharedBuffer(WorkerSharedBuffer *buf);
+
+/**
+ * 释放负载的一个引用，最后一个引用释放时回收内存
+ *
+ * @param buf 负载
+ */
+void Worker_ReleaseSharedBuffer(WorkerSharedBuffer *buf);
+
 /**
  * 运行事件循环，阻塞直到所有事件处理完毕
  *
@@ -128,8 +280,27 @@ void Worker_RunLoop(WorkerRuntime *wrt);
  */
 int Worker_RunLoopOnce(WorkerRuntime *wrt);
 
+/**
+ * 设置 performance 条目观察者，每个上下文释放前会把 mark/measure 条目交给它
+ *
+ * @param wrt 运行时环境
+ * @param observer 观察者回调，传入 NULL 取消
+ * @param opaque 传给观察者的参数
+ */
+void Worker_SetPerformanceObserver(WorkerRuntime *wrt, WorkerPerformanceObserver observer, void *opaque);
+
+/**
+ * 释放取消标志已置位的上下文，取消它们的定时器和调度任务，回调照常调用
+ *
+ * 只能在运行时所在的线程上、没有 JS 正在执行时调用
+ *
+ * @param wrt 运行时环境
+ */
+void Worker_ReapCancelledContexts(WorkerRuntime *wrt);
+
 void Worker_RequestContextFree(WorkerContext *wctx);
 void Worker_GetRuntimeStats(WorkerRuntime *wrt, WorkerRuntimeStats *stats);
 void Worker_CancelContextTimers(WorkerContext *wctx);
+void Worker_CancelContextTasks(WorkerContext *wctx);
 
 #endif /* WINTERQ_RUNTIME_H */
@@ -0,0 +1,176 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../clock.c"
+#include "../clock.h"
+#include "../cutils.c"
+#include "../cutils.h"
+#include "../mcwp/console.c"
+#include "../mcwp/console.h"
+#include "../mcwp/event.c"
+#include "../mcwp/event.h"
+#include "../mcwp/headers.c"
+#include "../mcwp/headers.h"
+#include "../mcwp/performance.c"
+#include "../mcwp/performance.h"
+#include "../mcwp/url.c"
+#include "../mcwp/url.h"
+#include "../runtime.c"
+#include "../runtime.h"
+#include "../threadpool.c"
+#include "../threadpool.h"
+
+/**
+ * 线程池统计计数器的伸缩性测试
+ *
+ * 每个线程重复执行一个任务在完成路径上的记账操作：
+ * - packed：旧布局，线程数据连续存放，完成数是整个线程池共享的原子计数器
+ * - isolated：当前布局，缓存行对齐的 ThreadData 槽位上的单写者计数器
+ * 同时有一个线程不断调用 sum_thread_counters 汇总，模拟 get_thread_pool_stats
+ */
+
+// 旧的 ThreadData 统计字段布局
+typedef struct PackedStats
+{
+  atomic_bool idle;
+  atomic_int tasks_processed;
+  uint64_t idle_start;
+  atomic_uint_least64_t idle_time;
+  atomic_uint_least64_t busy_time;
+} PackedStats;
+
+typedef struct BenchArg
+{
+  int index;
+  long iterations;
+  PackedStats *packed;
+  atomic_int *completed;
+  ThreadData *slot;
+} BenchArg;
+
+static atomic_bool bench_running;
+
+static void *packed_worker(void *arg)
+{
+  BenchArg *bench = (BenchArg *)arg;
+  PackedStats *stats = &bench->packed[bench->index];
+  for (long i = 0; i < bench->iterations; i++)
+  {
+    atomic_fetch_add(&stats->tasks_processed, 1);
+    atomic_fetch_add(&stats->busy_time, 1);
+    atomic_fetch_add(bench->completed, 1);
+  }
+  return NULL;
+}
+
+static void *isolated_worker(void *arg)
+{
+  BenchArg *bench = (BenchArg *)arg;
+  ThreadData *thread_data = bench->slot;
+  for (long i = 0; i < bench->iterations; i++)
+  {
+    COUNTER_ADD(&thread_data->tasks_processed, 1);
+    COUNTER_ADD(&thread_data->busy_time, 1);
+    COUNTER_ADD(&thread_data->tasks_completed, 1);
+    COUNTER_ADD(&thread_data->dequeued[TASK_PRIORITY_NORMAL], 1);
+  }
+  return NULL;
+}
+
+static void *stats_reader(void *arg)
+{
+  ThreadPool *pool = (ThreadPool *)arg;
+  uint64_t sink = 0;
+  while (atomic_load(&bench_running))
+    sink += sum_thread_counters(pool).completed;
+  return (void *)(uintptr_t)sink;
+}
+
+// 运行一轮，返回每秒完成的记账次数（百万）
+static double run_round(int threads, long iterations, bool isolated,
+                        ThreadPool *pool)
+{
+  pthread_t tids[threads];
+  BenchArg args[threads];
+  PackedStats *packed = (PackedStats *)calloc(threads, sizeof(PackedStats));
+  atomic_int completed = 0;
+  pthread_t reader;
+
+  atomic_store(&bench_running, true);
+  pthread_create(&reader, NULL, stats_reader, pool);
+
+  uint64_t start = winterq_clock_hrtime();
+  for (int i = 0; i < threads; i++)
+  {
+    args[i] = (BenchArg){
+        .index = i,
+        .iterations = iterations,
+        .packed = packed,
+        .completed = &completed,
+        .slot = pool->thread_data[i],
+    };
+    pthread_create(&tids[i], NULL, isolated ? isolated_worker : packed_worker,
+                   &args[i]);
+  }
+  for (int i = 0; i < threads; i++)
+    pthread_join(tids[i], NULL);
+  uint64_t elapsed = winterq_clock_hrtime() - start;
+
+  atomic_store(&bench_running, false);
+  pthread_join(reader, NULL);
+  free(packed);
+
+  return (double)threads * iterations / ((double)elapsed / 1e9) / 1e6;
+}
+
+int main(int argc, char *argv[])
+{
+  int max_threads = argc > 1 ? atoi(argv[1]) : 64;
+  long iterations = argc > 2 ? atol(argv[2]) : 1000000;
+  if (max_threads <= 0 || iterations <= 0)
+  {
+    fprintf(stderr, "Usage: %s [max_threads] [iterations]\n", argv[0]);
+    return 1;
+  }
+
+  // 只需要线程注册表，不启动工作线程
+  ThreadPool *pool = (ThreadPool *)aligned_alloc(_Alignof(ThreadPool),
+                                                 sizeof(ThreadPool));
+  memset(pool, 0, sizeof(ThreadPool));
+  pool->max_threads = max_threads;
+  pool->thread_data =
+      (ThreadData *_Atomic *)calloc(max_threads, sizeof(ThreadData *));
+  for (int i = 0; i < max_threads; i++)
+  {
+    ThreadData *slot = (ThreadData *)aligned_alloc(THREADPOOL_CACHE_LINE,
+                                                   sizeof(ThreadData));
+    memset(slot, 0, sizeof(ThreadData));
+    pool->thread_data[i] = slot;
+  }
+
+  printf("CPUs: %d, iterations per thread: %ld\n",
+         thread_pool_default_size(), iterations);
+  printf("| %-8s | %-16s | %-16s | %-8s |\n", "threads", "packed (M/s)",
+         "isolated (M/s)", "speedup");
+  int threads = 1;
+  for (;;)
+  {
+    double packed = run_round(threads, iterations, false, pool);
+    double isolated = run_round(threads, iterations, true, pool);
+    printf("| %-8d | %-16.2f | %-16.2f | %-8.2f |\n", threads, packed,
+           isolated, isolated / packed);
+    if (threads >= max_threads)
+      break;
+    // 线程数翻倍，最后一轮使用 max_threads
+    threads = threads * 2 < max_threads ? threads * 2 : max_threads;
+  }
+
+  for (int i = 0; i < max_threads; i++)
+    free(pool->thread_data[i]);
+  free(pool->thread_data);
+  free(pool);
+  return 0;
+}
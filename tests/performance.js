@@ -0,0 +1,163 @@
+class TestFramework {
+	constructor(name) {
+		this.name = name;
+		this.tests = [];
+		this.passedTests = 0;
+		this.failedTests = 0;
+	}
+
+	// 添加测试用例
+	addTest(name, testFn) {
+		this.tests.push({ name, testFn });
+		return this;
+	}
+
+	// 运行所有测试
+	async runTests() {
+		console.log(`\n开始测试: ${this.name}`);
+		console.log("====================================");
+
+		for (const test of this.tests) {
+			try {
+				await test.testFn();
+				console.info(`✅ 通过: ${test.name}`);
+				this.passedTests++;
+			} catch (error) {
+				console.error(`❌ 失败: ${test.name}`);
+				console.error(`   错误: ${error.message}`);
+				this.failedTests++;
+			}
+		}
+
+		console.log("====================================");
+		console.log(
+			`测试结果: ${this.passedTests} 通过, ${this.failedTests} 失败\n`,
+		);
+	}
+
+	// 断言函数
+	assert(condition, message) {
+		if (!condition) {
+			throw new Error(message || "断言失败");
+		}
+	}
+
+	assertEquals(actual, expected, message) {
+		if (actual !== expected) {
+			throw new Error(message || `期望值 ${expected}, 实际值 ${actual}`);
+		}
+	}
+
+	assertDeepEquals(actual, expected, message) {
+		const actualJson = JSON.stringify(actual);
+		const expectedJson = JSON.stringify(expected);
+		if (actualJson !== expectedJson) {
+			throw new Error(
+				message || `期望值 ${expectedJson}, 实际值 ${actualJson}`,
+			);
+		}
+	}
+}
+
+// 测试 Performance API
+const performanceTest = new TestFramework("Performance API 测试");
+
+performanceTest.addTest("performance.now - 单调递增", () => {
+	const a = performance.now();
+	const b = performance.now();
+	performanceTest.assert(typeof a === "number", "now() 应该返回数字");
+	performanceTest.assert(b >= a, "now() 应该单调递增");
+});
+
+performanceTest.addTest("performance.timeOrigin", () => {
+	performanceTest.assert(
+		performance.timeOrigin > 0,
+		"timeOrigin 应该是正数",
+	);
+	performanceTest.assert(
+		Math.abs(performance.timeOrigin + performance.now() - Date.now()) < 1000,
+		"timeOrigin + now() 应该接近当前墙钟时间",
+	);
+});
+
+performanceTest.addTest("performance.mark - 创建条目", () => {
+	const mark = performance.mark("start");
+	performanceTest.assertEquals(mark.name, "start", "name 应该正确设置");
+	performanceTest.assertEquals(mark.entryType, "mark", "entryType 应该是 mark");
+	performanceTest.assertEquals(mark.duration, 0, "mark 的 duration 应该是 0");
+});
+
+performanceTest.addTest("performance.measure - 两个 mark 之间", () => {
+	performance.mark("a", { startTime: 10 });
+	performance.mark("b", { startTime: 25 });
+	const measure = performance.measure("a-b", "a", "b");
+	performanceTest.assertEquals(measure.entryType, "measure", "entryType 应该是 measure");
+	performanceTest.assertEquals(measure.startTime, 10, "startTime 应该取自 a");
+	performanceTest.assertEquals(measure.duration, 15, "duration 应该是 b - a");
+});
+
+performanceTest.addTest("performance.measure - 选项对象", () => {
+	const measure = performance.measure("opt", { start: 5, duration: 7 });
+	performanceTest.assertEquals(measure.startTime, 5, "startTime 应该是 5");
+	performanceTest.assertEquals(measure.duration, 7, "duration 应该是 7");
+});
+
+performanceTest.addTest("performance.measure - 不存在的 mark", () => {
+	let caught = null;
+	try {
+		performance.measure("missing", "no-such-mark");
+	} catch (e) {
+		caught = e;
+	}
+	performanceTest.assert(caught !== null, "应该抛出异常");
+});
+
+performanceTest.addTest("performance.getEntriesByName / getEntriesByType", () => {
+	performanceTest.assertEquals(
+		performance.getEntriesByName("a").length,
+		1,
+		"应该找到一个名为 a 的条目",
+	);
+	performanceTest.assertEquals(
+		performance.getEntriesByName("a-b", "mark").length,
+		0,
+		"按类型过滤后不应该有条目",
+	);
+	performanceTest.assert(
+		performance.getEntriesByType("measure").length >= 2,
+		"应该至少有两个 measure",
+	);
+});
+
+performanceTest.addTest("performance.clearMarks", () => {
+	performance.clearMarks("a");
+	performanceTest.assertEquals(
+		performance.getEntriesByName("a").length,
+		0,
+		"a 应该被清除",
+	);
+	performance.clearMarks();
+	performanceTest.assertEquals(
+		performance.getEntriesByType("mark").length,
+		0,
+		"所有 mark 应该被清除",
+	);
+	performanceTest.assert(
+		performance.getEntriesByType("measure").length > 0,
+		"measure 不应该被清除",
+	);
+});
+
+performanceTest.addTest("console.time / timeLog / timeEnd", () => {
+	console.time("work");
+	console.timeLog("work", "halfway");
+	console.timeEnd("work");
+	console.timeEnd("work"); // 打印警告，不抛出异常
+});
+
+// 运行所有测试
+async function runAllTests() {
+	await performanceTest.runTests();
+}
+
+runAllTests().catch(console.error);
@@ -0,0 +1,195 @@
+class TestFramework {
+	constructor(name) {
+		this.name = name;
+		this.tests = [];
+		this.passedTests = 0;
+		this.failedTests = 0;
+	}
+
+	// 添加测试用例
+	addTest(name, testFn) {
+		this.tests.push({ name, testFn });
+		return this;
+	}
+
+	// 运行所有测试
+	async runTests() {
+		console.log(`\n开始测试: ${this.name}`);
+		console.log("====================================");
+
+		for (const test of this.tests) {
+			try {
+				await test.testFn();
+				console.info(`✅ 通过: ${test.name}`);
+				this.passedTests++;
+			} catch (error) {
+				console.error(`❌ 失败: ${test.name}`);
+				console.error(`   错误: ${error.message}`);
+				this.failedTests++;
+			}
+		}
+
+		console.log("====================================");
+		console.log(
+			`测试结果: ${this.passedTests} 通过, ${this.failedTests} 失败\n`,
+		);
+	}
+
+	// 断言函数
+	assert(condition, message) {
+		if (!condition) {
+			throw new Error(message || "断言失败");
+		}
+	}
+
+	assertEquals(actual, expected, message) {
+		if (actual !== expected) {
+			throw new Error(message || `期望值 ${expected}, 实际值 ${actual}`);
+		}
+	}
+
+	assertDeepEquals(actual, expected, message) {
+		const actualJson = JSON.stringify(actual);
+		const expectedJson = JSON.stringify(expected);
+		if (actualJson !== expectedJson) {
+			throw new Error(
+				message || `期望值 ${expectedJson}, 实际值 ${actualJson}`,
+			);
+		}
+	}
+}
+
+// 测试 scheduler API
+const schedulerTest = new TestFramework("scheduler API 测试");
+
+schedulerTest.addTest("scheduler.postTask - 返回回调结果", async () => {
+	const result = await scheduler.postTask(() => 42);
+	schedulerTest.assertEquals(result, 42, "postTask 应该以回调返回值 resolve");
+});
+
+schedulerTest.addTest("scheduler.postTask - 回调抛出异常时 reject", async () => {
+	let caught = null;
+	try {
+		await scheduler.postTask(() => {
+			throw new Error("boom");
+		});
+	} catch (e) {
+		caught = e;
+	}
+	schedulerTest.assert(caught !== null, "postTask 应该 reject");
+	schedulerTest.assertEquals(caught.message, "boom", "应该传递原始异常");
+});
+
+schedulerTest.addTest("scheduler.postTask - 按优先级执行", async () => {
+	const order = [];
+	await Promise.all([
+		scheduler.postTask(() => order.push("background"), {
+			priority: "background",
+		}),
+		scheduler.postTask(() => order.push("user-visible")),
+		scheduler.postTask(() => order.push("user-blocking"), {
+			priority: "user-blocking",
+		}),
+	]);
+	schedulerTest.assertDeepEquals(
+		order,
+		["user-blocking", "user-visible", "background"],
+		"高优先级任务应该先执行",
+	);
+});
+
+schedulerTest.addTest("scheduler.postTask - 非法优先级", () => {
+	let caught = null;
+	try {
+		scheduler.postTask(() => {}, { priority: "urgent" });
+	} catch (e) {
+		caught = e;
+	}
+	schedulerTest.assert(caught instanceof TypeError, "应该抛出 TypeError");
+});
+
+schedulerTest.addTest("scheduler.postTask - delay", async () => {
+	const order = [];
+	await Promise.all([
+		scheduler.postTask(() => order.push("delayed"), { delay: 20 }),
+		scheduler.postTask(() => order.push("immediate"), {
+			priority: "background",
+		}),
+	]);
+	schedulerTest.assertDeepEquals(
+		order,
+		["immediate", "delayed"],
+		"延迟任务应该在 delay 到期后执行",
+	);
+});
+
+schedulerTest.addTest("scheduler.postTask - 已中止的 signal", async () => {
+	const signal = { aborted: true, reason: "cancelled" };
+	let caught = null;
+	let ran = false;
+	try {
+		await scheduler.postTask(
+			() => {
+				ran = true;
+			},
+			{ signal },
+		);
+	} catch (e) {
+		caught = e;
+	}
+	schedulerTest.assertEquals(ran, false, "回调不应该执行");
+	schedulerTest.assertEquals(caught, "cancelled", "应该以 signal.reason reject");
+});
+
+schedulerTest.addTest("scheduler.postTask - 等待中被中止", async () => {
+	const signal = new EventTarget();
+	signal.aborted = false;
+	let ran = false;
+	const start = Date.now();
+	const task = scheduler.postTask(
+		() => {
+			ran = true;
+		},
+		{ signal, delay: 10000 },
+	);
+	setTimeout(() => {
+		signal.aborted = true;
+		signal.reason = "aborted";
+		signal.dispatchEvent(new Event("abort"));
+	}, 10);
+	let caught = null;
+	try {
+		await task;
+	} catch (e) {
+		caught = e;
+	}
+	schedulerTest.assertEquals(ran, false, "回调不应该执行");
+	schedulerTest.assertEquals(caught, "aborted", "应该以 signal.reason reject");
+	schedulerTest.assert(
+		Date.now() - start < 5000,
+		"应该在中止时立即 reject，而不是等到 delay 到期",
+	);
+});
+
+schedulerTest.addTest("scheduler.yield - 续体先于同优先级任务", async () => {
+	const order = [];
+	const background = scheduler.postTask(() => order.push("background"), {
+		priority: "background",
+	});
+	const task = scheduler.postTask(() => order.push("task"));
+	await scheduler.yield();
+	order.push("continuation");
+	await Promise.all([background, task]);
+	schedulerTest.assertDeepEquals(
+		order,
+		["continuation", "task", "background"],
+		"yield 续体应该先于已排队的同优先级任务执行",
+	);
+});
+
+// 运行所有测试
+async function runAllTests() {
+	await schedulerTest.runTests();
+}
+
+runAllTests().catch(console.error);
@@ -3,6 +3,8 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "../clock.c"
+#include "../clock.h"
 #include "../cutils.c"
 #include "../cutils.h"
 #include "../mcwp/console.c"
@@ -11,6 +13,8 @@
 #include "../mcwp/event.h"
 #include "../mcwp/headers.c"
 #include "../mcwp/headers.h"
+#include "../mcwp/performance.c"
+#include "../mcwp/performance.h"
 #include "../mcwp/url.c"
 #include "../mcwp/url.h"
 #include "../runtime.c"
@@ -3,10 +3,24 @@
 #include <time.h>
 #include <unistd.h>
 
-#include "../threadpool.h"
-#include "../threadpool.c"
+#include "../clock.c"
+#include "../clock.h"
+#include "../cutils.c"
+#include "../cutils.h"
+#include "../mcwp/console.c"
+#include "../mcwp/console.h"
+#include "../mcwp/event.c"
+#include "../mcwp/event.h"
+#include "../mcwp/headers.c"
+#include "../mcwp/headers.h"
+#include "../mcwp/performance.c"
+#include "../mcwp/performance.h"
+#include "../mcwp/url.c"
+#include "../mcwp/url.h"
 #include "../runtime.c"
-#include "../console.c"
+#include "../runtime.h"
+#include "../threadpool.c"
+#include "../threadpool.h"
 #include "./file.c"
 
 // 回调函数示例
@@ -15,6 +29,52 @@ void task_callback(void *arg)
   printf("A task completed.\n");
 }
 
+// 任务图示例：parse -> enrich -> render，每一步的输出作为下一步的输入
+#define PIPELINE_READ_INPUT                                                    \
+  "const data = JSON.parse(String.fromCharCode(\n"                             \
+  "  ...new Uint8Array(winterq.inputs[0])));\n"
+static const char *pipeline_scripts[] = {
+    "winterq.setOutput(JSON.stringify({ name: 'winterq', items: [1, 2, 3] }));",
+    PIPELINE_READ_INPUT
+    "data.total = data.items.reduce((a, b) => a + b, 0);\n"
+    "winterq.setOutput(JSON.stringify(data));",
+    PIPELINE_READ_INPUT
+    "winterq.setOutput(`${data.name}: ${data.total}`);",
+};
+
+void pipeline_complete(TaskGraph *graph, void *arg)
+{
+  int last = *(int *)arg;
+  size_t len = 0;
+  const uint8_t *output = task_graph_node_output(graph, last, &len);
+  printf("Pipeline finished with status %d: %.*s\n",
+         task_graph_node_status(graph, last), (int)len,
+         output != NULL ? (const char *)output : "");
+}
+
+// 负载示例：脚本直接读取宿主的缓冲区，输出交给完成函数
+static char payload_json[] = "{\"values\": [3, 4, 5]}";
+
+void payload_free(void *opaque, uint8_t *data)
+{
+  printf("Payload released\n");
+}
+
+void payload_complete(const TaskResult *result, void *arg)
+{
+  printf("Payload task %d finished with status %d: %.*s\n", result->task_id,
+         result->status, (int)result->output_len,
+         result->output != NULL ? (const char *)result->output : "");
+}
+
+// 去重示例：相同的提交共享一次执行的结果
+void dedup_complete(const TaskResult *result, void *arg)
+{
+  printf("Dedup submit %d got task %d status %d: %.*s\n", (int)(intptr_t)arg,
+         result->task_id, result->status, (int)result->output_len,
+         result->output != NULL ? (const char *)result->output : "");
+}
+
 int main(int argc, char **argv)
 {
   if (argc < 3)
@@ -36,8 +96,8 @@ int main(int argc, char **argv)
   // 任务数，总文件数乘以执行次数
   int total_tasks = num_files * iterations;
 
-  // 创建线程池（线程数等于处理器核心数）
-  int num_cores = sysconf(_SC_NPROCESSORS_ONLN);
+  // 创建线程池（线程数等于可用的处理器核心数，考虑容器配额）
+  int num_cores = thread_pool_default_size();
 
   printf("Creating thread pool with %d threads\n", num_cores);
 
@@ -50,6 +110,11 @@ int main(int argc, char **argv)
       .enable_work_stealing = false,
       .idle_threshold = 2,
       .dynamic_sizing = false,
+      .affinity = THREAD_AFFINITY_COMPACT,
+      .affinity_routing = true,
+      .memo_cache_bytes = 1 << 20,
+      .memo_ttl_ms = 60000,
+      .idle_policy = WORKER_IDLE_SPIN,
   };
 
   // 初始化线程池
@@ -63,21 +128,198 @@ int main(int argc, char **argv)
 
   printf("\n-------- Created thread pool successfully --------\n\n\n");
 
-  // 添加任务到队列
+  // 添加任务到队列：每个文件的所有执行次数作为一批提交
+  TaskSpec *specs = (TaskSpec *)calloc(iterations, sizeof(TaskSpec));
   for (int i = 0; i < num_files; i++)
   {
     const char *js_code = read_file_to_string(argv[i + 1]);
+    // 脚本只注册一次，所有任务共享同一份内容
+    ScriptBlob *blob = script_blob_create_script(js_code);
+    free((void *)js_code);
 
     for (int j = 0; j < iterations; j++)
     {
-      add_script_task_to_pool(pool, js_code, task_callback, NULL);
+      specs[j].blob = blob;
+      specs[j].callback = task_callback;
+      specs[j].callback_arg = NULL;
     }
 
-    free((void *)js_code);
+    // 队列满时只接受部分任务，剩余的稍后重新提交
+    int submitted = 0;
+    while (submitted < iterations)
+    {
+      int accepted = add_tasks_to_pool_batch(pool, specs + submitted,
+                                             iterations - submitted);
+      if (accepted < 0)
+      {
+        fprintf(stderr, "Failed to submit task batch\n");
+        break;
+      }
+      submitted += accepted;
+      // 等到有空闲名额再重试，避免空转
+      while (submitted < iterations && thread_pool_available_slots(pool) == 0)
+        usleep(1000);
+    }
+
+    script_blob_release(blob);
+  }
+  free(specs);
+
+  // 同一个键的任务按提交顺序依次执行
+  for (int i = 0; i < 4; i++)
+  {
+    if (add_ordered_script_task_to_pool(pool, "test-lane", "1 + 1",
+                                        task_callback, NULL) == 0)
+      total_tasks++;
+  }
+
+  // 多阶段任务：依赖完成后在同一个线程上接着执行后继
+  static int pipeline_last = -1;
+  TaskGraph *graph = task_graph_create(pool);
+  if (graph != NULL)
+  {
+    for (int i = 0; i < 3; i++)
+    {
+      TaskSpec spec = {.script = pipeline_scripts[i]};
+      int dep = pipeline_last;
+      pipeline_last = task_graph_add(graph, &spec, &dep, i > 0 ? 1 : 0);
+    }
+    if (pipeline_last >= 0 &&
+        task_graph_submit(graph, pipeline_complete, &pipeline_last,
+                          TASK_ENQUEUE_TIMEOUT_MS) == SUBMIT_OK)
+      total_tasks += 3;
+    task_graph_release(graph);
+  }
+
+  // 取消一个不会自己结束的任务：排队时直接丢弃，执行中则被中断
+  TaskSpec endless = {.script = "while (true) {}"};
+  TaskHandle *handle = NULL;
+  if (submit_task_with_handle(pool, &endless, TASK_ENQUEUE_TIMEOUT_MS,
+                              &handle) == SUBMIT_OK)
+  {
+    TaskResult result;
+    usleep(10000);
+    task_handle_cancel(handle);
+    if (task_handle_wait(handle, 1000, &result) == 0)
+      printf("Task %d finished with status %d after cancel\n",
+             task_handle_id(handle), result.status);
+    else
+      printf("Task %d did not stop after cancel\n", task_handle_id(handle));
+    task_handle_release(handle);
+  }
+
+  // 不复制地把负载交给脚本，处理结果通过完成函数返回
+  WorkerSharedBuffer *payload = Worker_WrapSharedBuffer(
+      (uint8_t *)payload_json, strlen(payload_json), "application/json",
+      payload_free, NULL);
+  if (payload != NULL)
+  {
+    TaskSpec spec = {
+        .script = "const req = JSON.parse(String.fromCharCode(\n"
+                  "  ...new Uint8Array(winterq.payload)));\n"
+                  "winterq.setOutput(`${winterq.contentType}: ${\n"
+                  "  req.values.reduce((a, b) => a * b, 1)}`);",
+        .completion = payload_complete,
+        .payload = payload,
+    };
+    if (submit_task(pool, &spec, TASK_ENQUEUE_TIMEOUT_MS) == SUBMIT_OK)
+      total_tasks++;
+    Worker_ReleaseSharedBuffer(payload); // 任务持有自己的引用
+  }
+
+  // 两个租户按 3:1 的权重分享线程池，租户 2 最多同时放出 2 个任务
+  thread_pool_set_tenant(pool, 1, 3, 0);
+  thread_pool_set_tenant(pool, 2, 1, 2);
+  // 租户 2 每秒最多提交 10 个，允许突发 3 个，其余提交被限速拒绝
+  thread_pool_set_tenant_rate(pool, 2, 10, 3);
+  int rate_limited = 0;
+  for (int i = 0; i < 12; i++)
+  {
+    TaskSpec spec = {.script = "let s = 0; for (let i = 0; i < 1e5; i++) s += i;",
+                     .tenant_id = i % 2 + 1};
+    SubmitStatus status = submit_task(pool, &spec, TASK_ENQUEUE_TIMEOUT_MS);
+    if (status == SUBMIT_OK)
+      total_tasks++;
+    else if (status == SUBMIT_RATE_LIMITED)
+      rate_limited++;
+  }
+  printf("Rate limited %d tenant submits\n", rate_limited);
+
+  // 缓存击穿时的重复提交：第一个创建任务，其余附加到它上面
+  for (int i = 0; i < 5; i++)
+  {
+    TaskSpec spec = {
+        .script = "let s = 0; for (let i = 0; i < 1e6; i++) s += i;\n"
+                  "winterq.setOutput(String(s));",
+        .completion = dedup_complete,
+        .callback_arg = (void *)(intptr_t)i,
+        .dedup_key = "sum:1e6",
+    };
+    if (submit_task(pool, &spec, TASK_ENQUEUE_TIMEOUT_MS) == SUBMIT_OK)
+      total_tasks++;
+  }
+
+  // 确定性脚本的结果缓存：第一次执行，之后的提交在提交路径上直接命中
+  for (int i = 0; i < 3; i++)
+  {
+    TaskSpec spec = {
+        .script = "winterq.setOutput(String([1, 2, 3].map(x => x * x)));",
+        .completion = dedup_complete,
+        .callback_arg = (void *)(intptr_t)(100 + i),
+        .memoize = true,
+    };
+    if (submit_task(pool, &spec, TASK_ENQUEUE_TIMEOUT_MS) == SUBMIT_OK)
+      total_tasks++;
+    usleep(20000); // 等第一次执行完成并写入缓存
+  }
+
+  // 通过完成队列收割结果，不在工作线程上调用回调
+  CompletionQueue *cq = completion_queue_create(16);
+  if (cq != NULL)
+  {
+    char script[64];
+    int posted = 0;
+    for (int i = 0; i < 8; i++)
+    {
+      snprintf(script, sizeof(script), "winterq.setOutput(String(%d * %d));",
+               i, i);
+      TaskSpec spec = {.script = script, .callback_arg = (void *)(intptr_t)i,
+                       .cq = cq};
+      if (submit_task(pool, &spec, TASK_ENQUEUE_TIMEOUT_MS) == SUBMIT_OK)
+        posted++;
+    }
+
+    TaskCompletion completions[8];
+    int reaped = 0;
+    while (reaped < posted && completion_queue_wait(cq, 5000) == 0)
+    {
+      size_t n = completion_queue_reap(cq, completions, 8);
+      for (size_t i = 0; i < n; i++)
+      {
+        printf("Completion %d (arg %d): status %d, output %.*s\n",
+               completions[i].result.task_id,
+               (int)(intptr_t)completions[i].user_data,
+               completions[i].result.status, (int)completions[i].output_len,
+               completions[i].output != NULL ? (char *)completions[i].output
+                                             : "");
+        free(completions[i].output);
+      }
+      reaped += (int)n;
+    }
+    total_tasks += posted;
+    completion_queue_destroy(cq);
   }
 
   printf("Added %d tasks to the queue\n", total_tasks);
 
+  // 任务执行期间扩容再缩容，被移除的线程把未执行的任务交还给其他线程
+  if (resize_thread_pool(pool, num_cores + 1) == 0 &&
+      resize_thread_pool(pool, num_cores) == 0)
+  {
+    printf("Resized pool to %d and back to %d threads\n", num_cores + 1,
+           num_cores);
+  }
+
   // 等待所有任务完成（最多等待5秒）
   printf("Waiting for tasks to complete...\n");
   int wait_result = wait_for_idle(pool, 5000);
@@ -103,6 +345,33 @@ int main(int argc, char **argv)
   printf("| %-20s | %-10d |\n", "Idle threads", stats.idle_threads);
   printf("| %-20s | \033[1;32m%-10d\033[0m |\n", "Completed tasks", stats.completed_tasks);
   printf("| %-20s | \033[1;34m%-9.2f%%\033[0m |\n", "Thread utilization", stats.thread_utilization);
+  printf("| %-20s | %-7.3fms |\n", "Avg wait (high)", stats.avg_wait_time_by_priority[TASK_PRIORITY_HIGH]);
+  printf("| %-20s | %-7.3fms |\n", "Avg wait (normal)", stats.avg_wait_time_by_priority[TASK_PRIORITY_NORMAL]);
+  printf("| %-20s | %-7.3fms |\n", "Avg wait (low)", stats.avg_wait_time_by_priority[TASK_PRIORITY_LOW]);
+  printf("| %-20s | %-10d |\n", "Shed tasks", stats.shed_tasks);
+  printf("| %-20s | %-10d |\n", "Late tasks", stats.late_tasks);
+  printf("| %-20s | %-10d |\n", "Rejected submits", stats.rejected_tasks);
+  printf("| %-20s | %-10d |\n", "Rate limited", stats.rate_limited_tasks);
+  printf("| %-20s | %-10d |\n", "Active lanes", stats.active_lanes);
+  printf("| %-20s | %-10d |\n", "Cancelled tasks", stats.cancelled_tasks);
+  printf("| %-20s | %-10d |\n", "Coalesced submits", stats.coalesced_tasks);
+  printf("| %-20s | %-10.2f |\n", "Memo hit rate (%)", stats.memo_hit_rate);
+  printf("| %-20s | %-10zu |\n", "Memo bytes", stats.memo_bytes);
+  printf("| %-20s | %-10.2f |\n", "Affinity hit rate (%)",
+         stats.affinity_hit_rate);
+  printf("| %-20s | %-10d |\n", "Spin hits", stats.spin_hits);
+  printf("| %-20s | %-10d |\n", "Yield hits", stats.yield_hits);
+  printf("| %-20s | %-10d |\n", "Park hits", stats.park_hits);
+  for (int tenant_id = 1; tenant_id <= 2; tenant_id++)
+  {
+    TenantStats tenant;
+    if (thread_pool_get_tenant_stats(pool, tenant_id, &tenant) == 0)
+      printf("| Tenant %-13d | weight %d, queued %d, completed %llu, "
+             "%.1f/s, wait %.2f ms\n",
+             tenant_id, tenant.weight, tenant.queued,
+             (unsigned long long)tenant.completed, tenant.throughput,
+             tenant.avg_wait_time);
+  }
   printf("===========================================================\n\n");
 
   // 关闭线程池
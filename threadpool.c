@@ -9,78 +9,256 @@
  * - 线程状态跟踪和统计收集
  * - 动态线程池大小调整
  * - 优先级任务调度
+ * - CPU 绑核与 NUMA 感知的工作窃取
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // sched_getaffinity, pthread_attr_setaffinity_np
+#endif
+
 #include <errno.h>
+#include <poll.h>
 #include <pthread.h>
+#include <sched.h>
 #include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/time.h>
+#include <sys/eventfd.h>
 #include <time.h>
 #include <unistd.h>
 
+#include "clock.h"
 #include "log.h"
 #include "runtime.h"
 #include "threadpool.h"
 
 // Forward declarations
-static void init_task_queue(TaskQueue *queue, size_t max_size);
 static void task_completion_callback(void *arg);
-static int enqueue_task(TaskQueue *queue, Task *task);
-static void destroy_task_queue(TaskQueue *queue);
-static Task *dequeue_task(TaskQueue *queue);
-static Task *steal_task(ThreadPool *pool, int thief_id);
+static Task *steal_task(ThreadData *thief);
+static int init_task_ring(TaskRing *ring, size_t capacity);
+static void destroy_task_ring(TaskRing *ring);
+static int task_ring_enqueue_wait(TaskRing *ring, Task *task, int timeout_ms);
+static Task *task_ring_dequeue(TaskRing *ring);
+static size_t task_ring_size(TaskRing *ring);
 static void *worker_thread(void *arg);
 static void *pool_adjuster_thread(void *arg);
 static int create_worker_thread(ThreadPool *pool, int thread_id);
-static uint64_t get_current_time_ms(void);
 static void execute_task(ThreadData *thread_data, Task *task);
-static bool check_thread_idle(ThreadData *thread_data);
+static void wake_idle_worker(ThreadPool *pool);
+static void wake_idle_workers(ThreadPool *pool, size_t n);
+static void wake_stealer(ThreadPool *pool);
+static void wake_worker(ThreadData *thread_data);
+static void worker_send_wakeup(ThreadData *thread_data);
+static SubmitStatus dispatch_task(ThreadPool *pool, Task *task, int thread_id,
+                                  int timeout_ms);
+static void migrate_thread_tasks(ThreadPool *pool, ThreadData *thread_data);
+static void reclaim_stranded_tasks(ThreadPool *pool, ThreadData *thread_data);
+static void reap_retired_threads(ThreadPool *pool);
+static bool revive_retiring_thread(ThreadPool *pool, ThreadData *thread_data);
+static void lane_release(ThreadPool *pool, KeyLane *lane);
+static void tenant_release(ThreadPool *pool, Tenant *tenant);
+static void flight_finish(FlightEntry *flight, const TaskResult *result);
+static void memo_store(ThreadPool *pool, const MemoKey *key,
+                       const uint8_t *output, size_t output_len);
+static void init_memo_cache(ThreadPool *pool);
+static void destroy_memo_cache(ThreadPool *pool);
+static void destroy_lanes(ThreadPool *pool);
+static void destroy_tenants(ThreadPool *pool);
+static void destroy_flights(ThreadPool *pool);
+static void graph_node_finish(ThreadPool *pool, TaskGraphNode *node,
+                              TaskStatus status);
+static void graph_release(TaskGraph *graph);
+static void task_handle_finish(TaskHandle *handle, const TaskResult *result);
+static void completion_queue_post(CompletionQueue *cq,
+                                  const TaskCompletion *entry);
+
+// 每次唤醒最多连续执行的任务数，超出后先让事件循环处理定时器和 I/O
+#define WORKER_BATCH_SIZE 32
+
+// 全局队列满时提交任务的最长等待时间(毫秒)
+#define TASK_ENQUEUE_TIMEOUT_MS 100
+
+// 每取这么多个任务优先检查一次全局队列，避免本地任务饿死全局任务
+#define WORKER_GLOBAL_CHECK_INTERVAL 31
+
+// 亲和队列积压超过这个数时才允许窃取
+#define AFFINITY_STEAL_THRESHOLD 2
+
+// 租户调度每次持锁最多放出的任务数
+#define TENANT_DISPATCH_BATCH 16
+
+// 空闲策略：默认自旋预算上限(微秒)，自旋结束后让出 CPU 的次数，
+// 每自旋这么多次检查一次时间
+#define WORKER_SPIN_DEFAULT_US 50
+#define WORKER_IDLE_YIELDS 4
+#define WORKER_SPIN_CHECK_INTERVAL 64
+
+// 自旋等待时提示 CPU 降低功耗、让出流水线给同一核心上的其他超线程
+#if defined(__x86_64__) || defined(__i386__)
+#define CPU_RELAX() __builtin_ia32_pause()
+#elif defined(__aarch64__)
+#define CPU_RELAX() __asm__ __volatile__("yield" ::: "memory")
+#else
+#define CPU_RELAX() atomic_signal_fence(memory_order_seq_cst)
+#endif
+
+// 探测 NUMA 拓扑时检查的最大节点编号
+#define THREADPOOL_MAX_NUMA_NODES 64
+
+// 动态调整：默认采样周期和目标排队等待时间(毫秒)
+#define POOL_ADJUST_INTERVAL_MS 500
+#define POOL_TARGET_WAIT_MS 10
+
+// 动态调整：扩容/缩容的利用率阈值和需要连续满足的周期数，调整后的冷却周期数
+#define POOL_GROW_UTILIZATION 0.75
+#define POOL_SHRINK_UTILIZATION 0.25
+#define POOL_GROW_TICKS 2
+#define POOL_SHRINK_TICKS 5
+#define POOL_RESIZE_COOLDOWN_TICKS 2
+
+// 单写者计数器：只有所属线程写入，用 relaxed 读写代替带锁前缀的原子加
+#define COUNTER_ADD(counter, value)                                            \
+  atomic_store_explicit(                                                       \
+      (counter),                                                               \
+      atomic_load_explicit((counter), memory_order_relaxed) + (value),         \
+      memory_order_relaxed)
+
+// 当前线程所属的工作线程数据，非工作线程为 NULL
+static __thread ThreadData *current_worker = NULL;
+
+// 窃取目标选择使用的线程本地 xorshift 随机数状态
+static __thread uint32_t steal_rng_state = 0;
+
+// 按线程累计的计数器的汇总
+typedef struct PoolCounters {
+  uint64_t completed;                     // 已完成任务数
+  uint64_t affinity_hits;                 // 亲和路由命中数
+  uint64_t affinity_misses;               // 亲和路由未命中数
+  uint64_t idle_hits[WORKER_IDLE_STAGE_PARK + 1]; // 各等待阶段等到的任务数
+  uint64_t exec_time;                     // 累计执行时间(纳秒)
+  uint64_t idle_time;                     // 累计空闲时间(毫秒)
+  uint64_t busy_time;                     // 累计忙碌时间(毫秒)
+  uint64_t dequeued[TASK_PRIORITY_COUNT]; // 各优先级从全局队列取出的任务数
+  uint64_t wait_ns[TASK_PRIORITY_COUNT];  // 各优先级累计排队时间(纳秒)
+} PoolCounters;
 
 typedef struct TaskCompletionState {
   Task *task;
-  clock_t start_time; // 任务开始执行的时间
+  uint64_t start_time; // 任务开始执行的时间(单调时钟纳秒)
+  TaskStatus status;   // 结束状态
 
   struct ThreadData *thread_data; // 指向线程池的指针
+
+  WorkerTaskIO *io;    // 传给运行时的输入输出
+  WorkerTaskIO own_io; // 任务不属于任务图也没有句柄时使用
 } TaskCompletionState;
 
+// 将运行时的 performance 条目转交给线程池配置的观察者
+static void task_performance_observer(void *arg,
+                                      const PerformanceEntry *entries,
+                                      int count, void *opaque) {
+  TaskCompletionState *taskState = (TaskCompletionState *)arg;
+  ThreadPool *pool = (ThreadPool *)opaque;
+  if (taskState == NULL || pool->config.performance_observer == NULL)
+    return;
+
+  pool->config.performance_observer(taskState->task->task_id,
+                                    taskState->task->callback_arg, entries,
+                                    count);
+}
+
 /**
- * @brief 获取当前时间戳（毫秒）
- * @return 当前时间的毫秒时间戳
+ * @brief 将线程标记为忙碌，并累加空闲时间
+ * @param thread_data 线程数据
  */
-static uint64_t get_current_time_ms(void) {
-  struct timeval tv;
-  gettimeofday(&tv, NULL);
-  return (uint64_t)(tv.tv_sec) * 1000 + (uint64_t)(tv.tv_usec) / 1000;
+static void mark_thread_busy(ThreadData *thread_data) {
+  if (!atomic_load(&thread_data->idle))
+    return;
+
+  ThreadPool *pool = thread_data->pool;
+  atomic_store(&thread_data->idle, false);
+  atomic_fetch_sub(&pool->idle_thread_count, 1);
+
+  // 计算并累加空闲时间
+  uint64_t now = winterq_clock_coarse_ms();
+  COUNTER_ADD(&thread_data->idle_time, now - thread_data->idle_start);
+
+  // 记录忙碌开始时间
+  thread_data->idle_start = now;
 }
 
-static bool check_thread_idle(ThreadData *thread_data) {
-  WINTERQ_LOG_DEBUG("--------check_thread_idle----------\n");
-  int has_pending_events = Worker_RunLoopOnce(thread_data->runtime);
-  if (has_pending_events)
-    return false;
+/**
+ * @brief 线程没有存活的 JS 上下文时将其标记为空闲，并累加忙碌时间
+ * @param thread_data 线程数据
+ */
+static void mark_thread_idle(ThreadData *thread_data) {
+  if (atomic_load(&thread_data->idle) || thread_data->runtime == NULL ||
+      thread_data->runtime->context_count > 0)
+    return;
 
   ThreadPool *pool = thread_data->pool;
-
   atomic_store(&thread_data->idle, true);
   atomic_fetch_add(&pool->idle_thread_count, 1);
 
   // 计算并累加忙碌时间
-  uint64_t now = get_current_time_ms();
-  uint64_t busy_time = now - thread_data->idle_start;
-  atomic_fetch_add(&thread_data->busy_time, busy_time);
+  uint64_t now = winterq_clock_coarse_ms();
+  COUNTER_ADD(&thread_data->busy_time, now - thread_data->idle_start);
 
   // 记录空闲开始时间
   thread_data->idle_start = now;
 
-  // 通知调整线程
-  pthread_mutex_lock(&pool->idle_mutex);
-  pthread_cond_signal(&pool->idle_cond);
-  pthread_mutex_unlock(&pool->idle_mutex);
-  return true;
+  // 通知等待线程
+  pthread_mutex_lock(&pool->wait_mutex);
+  pthread_cond_signal(&pool->wait_cond);
+  pthread_mutex_unlock(&pool->wait_mutex);
+}
+
+/**
+ * @brief 释放任务及其脚本或字节码
+ * @param task 要释放的任务
+ */
+static void free_task(Task *task) {
+  // 没有执行完就被丢弃的任务图节点（线程池关闭时），释放它持有的任务图引用
+  if (task->node != NULL)
+    graph_release(task->node->graph);
+  // 同样，通知等待句柄的线程和附加的提交任务不会再执行
+  if (task->handle != NULL || task->cq != NULL || task->flight != NULL) {
+    TaskResult result = {.task_id = task->task_id,
+                         .status = TASK_STATUS_CANCELLED};
+    if (task->handle != NULL)
+      task_handle_finish(task->handle, &result);
+    if (task->flight != NULL)
+      flight_finish(task->flight, &result);
+    if (task->cq != NULL) {
+      TaskCompletion record = {.result = result,
+                               .user_data = task->callback_arg,
+                               .end_time = winterq_clock_hrtime()};
+      completion_queue_post(task->cq, &record);
+    }
+  }
+
+  // 共享的脚本/字节码和负载只释放引用
+  if (task->blob != NULL)
+    script_blob_release(task->blob);
+  Worker_ReleaseSharedBuffer(task->payload);
+
+  if (task->block != NULL) {
+    // 批量分配的任务随所在内存块一起释放
+    if (atomic_fetch_sub(&task->block->refs, 1) == 1)
+      free(task->block);
+    return;
+  }
+
+  if (task->blob == NULL) {
+    if (task->is_script && task->script != NULL) {
+      free((void *)task->script); // 释放脚本字符串
+    } else if (!task->is_script && task->bytecode != NULL) {
+      free(task->bytecode); // 释放字节码
+    }
+  }
+  free(task);
 }
 
 // 回调包装函数，用于计算执行时间并释放任务
@@ -95,7 +273,7 @@ static void task_completion_callback(void *arg) {
   ThreadData *thread_data = taskState->thread_data;
   if (!thread_data) {
     // 如果没有线程池指针，只释放任务
-    free(task);
+    free_task(task);
     free(taskState);
     return;
   }
@@ -103,708 +281,4673 @@ static void task_completion_callback(void *arg) {
   ThreadPool *pool = thread_data->pool;
   if (!pool) {
     // 如果没有线程池指针，只释放任务
-    free(task);
+    free_task(task);
     free(taskState);
     return;
   }
 
   // 计算执行时间
-  clock_t end_time = clock();
-  task->execution_time =
-      ((double)(end_time - taskState->start_time)) / CLOCKS_PER_SEC;
+  uint64_t end_time = winterq_clock_hrtime();
+  uint64_t start_time = taskState->start_time;
+  task->execution_time = (double)(end_time - start_time) / 1e9;
 
   WINTERQ_LOG_DEBUG("Task %d executed in %.2f seconds\n", task->task_id,
                     task->execution_time);
 
+  TaskResult result = {
+      .task_id = task->task_id,
+      .status = taskState->status,
+      .late = task->deadline != 0 && end_time > task->deadline,
+      .execution_time = task->execution_time,
+  };
+  if (result.late)
+    atomic_fetch_add(&pool->late_tasks, 1);
+
+  // 执行被取消中断，或者上下文因取消被提前释放
+  TaskHandle *handle = task->handle;
+  task->handle = NULL; // 由 task_handle_finish 释放句柄引用
+  if (handle != NULL && handle->io.cancelled) {
+    result.status = TASK_STATUS_CANCELLED;
+    atomic_fetch_add(&pool->cancelled_tasks, 1);
+  }
+
   // 保存回调信息，因为我们将在释放 wctx 之前调用它
   void (*callback)(void *) = task->callback;
+  void (*completion)(const TaskResult *, void *) = task->completion;
   void *callback_arg = task->callback_arg;
+  KeyLane *lane = task->lane;
+  Tenant *tenant = task->tenant;
+  TaskGraphNode *node = task->node;
+  task->node = NULL; // 任务图引用由 graph_node_finish 释放
+  FlightEntry *flight = task->flight;
+  task->flight = NULL;
+
+  // 完成记录带走脚本的输出
+  CompletionQueue *cq = task->cq;
+  TaskCompletion record;
+  if (cq != NULL) {
+    task->cq = NULL;
+    record = (TaskCompletion){
+        .result = result,
+        .user_data = callback_arg,
+        .enqueue_time = task->enqueue_time,
+        .start_time = start_time,
+        .end_time = end_time,
+    };
+    if (taskState->io != NULL) {
+      record.output = taskState->io->output;
+      record.output_len = taskState->io->output_len;
+      record.result.output = record.output;
+      record.result.output_len = record.output_len;
+      taskState->io->output = NULL;
+      taskState->io->output_len = 0;
+    }
+  }
+
+  // 输出交给完成函数，任务自己的输出在回调返回后释放
+  uint8_t *own_output = NULL;
+  if (taskState->io != NULL) {
+    result.output = taskState->io->output;
+    result.output_len = taskState->io->output_len;
+    taskState->io->payload = NULL; // 负载引用随任务释放
+    if (taskState->io == &taskState->own_io)
+      own_output = taskState->own_io.output;
+  }
+
+  // 确定性脚本成功结束（没有抛出异常）时缓存输出
+  if (task->memoize && result.status == TASK_STATUS_COMPLETED &&
+      taskState->io != NULL && !taskState->io->error)
+    memo_store(pool, &task->memo_key, result.output, result.output_len);
 
   // 释放任务
-  free(task);
+  free_task(task);
   free(taskState);
 
-  // 调用原始回调（如果有）
-  if (callback) {
+  // 投递完成记录或调用原始回调（如果有）
+  if (cq != NULL) {
+    completion_queue_post(cq, &record);
+  } else if (completion) {
+    completion(&result, callback_arg);
+  } else if (callback) {
     callback(callback_arg);
   }
-
-  // 更新完成任务计数
-  atomic_fetch_add(&pool->completed_tasks, 1);
+  // 附加的提交收到相同的结果（包括输出）
+  if (flight != NULL)
+    flight_finish(flight, &result);
+  free(own_output);
+
+  // 更新完成任务计数，完成回调总在任务所在的工作线程上执行
+  COUNTER_ADD(&thread_data->exec_time, end_time - start_time);
+  COUNTER_ADD(&thread_data->tasks_completed, 1);
+
+  // 回调返回后才放出同一个键的下一个任务
+  if (lane != NULL)
+    lane_release(pool, lane);
+  // 归还租户的并发额度，放出等待中的租户任务
+  if (tenant != NULL)
+    tenant_release(pool, tenant);
+  // 放出任务图中就绪的后继
+  if (node != NULL)
+    graph_node_finish(pool, node, result.status);
+  if (handle != NULL)
+    task_handle_finish(handle, &result);
 
   // 通知等待线程
   pthread_mutex_lock(&pool->wait_mutex);
   pthread_cond_signal(&pool->wait_cond);
   pthread_mutex_unlock(&pool->wait_mutex);
+
+  // 异步完成（定时器等）时在工作线程的事件循环中执行到这里：
+  // 释放的上下文可能腾出了容量，或者线程已经没有存活的上下文
+  if (thread_data->throttled && !atomic_load(&pool->shutdown)) {
+    thread_data->throttled = false;
+    worker_send_wakeup(thread_data);
+  } else if (!thread_data->draining) {
+    mark_thread_idle(thread_data);
+  }
 }
 
 /**
- * @brief 初始化任务队列
- * @param queue 要初始化的队列
- * @param max_size 队列最大容量，0表示无限制
+ * @brief 将容量向上取整为 2 的幂
+ * @param capacity 期望容量，0 表示默认容量
+ * @return 2 的幂容量
  */
-static void init_task_queue(TaskQueue *queue, size_t max_size) {
-  WINTERQ_LOG_DEBUG("--------init_task_queue----------\n");
-  if (queue == NULL)
-    return;
+static size_t task_ring_capacity(size_t capacity) {
+  if (capacity == 0)
+    capacity = TASK_RING_DEFAULT_CAPACITY;
+  size_t size = 2; // 至少两个槽位，保证 sequence 的轮次可区分
+  while (size < capacity)
+    size <<= 1;
+  return size;
+}
 
-  queue->head = NULL;
-  queue->tail = NULL;
-  queue->size = 0;
-  queue->max_size = max_size;
-  // 初始化同步原语
-  if (pthread_mutex_init(&queue->mutex, NULL) != 0) {
-    WINTERQ_LOG_ERROR("Failed to initialize queue mutex\n");
-    return;
-  }
+/**
+ * @brief 初始化无锁环形队列
+ * @param ring 要初始化的队列
+ * @param capacity 期望容量，向上取整为 2 的幂，0 表示默认容量
+ * @return 成功返回0，失败返回-1
+ */
+static int init_task_ring(TaskRing *ring, size_t capacity) {
+  WINTERQ_LOG_DEBUG("--------init_task_ring----------\n");
+  if (ring == NULL)
+    return -1;
 
-  if (pthread_cond_init(&queue->not_empty, NULL) != 0) {
-    WINTERQ_LOG_ERROR("Failed to initialize queue not_empty condition\n");
-    pthread_mutex_destroy(&queue->mutex);
-    return;
+  size_t size = task_ring_capacity(capacity);
+  ring->cells = (TaskRingCell *)calloc(size, sizeof(TaskRingCell));
+  if (ring->cells == NULL) {
+    WINTERQ_LOG_ERROR("Failed to allocate memory for task ring\n");
+    return -1;
   }
 
-  if (pthread_cond_init(&queue->not_full, NULL) != 0) {
-    WINTERQ_LOG_ERROR("Failed to initialize queue not_full condition\n");
-    pthread_mutex_destroy(&queue->mutex);
-    pthread_cond_destroy(&queue->not_empty);
-    return;
+  // 槽位 i 初始可被第 i 个入队操作使用
+  for (size_t i = 0; i < size; i++) {
+    atomic_init(&ring->cells[i].sequence, i);
+    ring->cells[i].task = NULL;
+  }
+  ring->capacity = size;
+  ring->mask = size - 1;
+  atomic_init(&ring->enqueue_pos, 0);
+  atomic_init(&ring->dequeue_pos, 0);
+  atomic_init(&ring->full_waiters, 0);
+
+  if (pthread_mutex_init(&ring->mutex, NULL) != 0 ||
+      pthread_cond_init(&ring->not_full, NULL) != 0) {
+    WINTERQ_LOG_ERROR("Failed to initialize task ring condition\n");
+    free(ring->cells);
+    ring->cells = NULL;
+    return -1;
   }
 
-  WINTERQ_LOG_INFO("Task queue initialized with max size: %zu\n", max_size);
+  WINTERQ_LOG_INFO("Task ring initialized with capacity: %zu\n", size);
+  return 0;
 }
 
 /**
- * @brief 销毁任务队列并释放所有资源
- * @param queue 要销毁的队列
+ * @brief 销毁环形队列，释放仍在队列中的任务
+ * @param ring 要销毁的队列
  */
-static void destroy_task_queue(TaskQueue *queue) {
-  WINTERQ_LOG_DEBUG("--------destroy_task_queue----------\n");
-  if (queue == NULL)
+static void destroy_task_ring(TaskRing *ring) {
+  WINTERQ_LOG_DEBUG("--------destroy_task_ring----------\n");
+  if (ring == NULL || ring->cells == NULL)
     return;
 
-  pthread_mutex_lock(&queue->mutex);
-
-  TaskNode *current = queue->head;
-  while (current != NULL) {
-    TaskNode *next = current->next;
-    if (current->task->is_script && current->task->script != NULL) {
-      free((void *)current->task->script); // 释放脚本字符串
-    } else if (!current->task->is_script && current->task->bytecode != NULL) {
-      free(current->task->bytecode); // 释放字节码
-    }
-    free(current);
-    current = next;
-  }
-
-  queue->head = NULL;
-  queue->tail = NULL;
-  queue->size = 0;
-
-  pthread_mutex_unlock(&queue->mutex);
+  Task *task;
+  while ((task = task_ring_dequeue(ring)) != NULL)
+    free_task(task);
 
-  // 销毁同步原语
-  pthread_mutex_destroy(&queue->mutex);
-  pthread_cond_destroy(&queue->not_empty);
-  pthread_cond_destroy(&queue->not_full);
+  free(ring->cells);
+  ring->cells = NULL;
+  pthread_mutex_destroy(&ring->mutex);
+  pthread_cond_destroy(&ring->not_full);
 
-  WINTERQ_LOG_INFO("Task queue destroyed\n");
+  WINTERQ_LOG_INFO("Task ring destroyed\n");
 }
 
 /**
- * @brief 向任务队列中添加任务
- * @param queue 目标队列
+ * @brief 尝试入队（无锁、不阻塞）
+ * @param ring 目标队列
  * @param task 要添加的任务
- * @return 成功返回0，队列满返回1，其他错误返回-1
+ * @return 成功返回0，队列满返回1
  */
-static int enqueue_task(TaskQueue *queue, Task *task) {
-  WINTERQ_LOG_DEBUG("--------enqueue_task----------\n");
-  if (queue == NULL || task == NULL)
-    return -1;
-
-  TaskNode *node;
-
-  pthread_mutex_lock(&queue->mutex);
-
-  // Check if queue is full
-  while (queue->max_size > 0 && queue->size >= queue->max_size) {
-    // Wait for space with timeout
-    struct timespec ts;
-    clock_gettime(CLOCK_REALTIME, &ts);
-    ts.tv_nsec += 100 * 1000000; // 100 millisecond timeout
-
-    int wait_status =
-        pthread_cond_timedwait(&queue->not_full, &queue->mutex, &ts);
-    if (wait_status == ETIMEDOUT) {
-      pthread_mutex_unlock(&queue->mutex);
-      return 1; // Queue is full, couldn't add task
+static int task_ring_try_enqueue(TaskRing *ring, Task *task) {
+  size_t pos = atomic_load_explicit(&ring->enqueue_pos, memory_order_relaxed);
+  TaskRingCell *cell;
+
+  for (;;) {
+    cell = &ring->cells[pos & ring->mask];
+    size_t seq = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+    intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+    if (diff == 0) {
+      // 槽位空闲，抢占这个位置
+      if (atomic_compare_exchange_weak_explicit(&ring->enqueue_pos, &pos,
+                                                pos + 1, memory_order_relaxed,
+                                                memory_order_relaxed))
+        break;
+    } else if (diff < 0) {
+      // 槽位还未被上一轮消费，队列已满
+      return 1;
+    } else {
+      // 其他生产者已经抢占，重新读取位置
+      pos = atomic_load_explicit(&ring->enqueue_pos, memory_order_relaxed);
     }
   }
 
-  node = calloc(1, sizeof(TaskNode));
-  if (node == NULL) { // 内存分配失败
-    pthread_mutex_unlock(&queue->mutex);
-    return -1;
-  }
-
-  node->task = task;
-  node->next = NULL;
-
-  if (queue->size == 0) {
-    queue->head = node;
-    queue->tail = node;
-  } else {
-    queue->tail->next = node;
-    queue->tail = node;
-  }
-
-  queue->size++;
-
-  // 通知等待中的线程有新任务
-  pthread_cond_signal(&queue->not_empty);
-  pthread_mutex_unlock(&queue->mutex);
-
+  cell->task = task;
+  atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
   return 0;
 }
 
 /**
- * @brief 从任务队列中取出任务
- * @param queue 源队列
- * @return 任务指针，如果队列为空返回NULL
+ * @brief 在环形队列中一次预留最多 n 个连续槽位并写入任务（无锁、不阻塞）
+ * @param ring 目标队列
+ * @param tasks 要添加的任务
+ * @param n 任务数
+ * @param before_publish 预留成功后、任务对消费者可见前调用，参数为预留数量
+ * @param arg before_publish 的参数
+ * @return 实际入队的任务数（tasks 的前缀长度）
  */
-static Task *dequeue_task(TaskQueue *queue) {
-  WINTERQ_LOG_DEBUG("--------dequeue_task----------\n");
-  if (queue == NULL)
-    return NULL;
-
-  Task *task = NULL;
-  TaskNode *node;
-
-  pthread_mutex_lock(&queue->mutex);
-
-  // 如果队列为空，使用条件变量等待而不是立即返回
-  if (queue->size == 0) {
-    struct timespec ts;
-    clock_gettime(CLOCK_REALTIME, &ts);
-    ts.tv_nsec += 10 * 1000000; // 10ms timeout
-    if (ts.tv_nsec >= 1000 * 1000000) {
-      ts.tv_sec += 1;
-      ts.tv_nsec -= 1000000000;
+static size_t task_ring_enqueue_batch(TaskRing *ring, Task **tasks, size_t n,
+                                      void (*before_publish)(void *, size_t),
+                                      void *arg) {
+  size_t pos = atomic_load_explicit(&ring->enqueue_pos, memory_order_relaxed);
+  size_t count;
+
+  for (;;) {
+    // 统计从 pos 开始有多少个连续的空闲槽位
+    count = 0;
+    while (count < n && count < ring->capacity) {
+      TaskRingCell *cell = &ring->cells[(pos + count) & ring->mask];
+      size_t seq = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+      if (seq != pos + count)
+        break;
+      count++;
     }
 
-    int wait_status =
-        pthread_cond_timedwait(&queue->not_empty, &queue->mutex, &ts);
-    if (wait_status != 0 || queue->size == 0) {
-      pthread_mutex_unlock(&queue->mutex);
-      return NULL;
+    if (count == 0) {
+      TaskRingCell *cell = &ring->cells[pos & ring->mask];
+      size_t seq = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+      if ((intptr_t)seq - (intptr_t)pos < 0)
+        return 0; // 队列已满
+      pos = atomic_load_explicit(&ring->enqueue_pos, memory_order_relaxed);
+      continue;
     }
-  }
 
-  node = queue->head;
-
-  if (queue->size == 1) {
-    queue->head = NULL;
-    queue->tail = NULL;
-  } else {
-    queue->head = queue->head->next;
+    // 一次 CAS 预留 [pos, pos + count)
+    if (atomic_compare_exchange_weak_explicit(&ring->enqueue_pos, &pos,
+                                              pos + count, memory_order_relaxed,
+                                              memory_order_relaxed))
+      break;
   }
 
-  queue->size--;
+  if (before_publish != NULL)
+    before_publish(arg, count);
 
-  // Signal that queue is not full
-  if (queue->max_size > 0 &&
-      queue->size < queue->max_size) { // 通知等待的生产者线程
-    pthread_cond_signal(&queue->not_full);
+  for (size_t i = 0; i < count; i++) {
+    TaskRingCell *cell = &ring->cells[(pos + i) & ring->mask];
+    cell->task = tasks[i];
+    atomic_store_explicit(&cell->sequence, pos + i + 1, memory_order_release);
   }
+  return count;
+}
 
-  pthread_mutex_unlock(&queue->mutex);
+/**
+ * @brief 尝试出队（无锁、不阻塞）
+ * @param ring 源队列
+ * @return 任务指针，如果队列为空返回NULL
+ */
+static Task *task_ring_dequeue(TaskRing *ring) {
+  size_t pos = atomic_load_explicit(&ring->dequeue_pos, memory_order_relaxed);
+  TaskRingCell *cell;
+
+  for (;;) {
+    cell = &ring->cells[pos & ring->mask];
+    size_t seq = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+    intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak_explicit(&ring->dequeue_pos, &pos,
+                                                pos + 1, memory_order_relaxed,
+                                                memory_order_relaxed))
+        break;
+    } else if (diff < 0) {
+      // 槽位还未被生产者写入，队列为空
+      return NULL;
+    } else {
+      pos = atomic_load_explicit(&ring->dequeue_pos, memory_order_relaxed);
+    }
+  }
 
-  if (node != NULL) {
-    task = node->task;
-    free(node);
+  Task *task = cell->task;
+  cell->task = NULL;
+  // 释放槽位给下一轮的生产者
+  atomic_store_explicit(&cell->sequence, pos + ring->mask + 1,
+                        memory_order_release);
+
+  // 只有在有生产者等待空位时才加锁通知
+  if (atomic_load(&ring->full_waiters) > 0) {
+    pthread_mutex_lock(&ring->mutex);
+    pthread_cond_signal(&ring->not_full);
+    pthread_mutex_unlock(&ring->mutex);
   }
 
   return task;
 }
 
 /**
- * Try to steal a task from another thread
- *
- * @param pool The thread pool
- * @param thief_id ID of the thread attempting to steal
- * @return A stolen task or NULL if no task could be stolen
+ * @brief 入队，队列满时最多阻塞等待 timeout_ms
+ * @param ring 目标队列
+ * @param task 要添加的任务
+ * @param timeout_ms 最长等待时间(毫秒)，0表示不等待
+ * @return 成功返回0，队列满返回1，其他错误返回-1
  */
-static Task *steal_task(ThreadPool *pool, int thief_id) {
-  WINTERQ_LOG_DEBUG("--------steal_task----------\n");
-  if (pool == NULL || thief_id < 0 || thief_id >= pool->thread_count)
-    return NULL;
-
-  Task *task = NULL;
-  ThreadData *thread_data = pool->thread_data;
+static int task_ring_enqueue_wait(TaskRing *ring, Task *task, int timeout_ms) {
+  WINTERQ_LOG_DEBUG("--------task_ring_enqueue_wait----------\n");
+  if (ring == NULL || ring->cells == NULL || task == NULL)
+    return -1;
 
-  // 随机选择起始点以避免窃取模式
-  int start_victim = rand() % pool->thread_count;
+  if (task_ring_try_enqueue(ring, task) == 0)
+    return 0;
+  if (timeout_ms <= 0)
+    return 1;
 
-  // Try to steal from other threads
-  for (int i = 0; i < pool->thread_count; i++) {
-    int victim_id = (start_victim + i) % pool->thread_count;
-    // Don't steal from yourself
-    if (victim_id == thief_id)
-      continue;
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_sec += timeout_ms / 1000;
+  ts.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+  if (ts.tv_nsec >= 1000000000) {
+    ts.tv_sec += 1;
+    ts.tv_nsec -= 1000000000;
+  }
 
-    // 如果目标线程是空闲的，可能没有任务可偷
-    if (atomic_load(&thread_data[victim_id].idle)) {
-      continue;
+  int ret = 1;
+  pthread_mutex_lock(&ring->mutex);
+  atomic_fetch_add(&ring->full_waiters, 1);
+  for (;;) {
+    // 先登记等待者再重试，避免错过消费者的通知
+    if (task_ring_try_enqueue(ring, task) == 0) {
+      ret = 0;
+      break;
     }
+    if (pthread_cond_timedwait(&ring->not_full, &ring->mutex, &ts) ==
+        ETIMEDOUT) {
+      ret = task_ring_try_enqueue(ring, task) == 0 ? 0 : 1;
+      break;
+    }
+  }
+  atomic_fetch_sub(&ring->full_waiters, 1);
+  pthread_mutex_unlock(&ring->mutex);
 
-    // Try to lock the victim's queue
-    if (pthread_mutex_trylock(&thread_data[victim_id].local_queue.mutex) == 0) {
-      // Check if there's a task to steal
-      if (thread_data[victim_id].local_queue.size >
-          1) { // Leave at least one task
-        TaskNode *node = thread_data[victim_id].local_queue.head;
-        thread_data[victim_id].local_queue.head = node->next;
-        thread_data[victim_id].local_queue.size--;
+  return ret;
+}
 
-        if (thread_data[victim_id].local_queue.size == 0) {
-          thread_data[victim_id].local_queue.tail = NULL;
-        }
+/**
+ * @brief 获取环形队列中的任务数（近似值）
+ * @param ring 任务队列
+ * @return 任务数
+ */
+static size_t task_ring_size(TaskRing *ring) {
+  size_t dequeue_pos = atomic_load(&ring->dequeue_pos);
+  size_t enqueue_pos = atomic_load(&ring->enqueue_pos);
+  return enqueue_pos > dequeue_pos ? enqueue_pos - dequeue_pos : 0;
+}
 
-        task = node->task;
-        free(node);
+CompletionQueue *completion_queue_create(size_t capacity) {
+  CompletionQueue *cq = (CompletionQueue *)aligned_alloc(
+      _Alignof(CompletionQueue), sizeof(CompletionQueue));
+  if (cq == NULL) {
+    WINTERQ_LOG_ERROR("Failed to allocate memory for completion queue\n");
+    return NULL;
+  }
+  memset(cq, 0, sizeof(CompletionQueue));
+
+  if (capacity == 0)
+    capacity = COMPLETION_QUEUE_DEFAULT_CAPACITY;
+  size_t size = task_ring_capacity(capacity);
+  cq->cells = (CompletionCell *)calloc(size, sizeof(CompletionCell));
+  cq->eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (cq->cells == NULL || cq->eventfd < 0) {
+    WINTERQ_LOG_ERROR("Failed to initialize completion queue\n");
+    if (cq->eventfd >= 0)
+      close(cq->eventfd);
+    free(cq->cells);
+    free(cq);
+    return NULL;
+  }
 
-        WINTERQ_LOG_INFO("Thread %d stole task from thread %d\n", thief_id,
-                         victim_id);
-      }
+  cq->capacity = size;
+  cq->mask = size - 1;
+  for (size_t i = 0; i < size; i++)
+    atomic_init(&cq->cells[i].sequence, i);
+  atomic_init(&cq->enqueue_pos, 0);
+  cq->dequeue_pos = 0;
+  atomic_init(&cq->slots, (long)size);
+  atomic_init(&cq->signaled, false);
+  return cq;
+}
 
-      pthread_mutex_unlock(&thread_data[victim_id].local_queue.mutex);
+int completion_queue_fd(const CompletionQueue *cq) {
+  return cq != NULL ? cq->eventfd : -1;
+}
 
-      if (task != NULL) {
-        break; // Successfully stole a task
-      }
-    }
+/**
+ * @brief 为提交的任务预留一个槽位
+ * @param cq 完成队列
+ * @return 成功返回true，槽位用完返回false
+ */
+static bool completion_queue_reserve(CompletionQueue *cq) {
+  long slots = atomic_load(&cq->slots);
+  while (slots > 0) {
+    if (atomic_compare_exchange_weak(&cq->slots, &slots, slots - 1))
+      return true;
   }
-
-  return task;
+  return false;
 }
 
 /**
- * @brief 执行任务
- * @param runtime 执行任务的 Worker Runtime
- * @param task 要执行的任务
+ * @brief 归还预留的槽位（提交失败或记录被收割）
+ * @param cq 完成队列
+ * @param n 槽位数
  */
-static void execute_task(ThreadData *thread_data, Task *task) {
-  WINTERQ_LOG_DEBUG("--------execute_task----------\n");
-  if (thread_data == NULL || task == NULL)
-    return;
-
-  // 记录开始时间
-  TaskCompletionState *taskState =
-      (TaskCompletionState *)calloc(1, sizeof(TaskCompletionState));
-  taskState->task = task;
-  taskState->start_time = clock();
-  taskState->thread_data = thread_data;
+static void completion_queue_unreserve(CompletionQueue *cq, size_t n) {
+  if (n > 0)
+    atomic_fetch_add(&cq->slots, (long)n);
+}
 
-  if (task->is_script) {
-    // 执行JavaScript脚本
-    Worker_Eval_JS(thread_data->runtime, task->script, task_completion_callback,
-                   taskState);
-    if (task->script != NULL) {
-      free((void *)task->script); // 释放脚本字符串
-      task->script = NULL;
-    }
-  } else { // 执行JavaScript字节码
-    Worker_Eval_Bytecode(thread_data->runtime, task->bytecode,
-                         task->bytecode_len, task_completion_callback,
-                         taskState);
-    if (task->bytecode != NULL) {
-      free(task->bytecode); // 释放字节码
-      task->bytecode = NULL;
-    }
+/**
+ * @brief 在工作线程上投递完成记录，槽位已在提交时预留，不会失败
+ *
+ * 上次收割后第一条记录写 eventfd，之后的记录不再产生系统调用
+ * @param cq 完成队列
+ * @param entry 完成记录，输出的所有权转移给队列
+ */
+static void completion_queue_post(CompletionQueue *cq,
+                                  const TaskCompletion *entry) {
+  size_t pos = atomic_fetch_add(&cq->enqueue_pos, 1);
+  CompletionCell *cell = &cq->cells[pos & cq->mask];
+
+  // 预留保证槽位已被收割，这里只是防御
+  while (atomic_load_explicit(&cell->sequence, memory_order_acquire) != pos)
+    sched_yield();
+
+  cell->entry = *entry;
+  atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+
+  if (!atomic_exchange(&cq->signaled, true)) {
+    uint64_t one = 1;
+    if (write(cq->eventfd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+      WINTERQ_LOG_ERROR("Failed to signal completion queue: %d\n", errno);
   }
-
-  // 执行一次事件循环，处理可能的定时器和其他异步任务
-  Worker_RunLoopOnce(thread_data->runtime);
-
-  WINTERQ_LOG_DEBUG("Task %d executed synchronous successfully.\n",
-                    task->task_id);
 }
 
-// 线程工作函数
-static void *worker_thread(void *arg) {
-  WINTERQ_LOG_DEBUG("--------worker_thread----------\n");
-  ThreadData *thread_data = (ThreadData *)arg;
-  ThreadPool *pool = thread_data->pool;
-  Task *task = NULL;
-  int thread_id = thread_data->thread_id;
+size_t completion_queue_reap(CompletionQueue *cq, TaskCompletion *out,
+                             size_t max) {
+  if (cq == NULL || out == NULL)
+    return 0;
 
-  WorkerRuntime *wrt = Worker_NewRuntime(thread_data->max_contexts);
-  if (wrt == NULL) {
-    WINTERQ_LOG_ERROR("Failed to create worker runtime for thread %d\n",
-                      thread_id);
-    return NULL;
+  // 先清除通知状态再收割，之后投递的记录会重新写 eventfd
+  uint64_t value;
+  if (read(cq->eventfd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+    WINTERQ_LOG_ERROR("Failed to read completion queue eventfd: %d\n", errno);
+  atomic_store(&cq->signaled, false);
+
+  size_t n = 0;
+  while (n < max) {
+    size_t pos = cq->dequeue_pos;
+    CompletionCell *cell = &cq->cells[pos & cq->mask];
+    if (atomic_load_explicit(&cell->sequence, memory_order_acquire) != pos + 1)
+      break;
+    out[n++] = cell->entry;
+    atomic_store_explicit(&cell->sequence, pos + cq->capacity,
+                          memory_order_release);
+    cq->dequeue_pos = pos + 1;
   }
 
-  thread_data->runtime = wrt;
+  // 没有收割完时保持 eventfd 可读
+  if (n == max && !atomic_exchange(&cq->signaled, true)) {
+    uint64_t one = 1;
+    if (write(cq->eventfd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+      WINTERQ_LOG_ERROR("Failed to signal completion queue: %d\n", errno);
+  }
 
-  // 线程开始时为空闲状态
-  atomic_store(&thread_data->idle, true);
-  atomic_fetch_add(&pool->idle_thread_count, 1);
-  thread_data->idle_start = get_current_time_ms();
+  completion_queue_unreserve(cq, n);
+  return n;
+}
 
-  WINTERQ_LOG_INFO("Worker thread %d started\n", thread_id);
+int completion_queue_wait(CompletionQueue *cq, int timeout_ms) {
+  if (cq == NULL)
+    return -1;
+  struct pollfd pfd = {.fd = cq->eventfd, .events = POLLIN};
+  int rc;
+  do {
+    rc = poll(&pfd, 1, timeout_ms);
+  } while (rc < 0 && errno == EINTR);
+  if (rc < 0)
+    return -1;
+  return rc > 0 ? 0 : 1;
+}
 
-  // 线程主循环
-  while (!atomic_load(&pool->shutdown)) {
-    bool was_idle = atomic_load(&thread_data->idle);
-    task = NULL;
+void completion_queue_destroy(CompletionQueue *cq) {
+  if (cq == NULL)
+    return;
+  TaskCompletion entry;
+  while (completion_queue_reap(cq, &entry, 1) == 1)
+    free(entry.output);
+  close(cq->eventfd);
+  free(cq->cells);
+  free(cq);
+}
 
-    // 尝试获取任务，优先级：全局队列 > 本地队列 > 工作窃取
-    task = dequeue_task(&pool->queue);
-    if (task == NULL)
-      task = dequeue_task(&thread_data->local_queue);
-    if (task == NULL && pool->config.enable_work_stealing)
-      task = steal_task(pool, thread_id);
-
-    // 如果获得了任务
-    if (task != NULL) {
-      // 更新线程状态为忙碌
-      if (was_idle) {
-        was_idle = false;
-        atomic_store(&thread_data->idle, false);
-        atomic_fetch_sub(&pool->idle_thread_count, 1);
-
-        // 计算并累加空闲时间
-        uint64_t now = get_current_time_ms();
-        uint64_t idle_time = now - thread_data->idle_start;
-        atomic_fetch_add(&thread_data->idle_time, idle_time);
-
-        // 记录忙碌开始时间
-        thread_data->idle_start = now;
-      }
-      // 执行任务
-      execute_task(thread_data, task);
+// 全局队列的出队顺序（严格优先级）
+static const TaskPriority task_priority_order[TASK_PRIORITY_COUNT] = {
+    TASK_PRIORITY_HIGH, TASK_PRIORITY_NORMAL, TASK_PRIORITY_LOW};
 
-      // 更新统计信息
-      atomic_fetch_add(&thread_data->tasks_processed, 1);
+/**
+ * @brief 从全局队列准入名额中获取最多 n 个
+ *
+ * 名额为 0 时，timeout_ms 大于 0 则最多等待这么久直到至少有一个名额
+ * @param pool 线程池
+ * @param n 需要的名额数
+ * @param timeout_ms 最长等待时间(毫秒)，0表示不等待
+ * @return 获得的名额数（0..n）
+ */
+static size_t credits_acquire(ThreadPool *pool, size_t n, int timeout_ms) {
+  long available = atomic_load(&pool->credits);
+  for (;;) {
+    while (available > 0) {
+      long take = available < (long)n ? available : (long)n;
+      if (atomic_compare_exchange_weak(&pool->credits, &available,
+                                       available - take))
+        return (size_t)take;
     }
 
-    if (!was_idle) {
-      // 处理异步逻辑，并判断是否空闲
-      was_idle = check_thread_idle(thread_data);
+    if (timeout_ms <= 0 || atomic_load(&pool->shutdown))
+      return 0;
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += timeout_ms / 1000;
+    ts.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+    if (ts.tv_nsec >= 1000000000) {
+      ts.tv_sec += 1;
+      ts.tv_nsec -= 1000000000;
     }
 
-    // 只有当没有待处理事件时才休眠
-    if (was_idle) {
-      // 短暂休眠以避免CPU占用过高
-      struct timespec ts;
-      ts.tv_sec = 0;
-      ts.tv_nsec = 100 * 1000 * 1000; // 1ms
-      nanosleep(&ts, NULL);
+    // 先登记等待者再检查名额，与 credits_release 配对避免丢失通知
+    int rc = 0;
+    pthread_mutex_lock(&pool->credit_mutex);
+    atomic_fetch_add(&pool->credit_waiters, 1);
+    while (atomic_load(&pool->credits) <= 0 && !atomic_load(&pool->shutdown) &&
+           rc != ETIMEDOUT) {
+      rc = pthread_cond_timedwait(&pool->credit_cond, &pool->credit_mutex, &ts);
     }
+    atomic_fetch_sub(&pool->credit_waiters, 1);
+    pthread_mutex_unlock(&pool->credit_mutex);
+
+    // 只等待一次：超时或被唤醒后再尝试一次获取
+    timeout_ms = 0;
+    available = atomic_load(&pool->credits);
   }
+}
 
-  // 线程退出前清理
-  WINTERQ_LOG_INFO("Worker thread %d exiting\n", thread_id);
+/**
+ * @brief 归还名额，有提交者等待时通知
+ * @param pool 线程池
+ * @param n 归还的名额数
+ */
+static void credits_release(ThreadPool *pool, size_t n) {
+  if (n == 0)
+    return;
+  atomic_fetch_add(&pool->credits, (long)n);
+  if (atomic_load(&pool->credit_waiters) > 0) {
+    pthread_mutex_lock(&pool->credit_mutex);
+    pthread_cond_broadcast(&pool->credit_cond);
+    pthread_mutex_unlock(&pool->credit_mutex);
+  }
+}
 
-  // 释放运行时资源
-  if (thread_data->runtime != NULL) {
-    Worker_FreeRuntime(thread_data->runtime);
-    thread_data->runtime = NULL;
+/**
+ * @brief 比较两个任务在 EDF 堆中的先后
+ * @return a 应排在 b 之前返回true
+ */
+static bool task_heap_before(const Task *a, const Task *b) {
+  // 没有截止时间的任务排在最后
+  uint64_t da = a->deadline != 0 ? a->deadline : UINT64_MAX;
+  uint64_t db = b->deadline != 0 ? b->deadline : UINT64_MAX;
+  if (da != db)
+    return da < db;
+
+  // 相同截止时间按优先级，再按入队时间
+  int ra = 0, rb = 0;
+  for (int k = 0; k < TASK_PRIORITY_COUNT; k++) {
+    if (task_priority_order[k] == a->priority)
+      ra = k;
+    if (task_priority_order[k] == b->priority)
+      rb = k;
   }
+  if (ra != rb)
+    return ra < rb;
+  return a->enqueue_time < b->enqueue_time;
+}
 
-  // 计算最终的空闲/忙碌时间
-  if (atomic_load(&thread_data->idle)) {
-    uint64_t idle_time = get_current_time_ms() - thread_data->idle_start;
-    atomic_fetch_add(&thread_data->idle_time, idle_time);
-  } else {
-    uint64_t busy_time = get_current_time_ms() - thread_data->idle_start;
-    atomic_fetch_add(&thread_data->busy_time, busy_time);
+/**
+ * @brief 初始化 EDF 堆
+ * @param heap 要初始化的堆
+ * @param capacity 期望容量，0 表示默认容量
+ * @return 成功返回0，失败返回-1
+ */
+static int init_task_heap(TaskHeap *heap, size_t capacity) {
+  heap->capacity = task_ring_capacity(capacity);
+  heap->items = (Task **)calloc(heap->capacity, sizeof(Task *));
+  if (heap->items == NULL) {
+    WINTERQ_LOG_ERROR("Failed to allocate memory for task heap\n");
+    return -1;
+  }
+  atomic_init(&heap->size, 0);
+  for (int i = 0; i < TASK_PRIORITY_COUNT; i++)
+    atomic_init(&heap->class_size[i], 0);
+
+  if (pthread_mutex_init(&heap->mutex, NULL) != 0 ||
+      pthread_cond_init(&heap->not_full, NULL) != 0) {
+    WINTERQ_LOG_ERROR("Failed to initialize task heap mutex\n");
+    free(heap->items);
+    heap->items = NULL;
+    return -1;
   }
 
-  return NULL;
+  WINTERQ_LOG_INFO("Task heap initialized with capacity: %zu\n",
+                   heap->capacity);
+  return 0;
 }
 
 /**
- * @brief 线程池大小调整线程, Dynamically adjusts pool size based on workload
- * and idle thread thresholds.
- * @param arg 线程池 (ThreadPool*)
- * @return NULL
+ * @brief 在持有锁的情况下压入任务并上浮
  */
-static void *pool_adjuster_thread(void *arg) {
-  WINTERQ_LOG_DEBUG("--------pool_adjuster_thread----------\n");
-  ThreadPool *pool = (ThreadPool *)arg;
-  if (pool == NULL)
+static void task_heap_push_locked(TaskHeap *heap, Task *task) {
+  size_t i = atomic_load_explicit(&heap->size, memory_order_relaxed);
+  while (i > 0) {
+    size_t parent = (i - 1) / 2;
+    if (!task_heap_before(task, heap->items[parent]))
+      break;
+    heap->items[i] = heap->items[parent];
+    i = parent;
+  }
+  heap->items[i] = task;
+  atomic_fetch_add(&heap->size, 1);
+  atomic_fetch_add(&heap->class_size[task->priority], 1);
+}
+
+/**
+ * @brief 取出截止时间最早的任务
+ * @param heap EDF 堆
+ * @return 任务指针，堆为空时返回NULL
+ */
+static Task *task_heap_pop(TaskHeap *heap) {
+  // 无锁快速判断，避免空闲线程争用互斥锁
+  if (atomic_load(&heap->size) == 0)
     return NULL;
 
-  WINTERQ_LOG_INFO("Pool adjuster thread started\n");
+  pthread_mutex_lock(&heap->mutex);
+  size_t size = atomic_load_explicit(&heap->size, memory_order_relaxed);
+  if (size == 0) {
+    pthread_mutex_unlock(&heap->mutex);
+    return NULL;
+  }
+
+  Task *top = heap->items[0];
+  Task *last = heap->items[--size];
+  size_t i = 0;
+  for (;;) {
+    size_t child = 2 * i + 1;
+    if (child >= size)
+      break;
+    if (child + 1 < size &&
+        task_heap_before(heap->items[child + 1], heap->items[child]))
+      child++;
+    if (!task_heap_before(heap->items[child], last))
+      break;
+    heap->items[i] = heap->items[child];
+    i = child;
+  }
+  if (size > 0)
+    heap->items[i] = last;
+  atomic_store(&heap->size, size);
+  atomic_fetch_sub(&heap->class_size[top->priority], 1);
+
+  pthread_cond_signal(&heap->not_full);
+  pthread_mutex_unlock(&heap->mutex);
+  return top;
+}
+
+/**
+ * @brief 压入任务，堆满时最多阻塞等待 timeout_ms
+ * @param heap EDF 堆
+ * @param task 要添加的任务
+ * @param timeout_ms 最长等待时间(毫秒)，0表示不等待
+ * @return 成功返回0，堆满返回1
+ */
+static int task_heap_push_wait(TaskHeap *heap, Task *task, int timeout_ms) {
+  struct timespec ts;
+  if (timeout_ms > 0) {
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += timeout_ms / 1000;
+    ts.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+    if (ts.tv_nsec >= 1000000000) {
+      ts.tv_sec += 1;
+      ts.tv_nsec -= 1000000000;
+    }
+  }
+
+  pthread_mutex_lock(&heap->mutex);
+  while (atomic_load(&heap->size) >= heap->capacity) {
+    if (timeout_ms <= 0 ||
+        pthread_cond_timedwait(&heap->not_full, &heap->mutex, &ts) ==
+            ETIMEDOUT) {
+      pthread_mutex_unlock(&heap->mutex);
+      return 1;
+    }
+  }
+  task_heap_push_locked(heap, task);
+  pthread_mutex_unlock(&heap->mutex);
+  return 0;
+}
+
+/**
+ * @brief 一次加锁压入最多 n 个任务（不阻塞）
+ * @param heap EDF 堆
+ * @param tasks 要添加的任务
+ * @param n 任务数
+ * @param before_publish 确定接受数量后、任务对消费者可见前调用
+ * @param arg before_publish 的参数
+ * @return 实际压入的任务数（tasks 的前缀长度）
+ */
+static size_t task_heap_push_batch(TaskHeap *heap, Task **tasks, size_t n,
+                                   void (*before_publish)(void *, size_t),
+                                   void *arg) {
+  pthread_mutex_lock(&heap->mutex);
+  size_t space = heap->capacity - atomic_load(&heap->size);
+  size_t count = n < space ? n : space;
+  if (count > 0 && before_publish != NULL)
+    before_publish(arg, count);
+  for (size_t i = 0; i < count; i++)
+    task_heap_push_locked(heap, tasks[i]);
+  pthread_mutex_unlock(&heap->mutex);
+  return count;
+}
+
+/**
+ * @brief 销毁 EDF 堆，释放仍在堆中的任务
+ * @param heap 要销毁的堆
+ */
+static void destroy_task_heap(TaskHeap *heap) {
+  if (heap->items == NULL)
+    return;
+
+  size_t size = atomic_load(&heap->size);
+  for (size_t i = 0; i < size; i++)
+    free_task(heap->items[i]);
+
+  free(heap->items);
+  heap->items = NULL;
+  pthread_mutex_destroy(&heap->mutex);
+  pthread_cond_destroy(&heap->not_full);
+}
+
+/**
+ * @brief 初始化全局队列：EDF 模式使用截止时间堆，否则每个优先级一个环形队列
+ * @param pool 线程池
+ * @param capacity 每个队列的期望容量
+ * @return 成功返回0，失败返回-1
+ */
+static int init_global_queues(ThreadPool *pool, size_t capacity) {
+  for (int i = 0; i < TASK_PRIORITY_COUNT; i++) {
+    atomic_init(&pool->class_stats[i].last_served, 0);
+  }
+
+  if (pool->config.edf_scheduling)
+    return init_task_heap(&pool->edf_queue, capacity);
+
+  for (int i = 0; i < TASK_PRIORITY_COUNT; i++) {
+    if (init_task_ring(&pool->queues[i], capacity) != 0) {
+      while (--i >= 0)
+        destroy_task_ring(&pool->queues[i]);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief 销毁全局队列
+ * @param pool 线程池
+ */
+static void destroy_global_queues(ThreadPool *pool) {
+  if (pool->config.edf_scheduling) {
+    destroy_task_heap(&pool->edf_queue);
+    return;
+  }
+  for (int i = 0; i < TASK_PRIORITY_COUNT; i++)
+    destroy_task_ring(&pool->queues[i]);
+}
+
+/**
+ * @brief 全局队列中某个优先级的任务数（近似值）
+ * @param pool 线程池
+ * @param priority 优先级
+ * @return 任务数
+ */
+static size_t global_queue_class_size(ThreadPool *pool, TaskPriority priority) {
+  if (pool->config.edf_scheduling)
+    return atomic_load(&pool->edf_queue.class_size[priority]);
+  return task_ring_size(&pool->queues[priority]);
+}
+
+/**
+ * @brief 全局队列中的任务总数（近似值）
+ * @param pool 线程池
+ * @return 任务数
+ */
+static size_t global_queue_size(ThreadPool *pool) {
+  if (pool->config.edf_scheduling)
+    return atomic_load(&pool->edf_queue.size);
+
+  size_t size = 0;
+  for (int i = 0; i < TASK_PRIORITY_COUNT; i++)
+    size += task_ring_size(&pool->queues[i]);
+  return size;
+}
+
+/**
+ * @brief 老化计时使用的时钟
+ *
+ * 工作线程上的 winterq_clock_coarse_ms 是本线程事件循环缓存的时间，批量执行
+ * 或长时间运行同步脚本期间不更新；老化时间戳由多个线程读写，必须用同一个实时时钟
+ * @return 单调时钟的毫秒时间戳
+ */
+static uint64_t aging_clock_ms(void) {
+  return winterq_clock_hrtime() / 1000000;
+}
+
+/**
+ * @brief 任务即将进入某个优先级的环形队列：队列由空变为非空时重置老化计时
+ * @param pool 线程池
+ * @param priority 任务优先级
+ */
+static void global_queue_mark_enqueue(ThreadPool *pool, TaskPriority priority) {
+  if (task_ring_size(&pool->queues[priority]) == 0)
+    atomic_store(&pool->class_stats[priority].last_served, aging_clock_ms());
+}
+
+/**
+ * @brief 将任务放入全局队列
+ * @param pool 线程池
+ * @param task 要添加的任务
+ * @param timeout_ms 队列满时的最长等待时间(毫秒)
+ * @return 成功返回0，队列满返回1，其他错误返回-1
+ */
+static int global_enqueue(ThreadPool *pool, Task *task, int timeout_ms) {
+  task->enqueue_time = winterq_clock_hrtime();
+  if (pool->config.edf_scheduling)
+    return task_heap_push_wait(&pool->edf_queue, task, timeout_ms);
+
+  global_queue_mark_enqueue(pool, task->priority);
+  return task_ring_enqueue_wait(&pool->queues[task->priority], task,
+                                timeout_ms);
+}
+
+/**
+ * @brief 一次预留最多 n 个相同优先级任务的位置（不阻塞）
+ * @param pool 线程池
+ * @param priority 这些任务的优先级
+ * @param tasks 要添加的任务
+ * @param n 任务数
+ * @param before_publish 确定接受数量后、任务对工作线程可见前调用
+ * @param arg before_publish 的参数
+ * @return 实际入队的任务数（tasks 的前缀长度）
+ */
+static size_t global_enqueue_batch(ThreadPool *pool, TaskPriority priority,
+                                   Task **tasks, size_t n,
+                                   void (*before_publish)(void *, size_t),
+                                   void *arg) {
+  if (pool->config.edf_scheduling)
+    return task_heap_push_batch(&pool->edf_queue, tasks, n, before_publish,
+                                arg);
+
+  global_queue_mark_enqueue(pool, priority);
+  return task_ring_enqueue_batch(&pool->queues[priority], tasks, n,
+                                 before_publish, arg);
+}
+
+/**
+ * @brief 从全局队列取出任务
+ *
+ * EDF 模式取截止时间最早的任务；否则按严格优先级，
+ * 低优先级等待过久时通过老化提前执行
+ * @param pool 线程池
+ * @return 任务指针，所有队列为空时返回NULL
+ */
+static Task *global_dequeue(ThreadPool *pool, ThreadData *thread_data) {
+  uint64_t now_ms = aging_clock_ms();
+  Task *task = NULL;
+  TaskPriority served = TASK_PRIORITY_NORMAL;
+
+  if (pool->config.edf_scheduling) {
+    task = task_heap_pop(&pool->edf_queue);
+    if (task != NULL)
+      served = task->priority;
+  } else {
+    // 老化：较低优先级的队列太久没有被服务时先取一个
+    for (int k = TASK_PRIORITY_COUNT - 1; k > 0 && task == NULL; k--) {
+      TaskPriority priority = task_priority_order[k];
+      if (task_ring_size(&pool->queues[priority]) == 0)
+        continue;
+      uint64_t last = atomic_load(&pool->class_stats[priority].last_served);
+      // 其他线程可能在本线程读取时间之后写入了更新的时间戳
+      if (now_ms > last && now_ms - last >= TASK_PRIORITY_AGING_MS) {
+        task = task_ring_dequeue(&pool->queues[priority]);
+        served = priority;
+      }
+    }
+
+    // 严格优先级
+    for (int k = 0; k < TASK_PRIORITY_COUNT && task == NULL; k++) {
+      served = task_priority_order[k];
+      task = task_ring_dequeue(&pool->queues[served]);
+    }
+  }
+
+  if (task == NULL)
+    return NULL;
+
+  credits_release(pool, 1);
+  // 同一毫秒内不重复写共享的老化时间戳，也不把它改回更早的时间
+  if (atomic_load_explicit(&pool->class_stats[served].last_served,
+                           memory_order_relaxed) < now_ms)
+    atomic_store(&pool->class_stats[served].last_served, now_ms);
+  COUNTER_ADD(&thread_data->dequeued[served], 1);
+  COUNTER_ADD(&thread_data->wait_ns[served],
+              winterq_clock_hrtime() - task->enqueue_time);
+  return task;
+}
+
+/**
+ * @brief 初始化工作窃取队列
+ * @param deque 要初始化的队列
+ * @param capacity 期望容量，向上取整为 2 的幂，0 表示默认容量
+ * @return 成功返回0，失败返回-1
+ */
+static int init_task_deque(TaskDeque *deque, size_t capacity) {
+  WINTERQ_LOG_DEBUG("--------init_task_deque----------\n");
+  if (deque == NULL)
+    return -1;
+
+  size_t size = task_ring_capacity(capacity == 0 ? TASK_DEQUE_DEFAULT_CAPACITY
+                                                 : capacity);
+  deque->buffer = (Task *_Atomic *)calloc(size, sizeof(Task *_Atomic));
+  if (deque->buffer == NULL) {
+    WINTERQ_LOG_ERROR("Failed to allocate memory for task deque\n");
+    return -1;
+  }
+  deque->capacity = size;
+  deque->mask = size - 1;
+  atomic_init(&deque->top, 0);
+  atomic_init(&deque->bottom, 0);
+
+  return 0;
+}
+
+/**
+ * @brief 所属线程从 bottom 端取出任务
+ * @param deque 本线程的队列
+ * @return 任务指针，队列为空或被窃取者抢先时返回NULL
+ */
+static Task *task_deque_pop(TaskDeque *deque) {
+  int64_t b = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+  atomic_store_explicit(&deque->bottom, b, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+  int64_t t = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+  if (t > b) {
+    // 队列为空，恢复 bottom
+    atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+    return NULL;
+  }
+
+  Task *task = atomic_load_explicit(&deque->buffer[b & deque->mask],
+                                    memory_order_relaxed);
+  if (t == b) {
+    // 最后一个任务，与窃取者竞争
+    if (!atomic_compare_exchange_strong_explicit(&deque->top, &t, t + 1,
+                                                 memory_order_seq_cst,
+                                                 memory_order_relaxed))
+      task = NULL;
+    atomic_store_explicit(&deque->bottom, b + 1, memory_order_relaxed);
+  }
+  return task;
+}
+
+/**
+ * @brief 所属线程在 bottom 端压入任务
+ * @param deque 本线程的队列
+ * @param task 要添加的任务
+ * @return 成功返回0，队列满返回1
+ */
+static int task_deque_push(TaskDeque *deque, Task *task) {
+  int64_t b = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+  int64_t t = atomic_load_explicit(&deque->top, memory_order_acquire);
+  if (b - t >= (int64_t)deque->capacity)
+    return 1;
+
+  atomic_store_explicit(&deque->buffer[b & deque->mask], task,
+                        memory_order_relaxed);
+  // release 保证窃取者看到新的 bottom 时也能看到槽位中的任务
+  atomic_store_explicit(&deque->bottom, b + 1, memory_order_release);
+  return 0;
+}
+
+/**
+ * @brief 其他线程从 top 端窃取一个任务
+ * @param deque 被窃取的队列
+ * @return 任务指针，队列为空或竞争失败时返回NULL
+ */
+static Task *task_deque_steal(TaskDeque *deque) {
+  int64_t t = atomic_load_explicit(&deque->top, memory_order_acquire);
+  atomic_thread_fence(memory_order_seq_cst);
+  int64_t b = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+  if (t >= b)
+    return NULL;
+
+  Task *task = atomic_load_explicit(&deque->buffer[t & deque->mask],
+                                    memory_order_relaxed);
+  if (!atomic_compare_exchange_strong_explicit(&deque->top, &t, t + 1,
+                                               memory_order_seq_cst,
+                                               memory_order_relaxed))
+    return NULL;
+  return task;
+}
+
+/**
+ * @brief 获取工作窃取队列中的任务数（近似值）
+ * @param deque 任务队列
+ * @return 任务数
+ */
+static size_t task_deque_size(TaskDeque *deque) {
+  int64_t b = atomic_load(&deque->bottom);
+  int64_t t = atomic_load(&deque->top);
+  return b > t ? (size_t)(b - t) : 0;
+}
+
+/**
+ * @brief 销毁工作窃取队列，释放仍在队列中的任务
+ *
+ * 只能在所属线程退出后调用
+ * @param deque 要销毁的队列
+ */
+static void destroy_task_deque(TaskDeque *deque) {
+  WINTERQ_LOG_DEBUG("--------destroy_task_deque----------\n");
+  if (deque == NULL || deque->buffer == NULL)
+    return;
+
+  Task *task;
+  while ((task = task_deque_pop(deque)) != NULL)
+    free_task(task);
+
+  free(deque->buffer);
+  deque->buffer = NULL;
+}
+
+/**
+ * @brief 线程本地 xorshift32 随机数，避免 rand() 的全局锁
+ * @return 随机数
+ */
+static uint32_t steal_rng_next(void) {
+  uint32_t x = steal_rng_state;
+  if (x == 0) // 非工作线程或尚未播种
+    x = (uint32_t)winterq_clock_hrtime() | 1;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  steal_rng_state = x;
+  return x;
+}
+
+/**
+ * @brief 亲和队列允许被窃取的积压阈值
+ * @param pool 线程池
+ * @return 阈值，负数表示总是允许窃取
+ */
+static int affinity_steal_threshold(ThreadPool *pool) {
+  int threshold = pool->config.affinity_steal_threshold;
+  return threshold == 0 ? AFFINITY_STEAL_THRESHOLD : threshold;
+}
+
+/**
+ * @brief 从亲和队列取出一个任务，并归还它入队时占用的名额
+ * @param pool 线程池
+ * @param thread_data 亲和队列所属的线程
+ * @return 任务指针，队列为空时返回NULL
+ */
+static Task *affinity_dequeue(ThreadPool *pool, ThreadData *thread_data) {
+  Task *task = task_ring_dequeue(&thread_data->affinity_queue);
+  if (task != NULL)
+    credits_release(pool, 1);
+  return task;
+}
+
+/**
+ * @brief 从线程自己的本地队列取出一个任务，并归还它占用的准入名额
+ *
+ * 只能由所属线程调用，或者在它退出之后调用
+ * @param pool 线程池
+ * @param thread_data 队列所属线程
+ * @return 任务指针，队列为空时返回NULL
+ */
+static Task *local_dequeue(ThreadPool *pool, ThreadData *thread_data) {
+  Task *task = task_deque_pop(&thread_data->local_queue);
+  if (task != NULL)
+    credits_release(pool, 1);
+  return task;
+}
+
+/**
+ * @brief 从其他线程的本地队列窃取一半任务
+ *
+ * 返回第一个窃取到的任务，其余放入窃取者自己的本地队列；
+ * 本地队列为空时，亲和队列积压超过阈值才从中取一个任务，避免破坏缓存热度
+ * @param thief 发起窃取的线程
+ * @return 窃取到的任务，没有可窃取的任务时返回NULL
+ */
+static Task *steal_task(ThreadData *thief) {
+  WINTERQ_LOG_DEBUG("--------steal_task----------\n");
+  ThreadPool *pool = thief->pool;
+  int count = pool->thread_count;
+  if (count <= 1)
+    return NULL;
+
+  // 随机选择起始点以避免窃取模式
+  int start_victim = (int)(steal_rng_next() % (uint32_t)count);
+
+  // 有多个 NUMA 节点时先在本节点内窃取，找不到再跨节点
+  int passes = pool->placement.node_count > 1 ? 2 : 1;
+
+  for (int n = 0; n < passes * count; n++) {
+    ThreadData *victim = pool->thread_data[(start_victim + n) % count];
+    // Don't steal from yourself
+    if (victim == thief)
+      continue;
+    if (passes > 1 &&
+        (victim->numa_node == thief->numa_node) != (n < count))
+      continue;
+
+    size_t available = task_deque_size(&victim->local_queue);
+    if (available == 0) {
+      if (pool->config.affinity_routing &&
+          (long)task_ring_size(&victim->affinity_queue) >
+              affinity_steal_threshold(pool)) {
+        Task *task = affinity_dequeue(pool, victim);
+        if (task != NULL)
+          return task;
+      }
+      continue;
+    }
+
+    Task *task = task_deque_steal(&victim->local_queue);
+    if (task == NULL)
+      continue;
+    // 转入窃取者本地队列的任务继续占用名额，只归还马上执行的这一个
+    credits_release(pool, 1);
+
+    // 再窃取最多一半，放入自己的本地队列，减少后续窃取次数；
+    // 不超过本地队列的剩余空间，保证 push 一定成功
+    size_t extra = available / 2;
+    size_t space = thief->local_queue.capacity -
+                   task_deque_size(&thief->local_queue);
+    if (extra > space)
+      extra = space;
+
+    size_t stolen = 1;
+    while (stolen <= extra) {
+      Task *more = task_deque_steal(&victim->local_queue);
+      if (more == NULL)
+        break;
+      task_deque_push(&thief->local_queue, more);
+      stolen++;
+    }
+
+    WINTERQ_LOG_DEBUG("Thread %d stole %zu tasks from thread %d\n",
+                      thief->thread_id, stolen, victim->thread_id);
+    return task;
+  }
+
+  return NULL;
+}
+
+/**
+ * @brief 结束一个不再执行的任务
+ *
+ * 设置了完成队列或 completion 的任务以 status 快速失败，否则直接丢弃；
+ * 同时放出同一个排序通道和任务图中的后续任务
+ * @param pool 线程池
+ * @param task 任务
+ * @param status 结束状态
+ */
+static void finish_unexecuted_task(ThreadPool *pool, Task *task,
+                                   TaskStatus status) {
+  TaskResult result = {.task_id = task->task_id, .status = status};
+  void (*completion)(const TaskResult *, void *) = task->completion;
+  void *callback_arg = task->callback_arg;
+  KeyLane *lane = task->lane;
+  Tenant *tenant = task->tenant;
+  TaskGraphNode *node = task->node;
+  TaskHandle *handle = task->handle;
+  CompletionQueue *cq = task->cq;
+  FlightEntry *flight = task->flight;
+  TaskCompletion record = {.result = result,
+                           .user_data = callback_arg,
+                           .enqueue_time = task->enqueue_time,
+                           .end_time = winterq_clock_hrtime()};
+  task->node = NULL;
+  task->handle = NULL;
+  task->cq = NULL;
+  task->flight = NULL;
+  free_task(task);
+
+  if (cq != NULL)
+    completion_queue_post(cq, &record);
+  else if (completion)
+    completion(&result, callback_arg);
+  if (flight != NULL)
+    flight_finish(flight, &result);
+  if (lane != NULL)
+    lane_release(pool, lane);
+  if (tenant != NULL)
+    tenant_release(pool, tenant);
+  if (node != NULL)
+    graph_node_finish(pool, node, status);
+  if (handle != NULL)
+    task_handle_finish(handle, &result);
+}
+
+/**
+ * @brief 丢弃出队时已超过截止时间的任务，以 TASK_STATUS_EXPIRED 结束
+ * @param pool 线程池
+ * @param task 过期的任务
+ */
+static void shed_task(ThreadPool *pool, Task *task) {
+  atomic_fetch_add(&pool->shed_tasks, 1);
+  WINTERQ_LOG_DEBUG("Task %d shed: deadline passed before execution\n",
+                    task->task_id);
+  finish_unexecuted_task(pool, task, TASK_STATUS_EXPIRED);
+}
+
+/**
+ * @brief 丢弃出队时已被取消的任务，以 TASK_STATUS_CANCELLED 结束
+ * @param pool 线程池
+ * @param task 被取消的任务
+ */
+static void cancel_task(ThreadPool *pool, Task *task) {
+  atomic_fetch_add(&pool->cancelled_tasks, 1);
+  WINTERQ_LOG_DEBUG("Task %d cancelled before execution\n", task->task_id);
+  finish_unexecuted_task(pool, task, TASK_STATUS_CANCELLED);
+}
+
+/**
+ * @brief 执行任务
+ * @param thread_data 执行任务的线程
+ * @param task 要执行的任务
+ *
+ * 任务在同步执行期间可能已经完成并被释放，调用后不能再访问 task
+ */
+static void execute_task(ThreadData *thread_data, Task *task) {
+  WINTERQ_LOG_DEBUG("--------execute_task----------\n");
+  if (thread_data == NULL || task == NULL)
+    return;
+
+  int task_id = task->task_id;
+  int ret;
+
+  // 先登记执行线程再检查取消标志，与 task_handle_cancel 配对：
+  // 要么这里看到取消不再执行，要么取消方看到线程并唤醒它释放上下文
+  TaskHandle *handle = task->handle;
+  if (handle != NULL) {
+    atomic_store(&handle->thread_data, thread_data);
+    if (atomic_load(&handle->cancel)) {
+      cancel_task(thread_data->pool, task);
+      return;
+    }
+    atomic_store(&handle->state, TASK_HANDLE_RUNNING);
+  }
+
+  if (task->affine) {
+    if (task->affinity_thread == thread_data->thread_id)
+      COUNTER_ADD(&thread_data->affinity_hits, 1);
+    else
+      COUNTER_ADD(&thread_data->affinity_misses, 1);
+  }
+
+  // 记录开始时间
+  TaskCompletionState *taskState =
+      (TaskCompletionState *)calloc(1, sizeof(TaskCompletionState));
+  if (taskState == NULL) {
+    WINTERQ_LOG_ERROR("Failed to allocate memory for task state\n");
+    finish_unexecuted_task(thread_data->pool, task, TASK_STATUS_FAILED);
+    return;
+  }
+  taskState->task = task;
+  taskState->start_time = winterq_clock_hrtime();
+  taskState->thread_data = thread_data;
+
+  // 任务图节点的输入为依赖的输出，输出保存在节点中；
+  // 带句柄的任务通过 io 把取消标志传给运行时；其他任务的输出交给完成函数
+  WorkerTaskIO *io = task->node != NULL ? &task->node->io
+                     : handle != NULL   ? &handle->io
+                                        : &taskState->own_io;
+  io->payload = task->payload;
+  taskState->io = io;
+
+  // 脚本和字节码在任务完成时随任务一起释放
+  if (task->is_script) {
+    // 执行JavaScript脚本
+    ret = Worker_Eval_JS_IO(thread_data->runtime, task->script, io,
+                            task_completion_callback, taskState);
+  } else { // 执行JavaScript字节码
+    ret = Worker_Eval_Bytecode_IO(thread_data->runtime, task->bytecode,
+                                  task->bytecode_len, io,
+                                  task_completion_callback, taskState);
+  }
+
+  // 未能创建上下文时回调不会被调用，由这里完成清理
+  if (ret < 0) {
+    WINTERQ_LOG_ERROR("Task %d could not be started\n", task_id);
+    taskState->status = TASK_STATUS_FAILED;
+    task_completion_callback(taskState);
+    return;
+  }
+
+  WINTERQ_LOG_DEBUG("Task %d executed synchronous successfully.\n", task_id);
+}
+
+/**
+ * @brief 按 本地队列 > 收件箱 > 全局队列 > 工作窃取 的顺序获取任务
+ *
+ * 每 WORKER_GLOBAL_CHECK_INTERVAL 次先检查全局队列，避免本地任务持续产生时饿死全局任务
+ * @param thread_data 当前线程
+ * @return 任务指针，没有可执行的任务时返回NULL
+ */
+static Task *fetch_task(ThreadData *thread_data) {
+  static __thread unsigned int fetch_tick = 0;
+  ThreadPool *pool = thread_data->pool;
+  Task *task = NULL;
+
+  if (++fetch_tick % WORKER_GLOBAL_CHECK_INTERVAL == 0)
+    task = global_dequeue(pool, thread_data);
+  if (task == NULL)
+    task = local_dequeue(pool, thread_data);
+  if (task == NULL)
+    task = task_ring_dequeue(&thread_data->inbox);
+  // 亲和队列只有普通优先级的任务，全局队列中的高优先级任务先于它们执行
+  if (task == NULL && pool->config.affinity_routing &&
+      task_ring_size(&pool->queues[TASK_PRIORITY_HIGH]) > 0)
+    task = global_dequeue(pool, thread_data);
+  if (task == NULL)
+    task = affinity_dequeue(pool, thread_data);
+  if (task == NULL)
+    task = global_dequeue(pool, thread_data);
+  if (task == NULL && pool->config.enable_work_stealing)
+    task = steal_task(thread_data);
+  return task;
+}
+
+/**
+ * @brief 自旋预算上限
+ * @param pool 线程池
+ * @return 上限(纳秒)
+ */
+static uint64_t worker_spin_limit(ThreadPool *pool) {
+  int us = pool->config.idle_spin_us > 0 ? pool->config.idle_spin_us
+                                         : WORKER_SPIN_DEFAULT_US;
+  return (uint64_t)us * 1000;
+}
+
+/**
+ * @brief 线程等到了下一个任务：按所处的等待阶段计数，并根据到达间隔调整自旋预算
+ *
+ * 间隔的指数平均在预算上限以内时，自旋到平均间隔的两倍，大多数任务能在自旋时等到；
+ * 超过上限时自旋更久也等不到，只保留上限的 1/16 用于接住突发的任务
+ * @param thread_data 当前线程
+ */
+static void worker_note_arrival(ThreadData *thread_data) {
+  uint64_t gap = winterq_clock_hrtime() - thread_data->idle_since;
+  thread_data->idle_since = 0;
+  COUNTER_ADD(&thread_data->idle_hits[thread_data->idle_stage], 1);
+
+  ThreadPool *pool = thread_data->pool;
+  if (pool->config.idle_policy != WORKER_IDLE_SPIN)
+    return;
+
+  uint64_t ewma = thread_data->idle_gap_ewma;
+  thread_data->idle_gap_ewma = ewma == 0 ? gap : (ewma * 7 + gap) / 8;
+  uint64_t limit = worker_spin_limit(pool);
+  uint64_t budget = thread_data->idle_gap_ewma * 2;
+  thread_data->spin_ns = budget <= limit ? budget : limit / 16;
+}
+
+/**
+ * @brief 线程自己的队列中是否还有任务
+ * @param thread_data 当前线程
+ * @return 有任务返回true
+ */
+static bool has_pending_tasks(ThreadData *thread_data) {
+  return global_queue_size(thread_data->pool) > 0 ||
+         task_deque_size(&thread_data->local_queue) > 0 ||
+         task_ring_size(&thread_data->inbox) > 0 ||
+         task_ring_size(&thread_data->affinity_queue) > 0;
+}
+
+/**
+ * @brief 空闲后先自旋、再让出 CPU 等待新任务，省去进入事件循环再被唤醒的开销
+ *
+ * 自旋期间线程计入 spinning_workers，提交者看到有线程在自旋时不再发送唤醒；
+ * 有存活上下文的线程不自旋，它的定时器和 I/O 回调需要事件循环及时处理
+ * @param thread_data 当前线程
+ * @return 等到了任务（或线程需要退出）返回true，需要在事件循环中等待返回false
+ */
+static bool worker_idle_spin(ThreadData *thread_data) {
+  ThreadPool *pool = thread_data->pool;
+  thread_data->idle_since = winterq_clock_hrtime();
+  thread_data->idle_stage = WORKER_IDLE_STAGE_PARK;
+  if (pool->config.idle_policy != WORKER_IDLE_SPIN ||
+      thread_data->runtime->context_count > 0)
+    return false;
+
+  if (thread_data->spin_ns == 0)
+    thread_data->spin_ns = worker_spin_limit(pool);
+  uint64_t deadline = thread_data->idle_since + thread_data->spin_ns;
+  bool found = false;
+
+  atomic_fetch_add(&pool->spinning_workers, 1);
+  thread_data->idle_stage = WORKER_IDLE_STAGE_SPIN;
+  for (unsigned int i = 1;; i++) {
+    if (has_pending_tasks(thread_data) ||
+        atomic_load_explicit(&thread_data->retiring, memory_order_relaxed)) {
+      found = true;
+      break;
+    }
+    if (atomic_load_explicit(&pool->shutdown, memory_order_relaxed))
+      break;
+    CPU_RELAX();
+    if (i % WORKER_SPIN_CHECK_INTERVAL == 0 &&
+        winterq_clock_hrtime() >= deadline)
+      break;
+  }
+
+  if (!found && !atomic_load(&pool->shutdown)) {
+    thread_data->idle_stage = WORKER_IDLE_STAGE_YIELD;
+    for (int i = 0; i < WORKER_IDLE_YIELDS && !found; i++) {
+      sched_yield();
+      found = has_pending_tasks(thread_data);
+    }
+  }
+  atomic_fetch_sub(&pool->spinning_workers, 1);
+  return found;
+}
+
+/**
+ * @brief 停止工作线程的事件循环
+ *
+ * 先清空 wakeup 并等待正在发送唤醒的线程完成，之后句柄随运行时一起释放
+ * @param thread_data 当前线程
+ * @param handle 唤醒句柄
+ */
+static void worker_stop_loop(ThreadData *thread_data, uv_async_t *handle) {
+  atomic_store(&thread_data->sleeping, false);
+  atomic_store(&thread_data->wakeup, NULL);
+  while (atomic_load(&thread_data->wakers) > 0)
+    sched_yield();
+
+  uv_close((uv_handle_t *)handle, NULL);
+  uv_stop(thread_data->runtime->loop);
+}
+
+/**
+ * @brief 缩容时退出工作线程
+ *
+ * 还没开始执行的任务交给全局队列由其他线程执行；已经开始执行的上下文
+ * （定时器、Promise 等）绑定在本线程的运行时上，无法迁移，等它们结束后再退出
+ * @param thread_data 当前线程
+ * @param handle 唤醒句柄
+ */
+static void worker_retire(ThreadData *thread_data, uv_async_t *handle) {
+  atomic_store(&thread_data->sleeping, false);
+  migrate_thread_tasks(thread_data->pool, thread_data);
+
+  if (thread_data->runtime->context_count > 0) {
+    // 上下文结束时 task_completion_callback 会再次唤醒本线程
+    thread_data->throttled = true;
+    return;
+  }
+
+  // 与扩容重新启用本线程互斥：确认仍在退出中才停止事件循环
+  ThreadPool *pool = thread_data->pool;
+  pthread_mutex_lock(&pool->pool_mutex);
+  bool exiting = atomic_load(&thread_data->retiring);
+  thread_data->exiting = exiting;
+  pthread_mutex_unlock(&pool->pool_mutex);
+  if (!exiting)
+    return; // 已被重新启用，resize_thread_pool 会再唤醒一次
+
+  WINTERQ_LOG_INFO("Worker thread %d retired\n", thread_data->thread_id);
+  worker_stop_loop(thread_data, handle);
+}
+
+/**
+ * @brief 唤醒回调，在工作线程的事件循环中执行
+ *
+ * 每次最多连续执行 WORKER_BATCH_SIZE 个任务，然后让出事件循环；
+ * 没有任务时标记为 sleeping 并阻塞在事件循环中，与定时器和 I/O 共用同一个等待点
+ */
+static void worker_wakeup_callback(uv_async_t *handle) {
+  ThreadData *thread_data = (ThreadData *)handle->data;
+  ThreadPool *pool = thread_data->pool;
+  WorkerRuntime *wrt = thread_data->runtime;
+
+  // 线程池关闭
+  if (atomic_load(&pool->shutdown)) {
+    worker_stop_loop(thread_data, handle);
+    return;
+  }
+
+  // 释放执行中被取消的任务的上下文
+  if (atomic_exchange(&thread_data->reap_cancelled, false))
+    Worker_ReapCancelledContexts(wrt);
+
+  // 线程被缩容移除
+  if (atomic_load(&thread_data->retiring)) {
+    worker_retire(thread_data, handle);
+    return;
+  }
+
+  atomic_store(&thread_data->sleeping, false);
+  thread_data->draining = true;
+  // 缩容后被重新启用的线程可能还留着 worker_retire 设置的标志，取任务时会重新判断
+  thread_data->throttled = false;
+
+  int processed = 0;
+  for (;;) {
+    while (processed < WORKER_BATCH_SIZE &&
+           !atomic_load(&thread_data->retiring)) {
+      // 上下文数达到上限时暂停取任务，等某个上下文释放后再继续
+      if (wrt->context_count >= wrt->max_contexts) {
+        thread_data->throttled = true;
+        break;
+      }
+
+      // 先标记忙碌再取任务，避免 wait_for_idle 在任务出队后、执行前误判为空闲
+      mark_thread_busy(thread_data);
+      Task *task = fetch_task(thread_data);
+      if (task == NULL)
+        break;
+      if (thread_data->idle_since != 0)
+        worker_note_arrival(thread_data);
+
+      // 已经赶不上截止时间的任务不再执行
+      if (task->deadline != 0 && winterq_clock_hrtime() > task->deadline) {
+        shed_task(pool, task);
+        processed++;
+        continue;
+      }
+
+      execute_task(thread_data, task);
+      COUNTER_ADD(&thread_data->tasks_processed, 1);
+      processed++;
+    }
+
+    thread_data->draining = false;
+
+    if (thread_data->throttled)
+      return;
+
+    if (processed == WORKER_BATCH_SIZE || atomic_load(&thread_data->retiring)) {
+      // 可能还有任务，先处理定时器和 I/O 再继续
+      uv_async_send(handle);
+      return;
+    }
+
+    mark_thread_idle(thread_data);
+
+    // 自旋等到了新任务时直接继续执行，不经过事件循环
+    if (!worker_idle_spin(thread_data))
+      break;
+    thread_data->draining = true;
+  }
+
+  // 先声明进入等待再检查一次队列，避免与提交任务的线程竞争导致任务滞留
+  thread_data->idle_stage = WORKER_IDLE_STAGE_PARK;
+  atomic_store(&thread_data->sleeping, true);
+  atomic_thread_fence(memory_order_seq_cst);
+  if (has_pending_tasks(thread_data))
+    uv_async_send(handle);
+}
+
+/**
+ * @brief 唤醒最多 n 个在事件循环中等待的工作线程
+ * @param pool 线程池
+ * @param n 要唤醒的线程数
+ * @param skip_spinning 是否把正在自旋的线程算作已唤醒：自旋时只检查全局队列和
+ *        自己的队列，只有任务进入全局队列时才能这样计算
+ */
+static void wake_sleeping_workers(ThreadPool *pool, size_t n,
+                                  bool skip_spinning) {
+  static atomic_uint next_worker = 0;
+  int count = pool->thread_count;
+  if (count <= 0 || n == 0)
+    return;
+
+  // 与工作线程进入等待前的 sleeping/队列检查配对，保证入队对其可见
+  atomic_thread_fence(memory_order_seq_cst);
+
+  // 正在自旋的线程会自己发现全局队列中的新任务，不需要唤醒
+  int spinning = skip_spinning ? atomic_load(&pool->spinning_workers) : 0;
+  if (spinning > 0) {
+    if ((size_t)spinning >= n)
+      return;
+    n -= (size_t)spinning;
+  }
+
+  // 轮转起点，避免总是唤醒同一个线程
+  unsigned int start = atomic_fetch_add(&next_worker, 1);
+  for (int i = 0; i < count; i++) {
+    ThreadData *thread_data = pool->thread_data[(start + i) % count];
+    bool expected = true;
+    if (atomic_compare_exchange_strong(&thread_data->sleeping, &expected,
+                                       false)) {
+      worker_send_wakeup(thread_data);
+      if (--n == 0)
+        return;
+    }
+  }
+  // 没有足够的等待中的线程：忙碌的线程在执行完当前批次后会继续取任务
+}
+
+/**
+ * @brief 任务进入全局队列后唤醒最多 n 个在事件循环中等待的工作线程
+ * @param pool 线程池
+ * @param n 要唤醒的线程数
+ */
+static void wake_idle_workers(ThreadPool *pool, size_t n) {
+  wake_sleeping_workers(pool, n, true);
+}
+
+/**
+ * @brief 任务进入全局队列后唤醒一个在事件循环中等待的工作线程
+ * @param pool 线程池
+ */
+static void wake_idle_worker(ThreadPool *pool) { wake_idle_workers(pool, 1); }
+
+/**
+ * @brief 任务进入某个线程的本地队列或亲和队列后，唤醒一个等待中的线程来窃取
+ * @param pool 线程池
+ */
+static void wake_stealer(ThreadPool *pool) {
+  wake_sleeping_workers(pool, 1, false);
+}
+
+/**
+ * @brief 唤醒指定的工作线程（如果它正在等待）
+ * @param thread_data 目标线程
+ */
+static void wake_worker(ThreadData *thread_data) {
+  atomic_thread_fence(memory_order_seq_cst);
+  bool expected = true;
+  if (atomic_compare_exchange_strong(&thread_data->sleeping, &expected,
+                                     false)) {
+    worker_send_wakeup(thread_data);
+  }
+}
+
+/**
+ * @brief 向工作线程的事件循环发送唤醒，线程已退出时忽略
+ *
+ * 与 worker_stop_loop 配对：登记后再读取 wakeup，线程退出前会等待登记清零
+ * @param thread_data 目标线程
+ */
+static void worker_send_wakeup(ThreadData *thread_data) {
+  atomic_fetch_add(&thread_data->wakers, 1);
+  uv_async_t *wakeup = atomic_load(&thread_data->wakeup);
+  if (wakeup != NULL)
+    uv_async_send(wakeup);
+  atomic_fetch_sub(&thread_data->wakers, 1);
+}
+
+// 线程工作函数
+static void *worker_thread(void *arg) {
+  WINTERQ_LOG_DEBUG("--------worker_thread----------\n");
+  ThreadData *thread_data = (ThreadData *)arg;
+  ThreadPool *pool = thread_data->pool;
+  int thread_id = thread_data->thread_id;
+
+  WorkerRuntime *wrt = Worker_NewRuntime(thread_data->max_contexts);
+  if (wrt == NULL) {
+    WINTERQ_LOG_ERROR("Failed to create worker runtime for thread %d\n",
+                      thread_id);
+    atomic_store(&thread_data->exited, true);
+    return NULL;
+  }
+
+  thread_data->runtime = wrt;
+  current_worker = thread_data;
+  steal_rng_state =
+      ((uint32_t)thread_id + 1) * 2654435761u ^ (uint32_t)winterq_clock_hrtime();
+  if (steal_rng_state == 0)
+    steal_rng_state = 1;
+  if (pool->config.performance_observer != NULL)
+    Worker_SetPerformanceObserver(wrt, task_performance_observer, pool);
+
+  uv_async_t *wakeup = (uv_async_t *)calloc(1, sizeof(uv_async_t));
+  if (wakeup == NULL ||
+      uv_async_init(wrt->loop, wakeup, worker_wakeup_callback) != 0) {
+    WINTERQ_LOG_ERROR("Failed to create wakeup handle for thread %d\n",
+                      thread_id);
+    free(wakeup);
+    Worker_FreeRuntime(wrt);
+    thread_data->runtime = NULL;
+    atomic_store(&thread_data->exited, true);
+    return NULL;
+  }
+  wakeup->data = thread_data;
+
+  // 线程开始时为空闲状态
+  atomic_store(&thread_data->idle, true);
+  atomic_fetch_add(&pool->idle_thread_count, 1);
+  thread_data->idle_start = winterq_clock_coarse_ms();
+
+  // 发布唤醒句柄后先主动唤醒一次，处理启动前已入队的任务
+  atomic_store(&thread_data->wakeup, wakeup);
+  uv_async_send(wakeup);
+
+  WINTERQ_LOG_INFO("Worker thread %d started\n", thread_id);
+
+  // 阻塞在事件循环中，直到关闭时被 uv_stop
+  Worker_RunLoop(wrt);
+
+  // 线程退出前清理
+  WINTERQ_LOG_INFO("Worker thread %d exiting\n", thread_id);
+
+  // 释放运行时资源，唤醒句柄已在 worker_stop_loop 中关闭
+  Worker_FreeRuntime(thread_data->runtime);
+  thread_data->runtime = NULL;
+  free(wakeup);
+
+  // 计算最终的空闲/忙碌时间
+  if (atomic_load(&thread_data->idle)) {
+    uint64_t idle_time = winterq_clock_coarse_ms() - thread_data->idle_start;
+    atomic_fetch_add(&thread_data->idle_time, idle_time);
+    atomic_fetch_sub(&pool->idle_thread_count, 1);
+  } else {
+    uint64_t busy_time = winterq_clock_coarse_ms() - thread_data->idle_start;
+    atomic_fetch_add(&thread_data->busy_time, busy_time);
+  }
+
+  atomic_store(&thread_data->exited, true);
+  return NULL;
+}
+
+/**
+ * @brief 汇总所有线程槽位（包括已缩容退出的）的计数器，不加锁
+ * @param pool 线程池
+ * @return 汇总结果
+ */
+static PoolCounters sum_thread_counters(ThreadPool *pool) {
+  PoolCounters counters = {0};
+  for (int i = 0; i < pool->max_threads; i++) {
+    ThreadData *thread_data = pool->thread_data[i];
+    if (thread_data == NULL)
+      continue;
+    counters.completed += atomic_load_explicit(&thread_data->tasks_completed,
+                                               memory_order_relaxed);
+    counters.exec_time +=
+        atomic_load_explicit(&thread_data->exec_time, memory_order_relaxed);
+    counters.idle_time +=
+        atomic_load_explicit(&thread_data->idle_time, memory_order_relaxed);
+    counters.busy_time +=
+        atomic_load_explicit(&thread_data->busy_time, memory_order_relaxed);
+    counters.affinity_hits += atomic_load_explicit(
+        &thread_data->affinity_hits, memory_order_relaxed);
+    counters.affinity_misses += atomic_load_explicit(
+        &thread_data->affinity_misses, memory_order_relaxed);
+    for (int k = 0; k <= WORKER_IDLE_STAGE_PARK; k++)
+      counters.idle_hits[k] += atomic_load_explicit(&thread_data->idle_hits[k],
+                                                    memory_order_relaxed);
+    for (int k = 0; k < TASK_PRIORITY_COUNT; k++) {
+      counters.dequeued[k] += atomic_load_explicit(&thread_data->dequeued[k],
+                                                   memory_order_relaxed);
+      counters.wait_ns[k] += atomic_load_explicit(&thread_data->wait_ns[k],
+                                                  memory_order_relaxed);
+    }
+  }
+  return counters;
+}
+
+/**
+ * @brief 线程池大小调整线程, Dynamically adjusts pool size based on measured
+ * queue wait time and thread utilization.
+ *
+ * 每个采样周期计算这段时间内出队任务的平均排队等待时间和线程利用率：
+ * - 等待时间超过目标且线程基本都在忙，连续 POOL_GROW_TICKS 个周期后扩容
+ * - 等待时间低于目标的一半且利用率很低，连续 POOL_SHRINK_TICKS 个周期后缩容一个线程
+ * 两个方向的阈值和连续周期数不同（滞回），调整后冷却若干周期，避免来回抖动
+ * @param arg 线程池 (ThreadPool*)
+ * @return NULL
+ */
+static void *pool_adjuster_thread(void *arg) {
+  WINTERQ_LOG_DEBUG("--------pool_adjuster_thread----------\n");
+  ThreadPool *pool = (ThreadPool *)arg;
+  if (pool == NULL)
+    return NULL;
+
+  WINTERQ_LOG_INFO("Pool adjuster thread started\n");
+
+  int interval_ms = pool->config.adjust_interval_ms > 0
+                        ? pool->config.adjust_interval_ms
+                        : POOL_ADJUST_INTERVAL_MS;
+  double target_ms = pool->config.target_wait_ms > 0
+                         ? pool->config.target_wait_ms
+                         : POOL_TARGET_WAIT_MS;
+  int min_threads = pool->config.min_threads > 0 ? pool->config.min_threads : 1;
+
+  uint64_t last_dequeued = 0;
+  uint64_t last_wait_ns = 0;
+  double utilization = 0.0;
+  int grow_ticks = 0;
+  int shrink_ticks = 0;
+  int cooldown = 0;
+
+  while (atomic_load(&pool->adjuster_running)) {
+    // 休眠一个采样周期，关闭时被提前唤醒
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += interval_ms / 1000;
+    ts.tv_nsec += (long)(interval_ms % 1000) * 1000000;
+    if (ts.tv_nsec >= 1000000000) {
+      ts.tv_sec += 1;
+      ts.tv_nsec -= 1000000000;
+    }
+    pthread_mutex_lock(&pool->idle_mutex);
+    while (atomic_load(&pool->adjuster_running) &&
+           pthread_cond_timedwait(&pool->idle_cond, &pool->idle_mutex, &ts) !=
+               ETIMEDOUT) {
+    }
+    pthread_mutex_unlock(&pool->idle_mutex);
+
+    if (!atomic_load(&pool->adjuster_running))
+      break;
+
+    // 本周期出队任务的平均排队等待时间
+    uint64_t dequeued = 0;
+    uint64_t wait_ns = 0;
+    PoolCounters counters = sum_thread_counters(pool);
+    for (int i = 0; i < TASK_PRIORITY_COUNT; i++) {
+      dequeued += counters.dequeued[i];
+      wait_ns += counters.wait_ns[i];
+    }
+    size_t queued = global_queue_size(pool);
+    double wait_ms = 0.0;
+    if (dequeued > last_dequeued) {
+      wait_ms = (double)(wait_ns - last_wait_ns) / (dequeued - last_dequeued) /
+                1e6;
+    } else if (queued > 0) {
+      wait_ms = interval_ms; // 有任务排队但整个周期都没有出队
+    }
+    last_dequeued = dequeued;
+    last_wait_ns = wait_ns;
+
+    // 利用率取指数平滑，过滤单次采样的抖动
+    int total_count = pool->thread_count;
+    int idle_count = atomic_load(&pool->idle_thread_count);
+    double sample = total_count > 0
+                        ? (double)(total_count - idle_count) / total_count
+                        : 0.0;
+    utilization = 0.5 * utilization + 0.5 * sample;
+
+    if (wait_ms > target_ms && utilization >= POOL_GROW_UTILIZATION) {
+      grow_ticks++;
+      shrink_ticks = 0;
+    } else if (wait_ms < target_ms / 2 &&
+               utilization <= POOL_SHRINK_UTILIZATION) {
+      shrink_ticks++;
+      grow_ticks = 0;
+    } else {
+      grow_ticks = 0;
+      shrink_ticks = 0;
+    }
+
+    if (cooldown > 0) {
+      cooldown--;
+      continue;
+    }
+
+    if (grow_ticks >= POOL_GROW_TICKS && total_count < pool->max_threads) {
+      // 按比例扩容，排队严重时更快追上负载
+      int step = total_count / 4 > 1 ? total_count / 4 : 1;
+      int target = total_count + step;
+      if (target > pool->max_threads)
+        target = pool->max_threads;
+      WINTERQ_LOG_INFO("Queue wait %.2fms, utilization %.0f%%: growing pool "
+                       "from %d to %d\n",
+                       wait_ms, utilization * 100, total_count, target);
+      resize_thread_pool(pool, target);
+      grow_ticks = 0;
+      cooldown = POOL_RESIZE_COOLDOWN_TICKS;
+    } else if (shrink_ticks >= POOL_SHRINK_TICKS && total_count > min_threads) {
+      WINTERQ_LOG_INFO("Queue wait %.2fms, utilization %.0f%%: shrinking pool "
+                       "from %d to %d\n",
+                       wait_ms, utilization * 100, total_count,
+                       total_count - 1);
+      resize_thread_pool(pool, total_count - 1);
+      shrink_ticks = 0;
+      cooldown = POOL_RESIZE_COOLDOWN_TICKS;
+    }
+  }
+
+  WINTERQ_LOG_INFO("Pool adjuster thread exiting\n");
+  return NULL;
+}
+
+/**
+ * @brief 读取 /sys 或 /proc 下的小文件
+ * @param path 文件路径
+ * @param buf 缓冲区
+ * @param size 缓冲区大小
+ * @return 成功返回0，文件不存在或为空返回-1
+ */
+static int read_small_file(const char *path, char *buf, size_t size) {
+  FILE *fp = fopen(path, "r");
+  if (fp == NULL)
+    return -1;
+  size_t n = fread(buf, 1, size - 1, fp);
+  fclose(fp);
+  buf[n] = '\0';
+  return n > 0 ? 0 : -1;
+}
+
+/**
+ * @brief 读取 cgroup 的 CPU 配额（v2 的 cpu.max 或 v1 的 cfs_quota_us）
+ * @return 向上取整的 CPU 数，没有限制时返回0
+ */
+static int cgroup_cpu_limit(void) {
+  char buf[128];
+  long long quota = -1;
+  long long period = 0;
+
+  if (read_small_file("/sys/fs/cgroup/cpu.max", buf, sizeof(buf)) == 0) {
+    // 格式为 "$MAX $PERIOD"，不限制时 $MAX 为 "max"
+    if (strncmp(buf, "max", 3) != 0 &&
+        sscanf(buf, "%lld %lld", &quota, &period) != 2)
+      return 0;
+  } else if (read_small_file("/sys/fs/cgroup/cpu/cpu.cfs_quota_us", buf,
+                             sizeof(buf)) == 0) {
+    quota = atoll(buf); // 不限制时为 -1
+    if (read_small_file("/sys/fs/cgroup/cpu/cpu.cfs_period_us", buf,
+                        sizeof(buf)) == 0)
+      period = atoll(buf);
+  }
+
+  if (quota <= 0 || period <= 0)
+    return 0;
+  return (int)((quota + period - 1) / period);
+}
+
+int thread_pool_default_size(void) {
+  int cpus = 0;
+#ifdef __linux__
+  cpu_set_t allowed;
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+    cpus = CPU_COUNT(&allowed);
+#endif
+  if (cpus <= 0) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    cpus = online > 0 ? (int)online : 1;
+  }
+
+  int limit = cgroup_cpu_limit();
+  if (limit > 0 && limit < cpus)
+    cpus = limit;
+  return cpus;
+}
+
+#ifdef __linux__
+/**
+ * @brief 解析 cpulist 格式的 CPU 列表，例如 "0-3,8,10-11"
+ * @param text cpulist 字符串
+ * @param set 输出的 CPU 集合
+ */
+static void parse_cpu_list(const char *text, cpu_set_t *set) {
+  const char *p = text;
+  while (*p != '\0' && *p != '\n') {
+    char *end;
+    long first = strtol(p, &end, 10);
+    if (end == p)
+      break;
+    long last = first;
+    if (*end == '-') {
+      p = end + 1;
+      last = strtol(p, &end, 10);
+      if (end == p)
+        break;
+    }
+    for (long cpu = first < 0 ? 0 : first; cpu <= last && cpu < CPU_SETSIZE;
+         cpu++)
+      CPU_SET((int)cpu, set);
+    p = *end == ',' ? end + 1 : end;
+  }
+}
+
+/**
+ * @brief 读取每个 CPU 所属的 NUMA 节点，没有 NUMA 信息时都视为节点 0
+ * @param node_of 输出，长度为 CPU_SETSIZE
+ * @return NUMA 节点数
+ */
+static int read_numa_topology(int *node_of) {
+  int node_count = 1;
+  memset(node_of, 0, CPU_SETSIZE * sizeof(int));
+
+  for (int node = 0; node < THREADPOOL_MAX_NUMA_NODES; node++) {
+    char path[64];
+    char buf[1024];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist",
+             node);
+    if (read_small_file(path, buf, sizeof(buf)) != 0)
+      continue; // 节点编号可能不连续
+
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    parse_cpu_list(buf, &cpus);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+      if (CPU_ISSET(cpu, &cpus))
+        node_of[cpu] = node;
+    }
+    if (node + 1 > node_count)
+      node_count = node + 1;
+  }
+  return node_count;
+}
+#endif
+
+/**
+ * @brief 按配置的绑核方式计算工作线程的放置顺序
+ *
+ * 只考虑当前进程允许使用的 CPU（taskset、cpuset cgroup）
+ * @param pool 线程池
+ * @return 成功返回0，失败返回-1
+ */
+static int init_cpu_placement(ThreadPool *pool) {
+  CpuPlacement *placement = &pool->placement;
+  memset(placement, 0, sizeof(CpuPlacement));
+  placement->node_count = 1;
+
+  ThreadAffinity mode = pool->config.affinity;
+  if (mode == THREAD_AFFINITY_NONE)
+    return 0;
+
+#ifdef __linux__
+  cpu_set_t allowed;
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+    WINTERQ_LOG_WARNING("Failed to read CPU affinity, workers are not pinned\n");
+    return 0;
+  }
+
+  int *node_of = (int *)malloc(CPU_SETSIZE * sizeof(int));
+  if (node_of == NULL)
+    return -1;
+  int node_count = read_numa_topology(node_of);
+
+  int count = mode == THREAD_AFFINITY_LIST ? pool->config.cpu_list_len
+                                           : CPU_COUNT(&allowed);
+  if (count <= 0) {
+    WINTERQ_LOG_ERROR("No CPU available for thread affinity\n");
+    free(node_of);
+    return -1;
+  }
+
+  placement->cpus = (int *)malloc(count * sizeof(int));
+  placement->nodes = (int *)malloc(count * sizeof(int));
+  if (placement->cpus == NULL || placement->nodes == NULL) {
+    free(placement->cpus);
+    free(placement->nodes);
+    free(node_of);
+    return -1;
+  }
+
+  int n = 0;
+  if (mode == THREAD_AFFINITY_LIST) {
+    for (int i = 0; i < count; i++) {
+      int cpu = pool->config.cpu_list[i];
+      if (cpu < 0 || cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &allowed)) {
+        WINTERQ_LOG_ERROR("CPU %d is not available for thread affinity\n",
+                          cpu);
+        free(placement->cpus);
+        free(placement->nodes);
+        free(node_of);
+        return -1;
+      }
+      placement->cpus[n++] = cpu;
+    }
+  } else {
+    // 先按节点排列（compact），scatter 再从每个节点轮流取一个
+    int *compact = (int *)malloc(count * sizeof(int));
+    int *node_start = (int *)calloc(node_count + 1, sizeof(int));
+    if (compact == NULL || node_start == NULL) {
+      free(compact);
+      free(node_start);
+      free(placement->cpus);
+      free(placement->nodes);
+      free(node_of);
+      return -1;
+    }
+    int k = 0;
+    for (int node = 0; node < node_count; node++) {
+      node_start[node] = k;
+      for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed) && node_of[cpu] == node)
+          compact[k++] = cpu;
+      }
+    }
+    node_start[node_count] = k;
+
+    if (mode == THREAD_AFFINITY_SCATTER) {
+      for (int round = 0; n < count; round++) {
+        for (int node = 0; node < node_count; node++) {
+          if (node_start[node] + round < node_start[node + 1])
+            placement->cpus[n++] = compact[node_start[node] + round];
+        }
+      }
+    } else {
+      memcpy(placement->cpus, compact, count * sizeof(int));
+      n = count;
+    }
+    free(compact);
+    free(node_start);
+  }
+
+  for (int i = 0; i < n; i++)
+    placement->nodes[i] = node_of[placement->cpus[i]];
+  placement->count = n;
+  placement->node_count = node_count;
+  free(node_of);
+
+  WINTERQ_LOG_INFO("Pinning workers to %d CPUs on %d NUMA nodes\n", n,
+                   node_count);
+  return 0;
+#else
+  WINTERQ_LOG_WARNING("Thread affinity is not supported on this platform\n");
+  return 0;
+#endif
+}
+
+/**
+ * @brief 释放放置顺序
+ * @param pool 线程池
+ */
+static void destroy_cpu_placement(ThreadPool *pool) {
+  free(pool->placement.cpus);
+  free(pool->placement.nodes);
+  memset(&pool->placement, 0, sizeof(CpuPlacement));
+}
+
+/**
+ * @brief 释放线程槽位及其队列中剩余的任务，只在线程池关闭时调用
+ * @param thread_data 线程数据
+ */
+static void destroy_thread_slot(ThreadData *thread_data) {
+  destroy_task_deque(&thread_data->local_queue);
+  destroy_task_ring(&thread_data->inbox);
+  destroy_task_ring(&thread_data->affinity_queue);
+  free(thread_data);
+}
+
+/**
+ * @brief 创建工作线程
+ *
+ * 槽位第一次使用时分配线程数据和队列，之后缩容再扩容时复用，地址保持不变
+ * @param pool 线程池
+ * @param thread_id 线程ID
+ * @return 成功返回0，失败返回-1
+ */
+static int create_worker_thread(ThreadPool *pool, int thread_id) {
+  WINTERQ_LOG_DEBUG("--------create_worker_thread----------\n");
+  if (pool == NULL || thread_id < 0 || thread_id >= pool->max_threads)
+    return -1;
+
+  ThreadData *thread_data = pool->thread_data[thread_id];
+  bool fresh = thread_data == NULL;
+  if (fresh) {
+    // 按缓存行对齐，避免与其他线程的槽位共享缓存行
+    thread_data = (ThreadData *)aligned_alloc(THREADPOOL_CACHE_LINE,
+                                              sizeof(ThreadData));
+    if (thread_data == NULL) {
+      WINTERQ_LOG_ERROR("Failed to allocate memory for thread data\n");
+      return -1;
+    }
+    memset(thread_data, 0, sizeof(ThreadData));
+
+    // 初始化线程本地队列、收件箱和亲和队列
+    size_t ring_capacity = pool->config.local_queue_size == 0
+                               ? TASK_DEQUE_DEFAULT_CAPACITY
+                               : pool->config.local_queue_size;
+    if (init_task_deque(&thread_data->local_queue,
+                        pool->config.local_queue_size) != 0) {
+      free(thread_data);
+      return -1;
+    }
+    if (init_task_ring(&thread_data->inbox, ring_capacity) != 0) {
+      destroy_task_deque(&thread_data->local_queue);
+      free(thread_data);
+      return -1;
+    }
+    if (init_task_ring(&thread_data->affinity_queue, ring_capacity) != 0) {
+      destroy_task_ring(&thread_data->inbox);
+      destroy_task_deque(&thread_data->local_queue);
+      free(thread_data);
+      return -1;
+    }
+  }
+
+  // 初始化线程数据
+  thread_data->thread_id = thread_id;
+  thread_data->pool = pool;
+  thread_data->max_contexts = pool->config.max_contexts;
+  thread_data->runtime = NULL;
+  thread_data->idle_start = 0;
+  thread_data->draining = false;
+  thread_data->throttled = false;
+  thread_data->idle_since = 0;
+  thread_data->idle_stage = WORKER_IDLE_STAGE_PARK;
+  thread_data->idle_gap_ewma = 0;
+  thread_data->spin_ns = worker_spin_limit(pool);
+  atomic_store(&thread_data->wakeup, NULL);
+  atomic_store(&thread_data->wakers, 0);
+  atomic_store(&thread_data->sleeping, false);
+  atomic_store(&thread_data->retiring, false);
+  atomic_store(&thread_data->idle, true);
+  atomic_store(&thread_data->exited, false);
+  thread_data->exiting = false;
+
+  // 线程创建时即绑定到目标 CPU，之后 Worker_NewRuntime 分配的 JS 堆
+  // 由本线程首次写入，按 first-touch 策略落在本地 NUMA 节点
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  thread_data->cpu = -1;
+  thread_data->numa_node = 0;
+  if (pool->placement.count > 0) {
+    int slot = thread_id % pool->placement.count;
+    thread_data->cpu = pool->placement.cpus[slot];
+    thread_data->numa_node = pool->placement.nodes[slot];
+#ifdef __linux__
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(thread_data->cpu, &cpus);
+    if (pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus) != 0) {
+      WINTERQ_LOG_WARNING("Failed to pin thread %d to CPU %d\n", thread_id,
+                          thread_data->cpu);
+      thread_data->cpu = -1;
+    }
+#endif
+  }
+
+  // 创建线程
+  int rc =
+      pthread_create(&thread_data->thread, &attr, worker_thread, thread_data);
+  pthread_attr_destroy(&attr);
+  if (rc != 0) {
+    WINTERQ_LOG_ERROR("Failed to create worker thread %d\n", thread_id);
+    if (fresh)
+      destroy_thread_slot(thread_data);
+    return -1;
+  }
+
+  thread_data->joinable = true;
+  pool->thread_data[thread_id] = thread_data;
+  return 0;
+}
+
+ThreadPool *init_thread_pool(ThreadPoolConfig config) {
+  WINTERQ_LOG_DEBUG("--------init_thread_pool----------\n");
+  ThreadPool *pool = NULL;
+  int i;
+
+  // 参数校验
+  if (config.thread_count < 0) {
+    WINTERQ_LOG_ERROR("Invalid thread count: %d\n", config.thread_count);
+    return NULL;
+  }
+  if (config.affinity == THREAD_AFFINITY_LIST &&
+      (config.cpu_list == NULL || config.cpu_list_len <= 0)) {
+    WINTERQ_LOG_ERROR("THREAD_AFFINITY_LIST requires a cpu_list\n");
+    return NULL;
+  }
+  if (config.affinity_routing && config.edf_scheduling) {
+    WINTERQ_LOG_ERROR("affinity_routing cannot be used with edf_scheduling\n");
+    return NULL;
+  }
+  if (config.thread_count == 0) {
+    config.thread_count = thread_pool_default_size();
+    WINTERQ_LOG_INFO("Using %d worker threads\n", config.thread_count);
+  }
+  if (config.max_threads > 0 && config.max_threads < config.thread_count) {
+    WINTERQ_LOG_ERROR("max_threads %d is less than thread_count %d\n",
+                      config.max_threads, config.thread_count);
+    return NULL;
+  }
+
+  // 分配线程池结构体
+  pool = (ThreadPool *)aligned_alloc(_Alignof(ThreadPool), sizeof(ThreadPool));
+  if (pool == NULL) {
+    WINTERQ_LOG_ERROR("Failed to allocate memory for thread pool\n");
+    return NULL;
+  }
+  memset(pool, 0, sizeof(ThreadPool));
+
+  // 初始化配置
+  pool->config = config;
+  atomic_init(&pool->thread_count, 0); // 随线程创建递增
+  atomic_init(&pool->shutdown, false);
+  if (config.max_threads > 0) {
+    pool->max_threads = config.max_threads;
+  } else {
+    pool->max_threads = 2 * thread_pool_default_size();
+    if (pool->max_threads < config.thread_count)
+      pool->max_threads = config.thread_count;
+  }
+
+  pool->max_tasks = 0;
+  atomic_init(&pool->total_tasks, 0);
+
+  atomic_init(&pool->idle_thread_count, 0);
+  atomic_init(&pool->spinning_workers, 0);
+  atomic_init(&pool->adjuster_running, false);
+  atomic_init(&pool->shed_tasks, 0);
+  atomic_init(&pool->late_tasks, 0);
+  atomic_init(&pool->cancelled_tasks, 0);
+
+  // 名额与全局队列容量一致，持有名额时入队不会失败
+  pool->queue_capacity = task_ring_capacity(config.global_queue_size);
+  atomic_init(&pool->credits, (long)pool->queue_capacity);
+  atomic_init(&pool->credit_waiters, 0);
+  atomic_init(&pool->rejected_tasks, 0);
+  atomic_init(&pool->rate_limited_tasks, 0);
+
+  atomic_init(&pool->active_lanes, 0);
+  for (i = 0; i < TASK_LANE_BUCKETS; i++)
+    pthread_mutex_init(&pool->lanes[i].mutex, NULL);
+  pthread_mutex_init(&pool->tenant_mutex, NULL);
+  atomic_init(&pool->active_flights, 0);
+  atomic_init(&pool->coalesced_tasks, 0);
+  for (i = 0; i < TASK_FLIGHT_BUCKETS; i++)
+    pthread_mutex_init(&pool->flights[i].mutex, NULL);
+  init_memo_cache(pool);
+
+  // 初始化互斥锁和条件变量
+  if (pthread_mutex_init(&pool->pool_mutex, NULL) != 0 ||
+      pthread_mutex_init(&pool->wait_mutex, NULL) != 0 ||
+      pthread_mutex_init(&pool->idle_mutex, NULL) != 0 ||
+      pthread_mutex_init(&pool->resize_mutex, NULL) != 0 ||
+      pthread_mutex_init(&pool->credit_mutex, NULL) != 0 ||
+      pthread_cond_init(&pool->wait_cond, NULL) != 0 ||
+      pthread_cond_init(&pool->idle_cond, NULL) != 0 ||
+      pthread_cond_init(&pool->credit_cond, NULL) != 0) {
+    WINTERQ_LOG_ERROR("Failed to initialize mutex or condition variable\n");
+    goto fail;
+  }
+
+  // 初始化全局任务队列
+  if (init_global_queues(pool, config.global_queue_size) != 0)
+    goto fail_sync;
+
+  // 分配线程注册表，之后不再重新分配
+  pool->thread_data =
+      (ThreadData *_Atomic *)calloc(pool->max_threads, sizeof(ThreadData *));
+  if (pool->thread_data == NULL) {
+    WINTERQ_LOG_ERROR("Failed to allocate memory for thread data\n");
+    goto fail_queues;
+  }
+
+  // 计算绑核顺序
+  if (init_cpu_placement(pool) != 0) {
+    WINTERQ_LOG_ERROR("Failed to compute CPU placement\n");
+    goto fail_registry;
+  }
+
+  // 创建工作线程
+  for (i = 0; i < config.thread_count; i++) {
+    if (create_worker_thread(pool, i) != 0) {
+      WINTERQ_LOG_ERROR("Failed to create worker thread %d\n", i);
+      // 清理已创建的线程
+      atomic_store(&pool->shutdown, true);
+      for (int j = 0; j < i; j++) {
+        worker_send_wakeup(pool->thread_data[j]);
+        pthread_join(pool->thread_data[j]->thread, NULL);
+        destroy_thread_slot(pool->thread_data[j]);
+      }
+      destroy_cpu_placement(pool);
+      goto fail_registry;
+    }
+    atomic_store(&pool->thread_count, i + 1);
+  }
+
+  // 启动调整线程
+  if (config.dynamic_sizing) {
+    atomic_store(&pool->adjuster_running, true);
+    if (pthread_create(&pool->adjuster_thread, NULL, pool_adjuster_thread,
+                       pool) != 0) {
+      WINTERQ_LOG_ERROR("Failed to create pool adjuster thread\n");
+      atomic_store(&pool->adjuster_running, false);
+      // 线程池仍然可以工作，只是没有动态调整功能
+    }
+  }
+
+  WINTERQ_LOG_INFO("Thread pool initialized with %d threads\n",
+                   config.thread_count);
+  return pool;
+
+  // 按初始化的逆序释放
+fail_registry:
+  free(pool->thread_data);
+fail_queues:
+  destroy_global_queues(pool);
+fail_sync:
+  pthread_mutex_destroy(&pool->pool_mutex);
+  pthread_mutex_destroy(&pool->wait_mutex);
+  pthread_mutex_destroy(&pool->idle_mutex);
+  pthread_mutex_destroy(&pool->resize_mutex);
+  pthread_cond_destroy(&pool->wait_cond);
+  pthread_cond_destroy(&pool->idle_cond);
+  pthread_mutex_destroy(&pool->credit_mutex);
+  pthread_cond_destroy(&pool->credit_cond);
+fail:
+  destroy_memo_cache(pool);
+  destroy_flights(pool);
+  destroy_tenants(pool);
+  destroy_lanes(pool);
+  free(pool);
+  return NULL;
+}
+
+/**
+ * @brief 创建脚本任务，复制脚本字符串
+ * @param pool 线程池
+ * @param script JavaScript脚本
+ * @param callback 回调函数
+ * @param callback_arg 回调函数参数
+ * @return 任务指针，失败返回NULL
+ */
+static Task *create_script_task(ThreadPool *pool, const char *script,
+                                void (*callback)(void *), void *callback_arg) {
+  // 分配任务结构体
+  Task *task = (Task *)calloc(1, sizeof(Task));
+  if (task == NULL) {
+    WINTERQ_LOG_ERROR("Failed to allocate memory for task\n");
+    return NULL;
+  }
+
+  // 分配并复制脚本
+  task->script = strdup(script);
+  if (task->script == NULL) {
+    WINTERQ_LOG_ERROR("Failed to allocate memory for script\n");
+    free(task);
+    return NULL;
+  }
+
+  // 初始化任务字段
+  task->is_script = 1;
+  task->task_id = atomic_fetch_add(&pool->total_tasks, 1);
+  task->callback = callback;
+  task->callback_arg = callback_arg;
+
+  return task;
+}
+
+/**
+ * @brief 创建字节码任务，复制字节码
+ * @param pool 线程池
+ * @param bytecode JavaScript字节码
+ * @param bytecode_len 字节码长度
+ * @param callback 回调函数
+ * @param callback_arg 回调函数参数
+ * @return 任务指针，失败返回NULL
+ */
+static Task *create_bytecode_task(ThreadPool *pool, uint8_t *bytecode,
+                                  size_t bytecode_len, void (*callback)(void *),
+                                  void *callback_arg) {
+  // 分配任务结构体
+  Task *task = (Task *)calloc(1, sizeof(Task));
+  if (task == NULL) {
+    WINTERQ_LOG_ERROR("Failed to allocate memory for task\n");
+    return NULL;
+  }
 
-  while (atomic_load(&pool->adjuster_running)) {
-    // 等待有空闲线程的信号
-    pthread_mutex_lock(&pool->idle_mutex);
-    pthread_cond_wait(&pool->idle_cond, &pool->idle_mutex);
-    pthread_mutex_unlock(&pool->idle_mutex);
+  // 分配并复制字节码
+  task->bytecode = (uint8_t *)malloc(bytecode_len);
+  if (task->bytecode == NULL) {
+    WINTERQ_LOG_ERROR("Failed to allocate memory for bytecode\n");
+    free(task);
+    return NULL;
+  }
+  memcpy(task->bytecode, bytecode, bytecode_len);
+
+  // 初始化任务字段
+  task->is_script = 0;
+  task->bytecode_len = bytecode_len;
+  task->task_id = atomic_fetch_add(&pool->total_tasks, 1);
+  task->callback = callback;
+  task->callback_arg = callback_arg;
+
+  return task;
+}
+
+/**
+ * @brief 创建 ScriptBlob，复制一次内容
+ * @param data 内容
+ * @param len 内容长度
+ * @param is_script 是否为脚本字符串
+ * @return ScriptBlob 指针，失败返回NULL
+ */
+static ScriptBlob *script_blob_create(const void *data, size_t len,
+                                      bool is_script) {
+  // 脚本额外保留结尾的 '\0'
+  ScriptBlob *blob =
+      (ScriptBlob *)malloc(sizeof(ScriptBlob) + len + (is_script ? 1 : 0));
+  if (blob == NULL) {
+    WINTERQ_LOG_ERROR("Failed to allocate memory for script blob\n");
+    return NULL;
+  }
+
+  atomic_init(&blob->refs, 1);
+  atomic_init(&blob->memo_hash, 0);
+  atomic_init(&blob->memo_hashed, false);
+  blob->is_script = is_script;
+  blob->len = len;
+  memcpy(blob->data, data, len);
+  if (is_script)
+    blob->data[len] = '\0';
+
+  return blob;
+}
+
+ScriptBlob *script_blob_create_script(const char *script) {
+  if (script == NULL)
+    return NULL;
+  return script_blob_create(script, strlen(script), true);
+}
+
+ScriptBlob *script_blob_create_bytecode(const uint8_t *bytecode,
+                                        size_t bytecode_len) {
+  if (bytecode == NULL || bytecode_len == 0)
+    return NULL;
+  return script_blob_create(bytecode, bytecode_len, false);
+}
+
+ScriptBlob *script_blob_retain(ScriptBlob *blob) {
+  if (blob != NULL)
+    atomic_fetch_add_explicit(&blob->refs, 1, memory_order_relaxed);
+  return blob;
+}
+
+void script_blob_release(ScriptBlob *blob) {
+  if (blob == NULL)
+    return;
+  // acq_rel 保证其他线程对内容的读取都发生在释放之前
+  if (atomic_fetch_sub_explicit(&blob->refs, 1, memory_order_acq_rel) == 1)
+    free(blob);
+}
+
+/**
+ * @brief 校验优先级，无效值按 TASK_PRIORITY_NORMAL 处理
+ * @param priority 优先级
+ * @return 有效的优先级
+ */
+static TaskPriority task_priority_sanitize(TaskPriority priority) {
+  if ((int)priority < 0 || priority >= TASK_PRIORITY_COUNT)
+    return TASK_PRIORITY_NORMAL;
+  return priority;
+}
+
+/**
+ * @brief 让任务指向共享内容（不增加引用计数）
+ * @param task 任务
+ * @param blob 共享脚本/字节码
+ */
+static void task_use_blob(Task *task, ScriptBlob *blob) {
+  task->blob = blob;
+  task->is_script = blob->is_script;
+  if (blob->is_script) {
+    task->script = (const char *)blob->data;
+  } else {
+    // 字节码只读，Worker_Eval_Bytecode 不会修改缓冲区
+    task->bytecode = blob->data;
+    task->bytecode_len = blob->len;
+  }
+}
+
+/**
+ * @brief 任务的亲和哈希：亲和键的哈希，否则按脚本标识计算
+ *
+ * 共享脚本按地址区分，不需要读取内容；其他任务对脚本或字节码内容做 FNV-1a
+ * @param task 任务
+ * @return 32 位哈希值
+ */
+static uint32_t task_affinity_hash(const Task *task) {
+  if (task->affinity_key_hash != 0)
+    return task->affinity_key_hash;
+
+  uint64_t hash = 14695981039346656037ull;
+  if (task->blob != NULL) {
+    hash ^= (uint64_t)(uintptr_t)task->blob;
+    hash *= 1099511628211ull;
+  } else if (task->is_script) {
+    for (const unsigned char *p = (const unsigned char *)task->script;
+         *p != '\0'; p++) {
+      hash ^= *p;
+      hash *= 1099511628211ull;
+    }
+  } else {
+    for (size_t i = 0; i < task->bytecode_len; i++) {
+      hash ^= task->bytecode[i];
+      hash *= 1099511628211ull;
+    }
+  }
+  return (uint32_t)(hash ^ (hash >> 32));
+}
+
+/**
+ * @brief 把任务放入首选线程的亲和队列
+ *
+ * 首选线程积压超过窃取阈值时额外唤醒一个空闲线程来窃取，用负载均衡换缓存热度。
+ * 只路由普通优先级、没有截止时间的任务，高/低优先级和有截止时间的任务
+ * 仍由全局队列按优先级和老化调度；入队的任务与全局队列一样占用一个准入名额
+ * @param pool 线程池
+ * @param task 任务
+ * @return 成功返回true，不参与路由、没有名额、首选线程正在退出或亲和队列满时返回false
+ */
+static bool route_by_affinity(ThreadPool *pool, Task *task) {
+  int count = pool->thread_count;
+  if (count <= 0 || task->priority != TASK_PRIORITY_NORMAL ||
+      task->deadline != 0)
+    return false;
+
+  // 不论是否放入亲和队列都记录首选线程，溢出到其他队列的任务计为未命中
+  task->affine = true;
+  task->affinity_thread = (int)(task_affinity_hash(task) % (uint32_t)count);
+
+  ThreadData *target = pool->thread_data[task->affinity_thread];
+  if (target == NULL || atomic_load(&target->retiring))
+    return false;
+  if (credits_acquire(pool, 1, 0) == 0)
+    return false;
+  if (task_ring_try_enqueue(&target->affinity_queue, task) != 0) {
+    credits_release(pool, 1);
+    return false;
+  }
+
+  // 检查退出标志与入队之间线程可能开始退出，任务交给全局队列
+  reclaim_stranded_tasks(pool, target);
+  wake_worker(target);
+  if (pool->config.enable_work_stealing &&
+      (long)task_ring_size(&target->affinity_queue) >
+          affinity_steal_threshold(pool))
+    wake_stealer(pool);
+  return true;
+}
+
+/**
+ * @brief 任务可以放入本地队列时返回当前工作线程
+ *
+ * 本地队列按后进先出执行，只放普通优先级、没有截止时间的任务，且不启用 EDF 调度；
+ * 其他任务由全局队列按优先级、老化或截止时间调度
+ * @param pool 线程池
+ * @param task 任务
+ * @return 当前工作线程，不能放入本地队列时返回NULL
+ */
+static ThreadData *local_queue_owner(ThreadPool *pool, const Task *task) {
+  ThreadData *self = current_worker;
+  if (self == NULL || self->pool != pool || atomic_load(&self->retiring))
+    return NULL;
+  if (task->priority != TASK_PRIORITY_NORMAL || task->deadline != 0 ||
+      pool->config.edf_scheduling)
+    return NULL;
+  return self;
+}
+
+/**
+ * @brief 将任务放入合适的队列并唤醒工作线程
+ *
+ * - 指定线程：放入该线程的收件箱，只唤醒该线程
+ * - 亲和路由：放入首选线程的亲和队列，队列满时按下面的规则继续
+ * - 在工作线程上提交（例如任务完成回调中派生的任务）的普通优先级、没有截止时间的任务：
+ *   有名额时放入当前线程的本地队列，其他线程可以窃取
+ * - 其他情况：占用一个准入名额后放入全局队列
+ *
+ * 本地队列和亲和队列中的任务与全局队列一样占用名额，出队执行或转移时归还
+ *
+ * 失败时任务的所有权仍属于调用方
+ * @param pool 线程池
+ * @param task 要提交的任务
+ * @param thread_id 目标线程ID，-1表示不指定
+ * @param timeout_ms 队列满时的最长等待时间(毫秒)，0表示不等待
+ * @return SubmitStatus
+ */
+static SubmitStatus dispatch_task(ThreadPool *pool, Task *task, int thread_id,
+                                  int timeout_ms) {
+  if (atomic_load(&pool->shutdown))
+    return SUBMIT_SHUTDOWN;
+
+  if (thread_id >= 0) {
+    if (thread_id >= pool->thread_count) {
+      WINTERQ_LOG_ERROR("Invalid thread id: %d\n", thread_id);
+      return SUBMIT_ERROR;
+    }
+    ThreadData *target = pool->thread_data[thread_id];
+    if (task_ring_enqueue_wait(&target->inbox, task, timeout_ms) != 0)
+      return SUBMIT_QUEUE_FULL;
+    // 检查线程数与入队之间线程可能被缩容移除，任务交给全局队列
+    reclaim_stranded_tasks(pool, target);
+    wake_worker(target);
+    return SUBMIT_OK;
+  }
+
+  if (pool->config.affinity_routing && route_by_affinity(pool, task))
+    return SUBMIT_OK;
+
+  ThreadData *self = local_queue_owner(pool, task);
+  if (self != NULL && credits_acquire(pool, 1, 0) == 1) {
+    if (task_deque_push(&self->local_queue, task) == 0) {
+      // 当前线程可能正在事件循环中处理回调，确保它会继续取任务
+      wake_worker(self);
+      if (pool->config.enable_work_stealing)
+        wake_stealer(pool);
+      return SUBMIT_OK;
+    }
+    credits_release(pool, 1);
+  }
+
+  // 占用名额后全局队列一定有空位
+  if (credits_acquire(pool, 1, timeout_ms) == 0)
+    return atomic_load(&pool->shutdown) ? SUBMIT_SHUTDOWN : SUBMIT_QUEUE_FULL;
+
+  if (global_enqueue(pool, task, 0) != 0) {
+    credits_release(pool, 1);
+    return SUBMIT_QUEUE_FULL;
+  }
+
+  wake_idle_worker(pool);
+  return SUBMIT_OK;
+}
+
+/**
+ * @brief 把已经接受、之后才就绪的任务（排序通道放出的任务、任务图中就绪的节点）放入队列
+ *
+ * 任务提交时已经被接受，不再受名额限制，强制占用一个名额：可以放入本地队列时
+ * （见 local_queue_owner）放入，由当前线程接着执行，也可以被其他线程窃取；否则放入全局队列
+ * @param pool 线程池
+ * @param task 任务
+ * @param share 放入本地队列时是否唤醒空闲线程来窃取
+ * @return 成功返回0，全局队列放不下返回-1
+ */
+static int requeue_task(ThreadPool *pool, Task *task, bool share) {
+  atomic_fetch_sub(&pool->credits, 1);
+
+  ThreadData *self = local_queue_owner(pool, task);
+  if (self != NULL && task_deque_push(&self->local_queue, task) == 0) {
+    wake_worker(self);
+    if (share && pool->config.enable_work_stealing)
+      wake_stealer(pool);
+    return 0;
+  }
+
+  // 可能在工作线程的事件循环回调中调用，队列满时不等待，由调用方让任务失败
+  if (global_enqueue(pool, task, 0) != 0) {
+    credits_release(pool, 1);
+    return -1;
+  }
+  wake_idle_worker(pool);
+  return 0;
+}
+
+/**
+ * @brief 把退出中线程的一个任务转移到全局队列，放不下时让任务失败
+ * @param pool 线程池
+ * @param task 从该线程队列中取出的任务
+ * @return 转移成功返回1，否则返回0
+ */
+static int migrate_task(ThreadPool *pool, Task *task) {
+  // 已接受的任务强制占用名额，名额可以暂时为负；队列满时不等待，
+  // 这里可能在工作线程的事件循环回调中执行
+  atomic_fetch_sub(&pool->credits, 1);
+  if (global_enqueue(pool, task, 0) != 0) {
+    credits_release(pool, 1);
+    WINTERQ_LOG_ERROR("Dropping task %d of retired thread\n", task->task_id);
+    finish_unexecuted_task(pool, task, TASK_STATUS_FAILED);
+    return 0;
+  }
+  return 1;
+}
+
+/**
+ * @brief 将退出中线程的本地队列和收件箱中的任务转移到全局队列
+ *
+ * 只能由该线程自己调用，或者在它退出之后调用（作为本地队列的所属线程）
+ * @param pool 线程池
+ * @param thread_data 退出中或已退出的线程
+ */
+static void migrate_thread_tasks(ThreadPool *pool, ThreadData *thread_data) {
+  Task *task;
+  int moved = 0;
+
+  while ((task = local_dequeue(pool, thread_data)) != NULL ||
+         (task = task_ring_dequeue(&thread_data->inbox)) != NULL ||
+         (task = affinity_dequeue(pool, thread_data)) != NULL)
+    moved += migrate_task(pool, task);
+
+  if (moved > 0)
+    wake_idle_worker(pool);
+}
+
+/**
+ * @brief 提交到收件箱或亲和队列后，目标线程已经在退出时把其中的任务转移到全局队列
+ *
+ * 线程退出时只转移一次，之后投递的任务没有线程会取；收件箱和亲和队列是多生产者
+ * 多消费者队列，提交者可以直接取出。线程还没转移时两边一起取也不会重复
+ * @param pool 线程池
+ * @param thread_data 刚投递过任务的线程
+ */
+static void reclaim_stranded_tasks(ThreadPool *pool, ThreadData *thread_data) {
+  // 与缩容设置 retiring 配对：要么这里看到退出标志，要么线程转移时看到任务
+  atomic_thread_fence(memory_order_seq_cst);
+  if (!atomic_load(&thread_data->retiring) &&
+      !atomic_load(&thread_data->exited))
+    return;
+
+  Task *task;
+  int moved = 0;
+  while ((task = task_ring_dequeue(&thread_data->inbox)) != NULL ||
+         (task = affinity_dequeue(pool, thread_data)) != NULL)
+    moved += migrate_task(pool, task);
+
+  if (moved > 0)
+    wake_idle_worker(pool);
+}
+
+/**
+ * @brief 排序键的 64 位 FNV-1a 哈希
+ * @param key 排序键
+ * @return 哈希值
+ */
+static uint64_t lane_hash(const char *key) {
+  uint64_t hash = 14695981039346656037ull;
+  for (const unsigned char *p = (const unsigned char *)key; *p != '\0'; p++) {
+    hash ^= *p;
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+/**
+ * @brief 将排序任务挂到它的键对应的通道上
+ * @param pool 线程池
+ * @param task 排序任务
+ * @param key 排序键
+ * @return 通道原来空闲（任务应立即派发）返回1，任务挂起等待返回0，内存不足返回-1
+ */
+static int lane_attach(ThreadPool *pool, Task *task, const char *key) {
+  uint64_t hash = lane_hash(key);
+  LaneBucket *bucket = &pool->lanes[hash % TASK_LANE_BUCKETS];
+
+  pthread_mutex_lock(&bucket->mutex);
+  KeyLane *lane = bucket->lanes;
+  while (lane != NULL && (lane->hash != hash || strcmp(lane->key, key) != 0))
+    lane = lane->next;
+
+  if (lane != NULL) {
+    // 同一个键已有任务在执行，排在最后等待
+    task->lane = lane;
+    task->lane_next = NULL;
+    if (lane->tail != NULL)
+      lane->tail->lane_next = task;
+    else
+      lane->head = task;
+    lane->tail = task;
+    pthread_mutex_unlock(&bucket->mutex);
+    return 0;
+  }
+
+  size_t len = strlen(key) + 1;
+  lane = (KeyLane *)malloc(sizeof(KeyLane) + len);
+  if (lane == NULL) {
+    pthread_mutex_unlock(&bucket->mutex);
+    WINTERQ_LOG_ERROR("Failed to allocate memory for ordering lane\n");
+    return -1;
+  }
+  lane->hash = hash;
+  lane->head = NULL;
+  lane->tail = NULL;
+  memcpy(lane->key, key, len);
+  lane->next = bucket->lanes;
+  bucket->lanes = lane;
+  pthread_mutex_unlock(&bucket->mutex);
+
+  atomic_fetch_add(&pool->active_lanes, 1);
+  task->lane = lane;
+  return 1;
+}
+
+/**
+ * @brief 通道中当前的任务已经结束（完成、丢弃或派发失败），放出下一个
+ *
+ * 没有等待的任务时删除通道；线程池关闭时通道由 destroy_lanes 统一释放
+ * @param pool 线程池
+ * @param lane 通道
+ */
+static void lane_release(ThreadPool *pool, KeyLane *lane) {
+  if (atomic_load(&pool->shutdown))
+    return;
+
+  LaneBucket *bucket = &pool->lanes[lane->hash % TASK_LANE_BUCKETS];
+  for (;;) {
+    pthread_mutex_lock(&bucket->mutex);
+    Task *next = lane->head;
+    if (next != NULL) {
+      lane->head = next->lane_next;
+      if (lane->head == NULL)
+        lane->tail = NULL;
+      next->lane_next = NULL;
+    } else {
+      KeyLane **link = &bucket->lanes;
+      while (*link != lane)
+        link = &(*link)->next;
+      *link = lane->next;
+    }
+    pthread_mutex_unlock(&bucket->mutex);
+
+    if (next == NULL) {
+      free(lane);
+      atomic_fetch_sub(&pool->active_lanes, 1);
+      return;
+    }
+
+    // 归还挂起期间占用的名额
+    credits_release(pool, 1);
+    if (requeue_task(pool, next, true) == 0)
+      return;
+
+    // 由这个循环继续放出下一个，不在 finish_unexecuted_task 中递归释放通道
+    WINTERQ_LOG_ERROR("Dropping ordered task %d: queue full\n", next->task_id);
+    next->lane = NULL;
+    finish_unexecuted_task(pool, next, TASK_STATUS_FAILED);
+  }
+}
+
+/**
+ * @brief 提交排序任务
+ * @param pool 线程池
+ * @param task 任务
+ * @param key 排序键
+ * @param timeout_ms 队列满时的最长等待时间(毫秒)
+ * @return SubmitStatus
+ */
+static SubmitStatus submit_ordered_task(ThreadPool *pool, Task *task,
+                                        const char *key, int timeout_ms) {
+  // 挂起等待的任务同样占用名额，避免通道无限增长
+  if (credits_acquire(pool, 1, timeout_ms) == 0)
+    return atomic_load(&pool->shutdown) ? SUBMIT_SHUTDOWN : SUBMIT_QUEUE_FULL;
+
+  int attached = lane_attach(pool, task, key);
+  if (attached <= 0) {
+    if (attached < 0)
+      credits_release(pool, 1);
+    return attached < 0 ? SUBMIT_ERROR : SUBMIT_OK;
+  }
+
+  // 通道原来空闲，按普通任务派发
+  credits_release(pool, 1);
+  KeyLane *lane = task->lane;
+  SubmitStatus status = dispatch_task(pool, task, -1, timeout_ms);
+  if (status != SUBMIT_OK) {
+    task->lane = NULL;
+    lane_release(pool, lane); // 期间挂起的任务由下一个接替
+  }
+  return status;
+}
+
+/**
+ * @brief 释放所有通道及其中等待的任务，只在线程池关闭时调用
+ * @param pool 线程池
+ */
+static void destroy_lanes(ThreadPool *pool) {
+  for (int i = 0; i < TASK_LANE_BUCKETS; i++) {
+    KeyLane *lane = pool->lanes[i].lanes;
+    while (lane != NULL) {
+      KeyLane *next_lane = lane->next;
+      Task *task = lane->head;
+      while (task != NULL) {
+        Task *next = task->lane_next;
+        free_task(task);
+        task = next;
+      }
+      free(lane);
+      lane = next_lane;
+    }
+    pool->lanes[i].lanes = NULL;
+    pthread_mutex_destroy(&pool->lanes[i].mutex);
+  }
+}
+
+/**
+ * @brief 租户任务同时放出的窗口大小
+ * @param pool 线程池
+ * @return 窗口大小
+ */
+static int tenant_window(ThreadPool *pool) {
+  if (pool->config.tenant_window > 0)
+    return pool->config.tenant_window;
+  int contexts = pool->config.max_contexts > 0 ? pool->config.max_contexts : 1;
+  int window = pool->thread_count * contexts;
+  return window > 0 ? window : 1;
+}
+
+/**
+ * @brief 租户是否可以放出任务：有等待的任务且没有达到并发上限
+ * @param tenant 租户
+ * @return 可以放出返回true
+ */
+static bool tenant_runnable(const Tenant *tenant) {
+  return tenant->head != NULL &&
+         (tenant->max_in_flight <= 0 ||
+          tenant->in_flight < tenant->max_in_flight);
+}
+
+/**
+ * @brief 获取租户，不存在时以默认参数创建，调用方持有 tenant_mutex
+ * @param pool 线程池
+ * @param tenant_id 租户ID
+ * @return 租户，ID无效或内存不足返回NULL
+ */
+static Tenant *tenant_get_locked(ThreadPool *pool, int tenant_id) {
+  if (tenant_id <= 0 || tenant_id >= TASK_MAX_TENANTS)
+    return NULL;
+
+  Tenant *tenant = pool->tenants[tenant_id];
+  if (tenant != NULL)
+    return tenant;
+
+  tenant = (Tenant *)calloc(1, sizeof(Tenant));
+  if (tenant == NULL) {
+    WINTERQ_LOG_ERROR("Failed to allocate memory for tenant\n");
+    return NULL;
+  }
+  tenant->id = tenant_id;
+  tenant->weight = 1;
+  tenant->created = winterq_clock_hrtime();
+  pool->tenants[tenant_id] = tenant;
+  return tenant;
+}
+
+/**
+ * @brief 把租户加入轮询链表尾部，调用方持有 tenant_mutex
+ * @param pool 线程池
+ * @param tenant 租户
+ */
+static void tenant_activate_locked(ThreadPool *pool, Tenant *tenant) {
+  tenant->active = true;
+  tenant->deficit = 0;
+  tenant->next_active = NULL;
+  if (pool->active_tenants_tail != NULL)
+    pool->active_tenants_tail->next_active = tenant;
+  else
+    pool->active_tenants = tenant;
+  pool->active_tenants_tail = tenant;
+}
+
+/**
+ * @brief 按加权轮询把租户任务放出到工作队列，直到窗口满或没有可以放出的任务
+ *
+ * 轮到的租户先获得 weight 个额度，每放出一个任务消耗一个；额度用完、队列为空或
+ * 达到并发上限时结束本轮，仍可运行的租户排到链表尾部，其余租户离开链表，
+ * 之后有新任务或并发额度归还时重新加入。放出时持锁只摘下任务，在锁外按放出的顺序
+ * 放入全局队列
+ * @param pool 线程池
+ */
+static void tenant_dispatch(ThreadPool *pool) {
+  Task *ready[TENANT_DISPATCH_BATCH];
+
+  for (;;) {
+    size_t n = 0;
+    pthread_mutex_lock(&pool->tenant_mutex);
+    int window = tenant_window(pool);
+    uint64_t now = winterq_clock_hrtime();
+    while (n < TENANT_DISPATCH_BATCH && pool->tenant_in_flight < window &&
+           pool->active_tenants != NULL && !atomic_load(&pool->shutdown)) {
+      Tenant *tenant = pool->active_tenants;
+      if (tenant->deficit == 0)
+        tenant->deficit = tenant->weight;
+
+      Task *task = tenant->head;
+      tenant->head = task->tenant_next;
+      if (tenant->head == NULL)
+        tenant->tail = NULL;
+      task->tenant_next = NULL;
+      tenant->queued--;
+      tenant->in_flight++;
+      tenant->deficit--;
+      tenant->released++;
+      tenant->wait_ns += now - task->enqueue_time;
+      pool->tenant_in_flight++;
+      ready[n++] = task;
+
+      if (tenant->deficit > 0 && tenant_runnable(tenant))
+        continue;
+
+      // 本轮结束
+      pool->active_tenants = tenant->next_active;
+      if (pool->active_tenants == NULL)
+        pool->active_tenants_tail = NULL;
+      tenant->active = false;
+      if (tenant_runnable(tenant))
+        tenant_activate_locked(pool, tenant);
+    }
+    pthread_mutex_unlock(&pool->tenant_mutex);
+
+    // 按放出的顺序进入全局队列，不放入当前线程的本地队列（后进先出会打乱顺序）；
+    // 排队期间占用的名额直接转给全局队列，队列满时不等待
+    size_t moved = 0;
+    for (size_t i = 0; i < n; i++) {
+      if (global_enqueue(pool, ready[i], 0) != 0) {
+        credits_release(pool, 1);
+        WINTERQ_LOG_ERROR("Dropping tenant task %d: queue full\n",
+                          ready[i]->task_id);
+        finish_unexecuted_task(pool, ready[i], TASK_STATUS_FAILED);
+        continue;
+      }
+      moved++;
+    }
+    wake_idle_workers(pool, moved);
+    if (n < TENANT_DISPATCH_BATCH)
+      return;
+  }
+}
+
+/**
+ * @brief 租户任务结束，归还并发额度并继续放出等待的任务
+ * @param pool 线程池
+ * @param tenant 任务所属的租户
+ */
+static void tenant_release(ThreadPool *pool, Tenant *tenant) {
+  pthread_mutex_lock(&pool->tenant_mutex);
+  tenant->in_flight--;
+  tenant->completed++;
+  pool->tenant_in_flight--;
+  if (!tenant->active && tenant_runnable(tenant))
+    tenant_activate_locked(pool, tenant);
+  pthread_mutex_unlock(&pool->tenant_mutex);
+
+  tenant_dispatch(pool);
+}
+
+/**
+ * @brief 从令牌桶取一个令牌
+ *
+ * 理论到达时间 tat 超前当前时间不超过 tolerance 时允许提交，并把 tat 推进一个
+ * interval；桶满（tat 落后于当前时间）时从当前时间开始计算
+ * @param bucket 令牌桶
+ * @return 取到返回true，超过速率返回false
+ */
+static bool token_bucket_acquire(TokenBucket *bucket) {
+  uint64_t interval =
+      atomic_load_explicit(&bucket->interval, memory_order_relaxed);
+  if (interval == 0)
+    return true;
+  uint64_t tolerance =
+      atomic_load_explicit(&bucket->tolerance, memory_order_relaxed);
+
+  uint64_t now = winterq_clock_hrtime();
+  uint64_t tat = atomic_load_explicit(&bucket->tat, memory_order_relaxed);
+  for (;;) {
+    uint64_t start = tat > now ? tat : now;
+    if (start - now > tolerance) {
+      atomic_fetch_add_explicit(&bucket->rejected, 1, memory_order_relaxed);
+      return false;
+    }
+    if (atomic_compare_exchange_weak_explicit(&bucket->tat, &tat,
+                                              start + interval,
+                                              memory_order_relaxed,
+                                              memory_order_relaxed))
+      return true;
+  }
+}
+
+int thread_pool_set_tenant_rate(ThreadPool *pool, int tenant_id, double rate,
+                                int burst) {
+  if (pool == NULL || tenant_id <= 0 || tenant_id >= TASK_MAX_TENANTS ||
+      rate < 0 || burst < 1)
+    return -1;
+
+  TokenBucket *bucket = &pool->rate_limits[tenant_id];
+  uint64_t interval = rate > 0 ? (uint64_t)(1e9 / rate) : 0;
+  if (rate > 0 && interval == 0)
+    interval = 1;
+  // 两个参数分别写入，修改期间的个别判断可能混用新旧参数
+  atomic_store(&bucket->tolerance, (uint64_t)(burst - 1) * interval);
+  atomic_store(&bucket->interval, interval);
+  return 0;
+}
+
+/**
+ * @brief 提交租户任务：放入租户队列，由调度器按权重放出
+ * @param pool 线程池
+ * @param task 任务
+ * @param tenant_id 租户ID
+ * @param timeout_ms 队列满时的最长等待时间(毫秒)
+ * @return SubmitStatus
+ */
+static SubmitStatus submit_tenant_task(ThreadPool *pool, Task *task,
+                                       int tenant_id, int timeout_ms) {
+  // 在租户队列中等待的任务同样占用名额，突发提交的租户受全局容量限制
+  if (credits_acquire(pool, 1, timeout_ms) == 0)
+    return atomic_load(&pool->shutdown) ? SUBMIT_SHUTDOWN : SUBMIT_QUEUE_FULL;
+
+  pthread_mutex_lock(&pool->tenant_mutex);
+  Tenant *tenant = tenant_get_locked(pool, tenant_id);
+  if (tenant == NULL) {
+    pthread_mutex_unlock(&pool->tenant_mutex);
+    credits_release(pool, 1);
+    return SUBMIT_ERROR;
+  }
+  task->tenant = tenant;
+  task->enqueue_time = winterq_clock_hrtime();
+  if (tenant->tail != NULL)
+    tenant->tail->tenant_next = task;
+  else
+    tenant->head = task;
+  tenant->tail = task;
+  tenant->queued++;
+  if (!tenant->active && tenant_runnable(tenant))
+    tenant_activate_locked(pool, tenant);
+  pthread_mutex_unlock(&pool->tenant_mutex);
+
+  tenant_dispatch(pool);
+  return SUBMIT_OK;
+}
+
+int thread_pool_set_tenant(ThreadPool *pool, int tenant_id, int weight,
+                           int max_in_flight) {
+  if (pool == NULL || weight <= 0 || max_in_flight < 0)
+    return -1;
+
+  pthread_mutex_lock(&pool->tenant_mutex);
+  Tenant *tenant = tenant_get_locked(pool, tenant_id);
+  if (tenant == NULL) {
+    pthread_mutex_unlock(&pool->tenant_mutex);
+    return -1;
+  }
+  tenant->weight = weight;
+  tenant->max_in_flight = max_in_flight;
+  if (!tenant->active && tenant_runnable(tenant))
+    tenant_activate_locked(pool, tenant);
+  pthread_mutex_unlock(&pool->tenant_mutex);
+
+  // 提高并发上限后可能有任务可以放出
+  tenant_dispatch(pool);
+  return 0;
+}
+
+int thread_pool_get_tenant_stats(ThreadPool *pool, int tenant_id,
+                                 TenantStats *stats) {
+  if (pool == NULL || stats == NULL || tenant_id <= 0 ||
+      tenant_id >= TASK_MAX_TENANTS)
+    return -1;
+
+  pthread_mutex_lock(&pool->tenant_mutex);
+  Tenant *tenant = pool->tenants[tenant_id];
+  if (tenant == NULL) {
+    pthread_mutex_unlock(&pool->tenant_mutex);
+    return -1;
+  }
+  memset(stats, 0, sizeof(TenantStats));
+  stats->weight = tenant->weight;
+  stats->max_in_flight = tenant->max_in_flight;
+  stats->queued = tenant->queued;
+  stats->in_flight = tenant->in_flight;
+  stats->completed = tenant->completed;
+  uint64_t elapsed = winterq_clock_hrtime() - tenant->created;
+  if (elapsed > 0)
+    stats->throughput = (double)tenant->completed / ((double)elapsed / 1e9);
+  if (tenant->released > 0)
+    stats->avg_wait_time = (double)tenant->wait_ns / tenant->released / 1e6;
+  pthread_mutex_unlock(&pool->tenant_mutex);
+  stats->rate_limited = atomic_load(&pool->rate_limits[tenant_id].rejected);
+  return 0;
+}
 
-    // 如果线程池已关闭或不需要动态调整，则退出
-    if (!atomic_load(&pool->adjuster_running) || !pool->config.dynamic_sizing) {
+/**
+ * @brief 释放所有租户及其队列中的任务，只在线程池关闭时调用
+ * @param pool 线程池
+ */
+static void destroy_tenants(ThreadPool *pool) {
+  for (int i = 0; i < TASK_MAX_TENANTS; i++) {
+    Tenant *tenant = pool->tenants[i];
+    if (tenant == NULL)
       continue;
+    Task *task = tenant->head;
+    while (task != NULL) {
+      Task *next = task->tenant_next;
+      free_task(task);
+      task = next;
     }
+    free(tenant);
+    pool->tenants[i] = NULL;
+  }
+  pool->active_tenants = NULL;
+  pool->active_tenants_tail = NULL;
+  pthread_mutex_destroy(&pool->tenant_mutex);
+}
 
-    int idle_count = atomic_load(&pool->idle_thread_count);
-    int total_count = pool->thread_count;
+/**
+ * @brief 加入去重键的执行记录
+ *
+ * 记录已经存在时附加到它上面；否则登记一个新记录，由调用方创建并派发任务
+ * @param pool 线程池
+ * @param spec 任务描述
+ * @param flight 输出：新登记的记录
+ * @return 附加到已有记录返回1，登记了新记录返回0，内存不足返回-1
+ */
+static int flight_join(ThreadPool *pool, const TaskSpec *spec,
+                       FlightEntry **flight) {
+  const char *key = spec->dedup_key;
+  uint64_t hash = lane_hash(key);
+  FlightBucket *bucket = &pool->flights[hash % TASK_FLIGHT_BUCKETS];
+
+  pthread_mutex_lock(&bucket->mutex);
+  FlightEntry *entry = bucket->entries;
+  while (entry != NULL && (entry->hash != hash || strcmp(entry->key, key) != 0))
+    entry = entry->next;
+
+  if (entry != NULL) {
+    FlightWaiter *waiter = (FlightWaiter *)malloc(sizeof(FlightWaiter));
+    if (waiter == NULL) {
+      pthread_mutex_unlock(&bucket->mutex);
+      WINTERQ_LOG_ERROR("Failed to allocate memory for flight waiter\n");
+      return -1;
+    }
+    waiter->next = NULL;
+    waiter->callback = spec->callback;
+    waiter->completion = spec->completion;
+    waiter->callback_arg = spec->callback_arg;
+    if (entry->waiters_tail != NULL)
+      entry->waiters_tail->next = waiter;
+    else
+      entry->waiters = waiter;
+    entry->waiters_tail = waiter;
+    pthread_mutex_unlock(&bucket->mutex);
+    atomic_fetch_add(&pool->coalesced_tasks, 1);
+    return 1;
+  }
 
-    // 当空闲线程数超过阈值时，减少线程数
-    if (idle_count > pool->config.idle_threshold && total_count > 1) {
-      // 尝试减少一个线程
-      WINTERQ_LOG_INFO("Reducing thread pool size from %d to %d\n", total_count,
-                       total_count - 1);
-      resize_thread_pool(pool, total_count - 1);
+  size_t len = strlen(key) + 1;
+  entry = (FlightEntry *)malloc(sizeof(FlightEntry) + len);
+  if (entry == NULL) {
+    pthread_mutex_unlock(&bucket->mutex);
+    WINTERQ_LOG_ERROR("Failed to allocate memory for flight entry\n");
+    return -1;
+  }
+  entry->pool = pool;
+  entry->hash = hash;
+  entry->waiters = NULL;
+  entry->waiters_tail = NULL;
+  memcpy(entry->key, key, len);
+  entry->next = bucket->entries;
+  bucket->entries = entry;
+  pthread_mutex_unlock(&bucket->mutex);
+
+  atomic_fetch_add(&pool->active_flights, 1);
+  *flight = entry;
+  return 0;
+}
+
+/**
+ * @brief 任务结束，删除执行记录并把结果交给附加的提交
+ *
+ * 删除之后的同键提交会创建新任务；回调在锁外调用，可以再次提交
+ * @param flight 执行记录
+ * @param result 任务结果，output 只在调用期间有效
+ */
+static void flight_finish(FlightEntry *flight, const TaskResult *result) {
+  ThreadPool *pool = flight->pool;
+  FlightBucket *bucket = &pool->flights[flight->hash % TASK_FLIGHT_BUCKETS];
+
+  pthread_mutex_lock(&bucket->mutex);
+  FlightEntry **link = &bucket->entries;
+  while (*link != flight)
+    link = &(*link)->next;
+  *link = flight->next;
+  pthread_mutex_unlock(&bucket->mutex);
+  atomic_fetch_sub(&pool->active_flights, 1);
+
+  FlightWaiter *waiter = flight->waiters;
+  free(flight);
+  while (waiter != NULL) {
+    FlightWaiter *next = waiter->next;
+    if (waiter->completion)
+      waiter->completion(result, waiter->callback_arg);
+    else if (waiter->callback)
+      waiter->callback(waiter->callback_arg);
+    free(waiter);
+    waiter = next;
+  }
+}
+
+/**
+ * @brief 新登记的记录没能派发任务，期间附加的提交已经被接受，以失败结束
+ * @param flight 执行记录
+ * @param task_id 任务ID，任务还没创建时为-1
+ */
+static void flight_fail(FlightEntry *flight, int task_id) {
+  TaskResult result = {.task_id = task_id, .status = TASK_STATUS_FAILED};
+  flight_finish(flight, &result);
+}
+
+/**
+ * @brief 释放去重表中剩余的记录，只在线程池关闭时调用
+ * @param pool 线程池
+ */
+static void destroy_flights(ThreadPool *pool) {
+  for (int i = 0; i < TASK_FLIGHT_BUCKETS; i++) {
+    FlightEntry *entry = pool->flights[i].entries;
+    while (entry != NULL) {
+      FlightEntry *next_entry = entry->next;
+      FlightWaiter *waiter = entry->waiters;
+      while (waiter != NULL) {
+        FlightWaiter *next = waiter->next;
+        free(waiter);
+        waiter = next;
+      }
+      free(entry);
+      entry = next_entry;
+    }
+    pool->flights[i].entries = NULL;
+    pthread_mutex_destroy(&pool->flights[i].mutex);
+  }
+}
+
+// 结果缓存哈希的密钥，进程内随机生成一次
+static uint64_t memo_hash_key[2];
+static pthread_once_t memo_hash_key_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief 生成结果缓存哈希的密钥，取不到系统随机数时退回时钟和进程号
+ */
+static void init_memo_hash_key(void) {
+  if (getentropy(memo_hash_key, sizeof(memo_hash_key)) != 0) {
+    memo_hash_key[0] = winterq_clock_hrtime() * 0x9E3779B97F4A7C15ull;
+    memo_hash_key[1] = ((uint64_t)getpid() << 32) ^ (uint64_t)time(NULL) ^
+                       (uint64_t)(uintptr_t)&memo_hash_key;
+  }
+}
+
+#define MEMO_ROTL(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+
+/**
+ * @brief SipHash 的一轮压缩
+ * @param v 内部状态
+ */
+static inline void memo_sipround(uint64_t v[4]) {
+  v[0] += v[1];
+  v[1] = MEMO_ROTL(v[1], 13);
+  v[1] ^= v[0];
+  v[0] = MEMO_ROTL(v[0], 32);
+  v[2] += v[3];
+  v[3] = MEMO_ROTL(v[3], 16);
+  v[3] ^= v[2];
+  v[0] += v[3];
+  v[3] = MEMO_ROTL(v[3], 21);
+  v[3] ^= v[0];
+  v[2] += v[1];
+  v[1] = MEMO_ROTL(v[1], 17);
+  v[1] ^= v[2];
+  v[2] = MEMO_ROTL(v[2], 32);
+}
+
+/**
+ * @brief 带密钥的 64 位 SipHash-2-4
+ * @param data 数据
+ * @param len 数据长度
+ * @param domain 与密钥混合的域标识，区分脚本、字节码、负载和内容类型
+ * @return 哈希值
+ */
+static uint64_t memo_siphash(const void *data, size_t len, uint64_t domain) {
+  pthread_once(&memo_hash_key_once, init_memo_hash_key);
+  uint64_t k0 = memo_hash_key[0] ^ domain, k1 = memo_hash_key[1];
+  uint64_t v[4] = {k0 ^ 0x736f6d6570736575ull, k1 ^ 0x646f72616e646f6dull,
+                   k0 ^ 0x6c7967656e657261ull, k1 ^ 0x7465646279746573ull};
+  const uint8_t *p = (const uint8_t *)data;
+  size_t tail = len % 8;
+  const uint8_t *end = p + (len - tail);
+
+  for (; p != end; p += 8) {
+    uint64_t m;
+    memcpy(&m, p, sizeof(m));
+    v[3] ^= m;
+    memo_sipround(v);
+    memo_sipround(v);
+    v[0] ^= m;
+  }
+
+  uint64_t b = (uint64_t)len << 56;
+  for (size_t i = 0; i < tail; i++)
+    b |= (uint64_t)p[i] << (8 * i);
+  v[3] ^= b;
+  memo_sipround(v);
+  memo_sipround(v);
+  v[0] ^= b;
+
+  v[2] ^= 0xff;
+  for (int i = 0; i < 4; i++)
+    memo_sipround(v);
+  return v[0] ^ v[1] ^ v[2] ^ v[3];
+}
+
+/**
+ * @brief 共享脚本/字节码的内容哈希，内容不可变，只在第一次用到时计算
+ * @param blob 共享脚本/字节码
+ * @return 哈希值
+ */
+static uint64_t script_blob_memo_hash(ScriptBlob *blob) {
+  if (atomic_load_explicit(&blob->memo_hashed, memory_order_acquire))
+    return atomic_load_explicit(&blob->memo_hash, memory_order_relaxed);
+
+  // 并发计算的结果相同，重复写入无害
+  uint64_t hash =
+      memo_siphash(blob->data, blob->len, blob->is_script ? 's' : 'b');
+  atomic_store_explicit(&blob->memo_hash, hash, memory_order_relaxed);
+  atomic_store_explicit(&blob->memo_hashed, true, memory_order_release);
+  return hash;
+}
+
+/**
+ * @brief 计算结果缓存的键：脚本（或字节码）内容和输入负载的哈希与长度
+ *
+ * 按内容而不是 blob 地址计算，blob 释放后地址被复用也不会命中错误的结果
+ * @param spec 任务描述
+ * @param key 输出：键
+ */
+static void memo_key_from_spec(const TaskSpec *spec, MemoKey *key) {
+  if (spec->blob != NULL) {
+    key->code_hash = script_blob_memo_hash(spec->blob);
+    key->code_len = spec->blob->len;
+  } else if (spec->script != NULL) {
+    key->code_len = strlen(spec->script);
+    key->code_hash = memo_siphash(spec->script, key->code_len, 's');
+  } else {
+    key->code_len = spec->bytecode_len;
+    key->code_hash = memo_siphash(spec->bytecode, spec->bytecode_len, 'b');
+  }
+
+  key->input_hash = 0;
+  key->input_len = 0;
+  WorkerSharedBuffer *payload = spec->payload;
+  if (payload != NULL) {
+    key->input_len = payload->len;
+    key->input_hash = memo_siphash(payload->data, payload->len, 'p');
+    if (payload->content_type != NULL)
+      key->input_hash ^= MEMO_ROTL(memo_siphash(payload->content_type,
+                                                strlen(payload->content_type),
+                                                't'),
+                                   1);
+  }
+}
+
+/**
+ * @brief 比较两个键的哈希和长度
+ * @param a 键
+ * @param b 键
+ * @return 相同返回true
+ */
+static bool memo_key_equal(const MemoKey *a, const MemoKey *b) {
+  return a->code_hash == b->code_hash && a->input_hash == b->input_hash &&
+         a->code_len == b->code_len && a->input_len == b->input_len;
+}
+
+/**
+ * @brief 键所在的分片和桶
+ * @param pool 线程池
+ * @param key 键
+ * @param bucket 输出：桶下标
+ * @return 分片
+ */
+static MemoShard *memo_shard_for(ThreadPool *pool, const MemoKey *key,
+                                 size_t *bucket) {
+  uint64_t mixed = key->code_hash ^ (key->input_hash * 0x9E3779B97F4A7C15ull);
+  *bucket = (size_t)(mixed / MEMO_CACHE_SHARDS) % MEMO_SHARD_BUCKETS;
+  return &pool->memo_shards[mixed % MEMO_CACHE_SHARDS];
+}
+
+/**
+ * @brief 释放条目的一个引用
+ * @param entry 条目
+ */
+static void memo_entry_release(MemoEntry *entry) {
+  if (atomic_fetch_sub(&entry->refs, 1) == 1)
+    free(entry);
+}
+
+/**
+ * @brief 把条目从分片中删除并释放缓存持有的引用，调用方持有分片锁
+ * @param shard 分片
+ * @param link 桶链表中指向该条目的指针
+ */
+static void memo_unlink_locked(MemoShard *shard, MemoEntry **link) {
+  MemoEntry *entry = *link;
+  *link = entry->next;
+
+  if (entry->lru_prev != NULL)
+    entry->lru_prev->lru_next = entry->lru_next;
+  else
+    shard->lru_head = entry->lru_next;
+  if (entry->lru_next != NULL)
+    entry->lru_next->lru_prev = entry->lru_prev;
+  else
+    shard->lru_tail = entry->lru_prev;
+
+  // 持锁时只有一个写者
+  COUNTER_ADD(&shard->bytes, 0 - entry->size);
+  COUNTER_ADD(&shard->entries, (size_t)-1);
+  memo_entry_release(entry);
+}
+
+/**
+ * @brief 查找桶中键对应的条目，调用方持有分片锁
+ * @param shard 分片
+ * @param bucket 桶下标
+ * @param key 键
+ * @return 桶链表中指向该条目的指针，不存在时指向链表末尾的 NULL
+ */
+static MemoEntry **memo_find_locked(MemoShard *shard, size_t bucket,
+                                    const MemoKey *key) {
+  MemoEntry **link = &shard->buckets[bucket];
+  while (*link != NULL && !memo_key_equal(&(*link)->key, key))
+    link = &(*link)->next;
+  return link;
+}
+
+/**
+ * @brief 查找缓存的结果，过期的条目顺便删除
+ * @param pool 线程池
+ * @param key 键
+ * @return 命中时返回条目并增加一个引用（调用方用 memo_entry_release 释放），
+ *         未命中返回NULL
+ */
+static MemoEntry *memo_lookup(ThreadPool *pool, const MemoKey *key) {
+  size_t bucket;
+  MemoShard *shard = memo_shard_for(pool, key, &bucket);
+
+  pthread_mutex_lock(&shard->mutex);
+  MemoEntry **link = memo_find_locked(shard, bucket, key);
+  MemoEntry *entry = *link;
+  if (entry != NULL && entry->expires != 0 &&
+      winterq_clock_hrtime() >= entry->expires) {
+    memo_unlink_locked(shard, link);
+    entry = NULL;
+  }
+  if (entry != NULL) {
+    // 移到最近使用的一端
+    if (entry != shard->lru_head) {
+      entry->lru_prev->lru_next = entry->lru_next;
+      if (entry->lru_next != NULL)
+        entry->lru_next->lru_prev = entry->lru_prev;
+      else
+        shard->lru_tail = entry->lru_prev;
+      entry->lru_prev = NULL;
+      entry->lru_next = shard->lru_head;
+      shard->lru_head->lru_prev = entry;
+      shard->lru_head = entry;
+    }
+    atomic_fetch_add(&entry->refs, 1);
+  }
+  pthread_mutex_unlock(&shard->mutex);
+
+  atomic_fetch_add(entry != NULL ? &pool->memo_hits : &pool->memo_misses, 1);
+  return entry;
+}
+
+/**
+ * @brief 缓存任务的输出，超过分片的字节预算时淘汰最久未使用的条目
+ * @param pool 线程池
+ * @param key 键
+ * @param output 输出，可以为NULL
+ * @param output_len 输出长度
+ */
+static void memo_store(ThreadPool *pool, const MemoKey *key,
+                       const uint8_t *output, size_t output_len) {
+  if (pool->memo_shards == NULL)
+    return;
+
+  size_t budget = pool->config.memo_cache_bytes / MEMO_CACHE_SHARDS;
+  size_t size = sizeof(MemoEntry) + output_len;
+  if (size > budget)
+    return; // 单个结果超过分片预算，不缓存
+
+  MemoEntry *entry = (MemoEntry *)malloc(size);
+  if (entry == NULL) {
+    WINTERQ_LOG_ERROR("Failed to allocate memory for memo entry\n");
+    return;
+  }
+  atomic_init(&entry->refs, 1);
+  entry->key = *key;
+  entry->expires = pool->config.memo_ttl_ms > 0
+                       ? winterq_clock_hrtime() +
+                             (uint64_t)pool->config.memo_ttl_ms * 1000000
+                       : 0;
+  entry->size = size;
+  entry->output_len = output_len;
+  if (output_len > 0)
+    memcpy(entry->output, output, output_len);
+
+  size_t bucket;
+  MemoShard *shard = memo_shard_for(pool, key, &bucket);
+  pthread_mutex_lock(&shard->mutex);
+
+  // 同一个键被并发执行时以后结束的为准
+  MemoEntry **link = memo_find_locked(shard, bucket, key);
+  if (*link != NULL)
+    memo_unlink_locked(shard, link);
+
+  entry->next = shard->buckets[bucket];
+  shard->buckets[bucket] = entry;
+  entry->lru_prev = NULL;
+  entry->lru_next = shard->lru_head;
+  if (shard->lru_head != NULL)
+    shard->lru_head->lru_prev = entry;
+  else
+    shard->lru_tail = entry;
+  shard->lru_head = entry;
+  COUNTER_ADD(&shard->bytes, size);
+  COUNTER_ADD(&shard->entries, 1);
+
+  while (atomic_load_explicit(&shard->bytes, memory_order_relaxed) > budget) {
+    MemoEntry *victim = shard->lru_tail;
+    size_t victim_bucket;
+    memo_shard_for(pool, &victim->key, &victim_bucket);
+    memo_unlink_locked(shard, memo_find_locked(shard, victim_bucket,
+                                               &victim->key));
+  }
+  pthread_mutex_unlock(&shard->mutex);
+}
+
+/**
+ * @brief 以缓存的输出回答提交，在提交线程上调用完成函数
+ * @param spec 任务描述
+ * @param entry 命中的条目
+ */
+static void memo_answer(const TaskSpec *spec, const MemoEntry *entry) {
+  TaskResult result = {
+      .task_id = -1,
+      .status = TASK_STATUS_COMPLETED,
+      .output = entry->output_len > 0 ? entry->output : NULL,
+      .output_len = entry->output_len,
+  };
+  if (spec->completion)
+    spec->completion(&result, spec->callback_arg);
+  else if (spec->callback)
+    spec->callback(spec->callback_arg);
+}
+
+/**
+ * @brief 按配置创建结果缓存，memo_cache_bytes 为0时不创建
+ * @param pool 线程池
+ */
+static void init_memo_cache(ThreadPool *pool) {
+  atomic_init(&pool->memo_hits, 0);
+  atomic_init(&pool->memo_misses, 0);
+  pool->memo_shards = NULL;
+  if (pool->config.memo_cache_bytes == 0)
+    return;
+
+  MemoShard *shards = (MemoShard *)calloc(MEMO_CACHE_SHARDS, sizeof(MemoShard));
+  if (shards == NULL) {
+    WINTERQ_LOG_ERROR("Failed to allocate memory for memo cache, disabled\n");
+    return;
+  }
+  for (int i = 0; i < MEMO_CACHE_SHARDS; i++) {
+    pthread_mutex_init(&shards[i].mutex, NULL);
+    atomic_init(&shards[i].bytes, 0);
+    atomic_init(&shards[i].entries, 0);
+  }
+  pool->memo_shards = shards;
+}
+
+/**
+ * @brief 释放结果缓存，只在线程池关闭时调用
+ * @param pool 线程池
+ */
+static void destroy_memo_cache(ThreadPool *pool) {
+  if (pool->memo_shards == NULL)
+    return;
+
+  for (int i = 0; i < MEMO_CACHE_SHARDS; i++) {
+    MemoShard *shard = &pool->memo_shards[i];
+    MemoEntry *entry = shard->lru_head;
+    while (entry != NULL) {
+      MemoEntry *next = entry->lru_next;
+      memo_entry_release(entry);
+      entry = next;
+    }
+    pthread_mutex_destroy(&shard->mutex);
+  }
+  free(pool->memo_shards);
+  pool->memo_shards = NULL;
+}
+
+/**
+ * @brief 添加脚本任务到线程池
+ * @param pool 线程池
+ * @param script JavaScript脚本
+ * @param callback 回调函数
+ * @param callback_arg 回调函数参数
+ * @return 成功返回0，失败返回-1
+ */
+int add_script_task_to_pool(ThreadPool *pool, const char *script,
+                            void (*callback)(void *), void *callback_arg) {
+  WINTERQ_LOG_DEBUG("--------add_script_task_to_pool----------\n");
+  return add_script_task_to_thread(pool, -1, script, callback, callback_arg);
+}
+
+/**
+ * @brief 添加字节码任务到线程池
+ * @param pool 线程池
+ * @param bytecode JavaScript字节码
+ * @param bytecode_len 字节码长度
+ * @param callback 回调函数
+ * @param callback_arg 回调函数参数
+ * @return 成功返回0，失败返回-1
+ */
+int add_bytecode_task_to_pool(ThreadPool *pool, uint8_t *bytecode,
+                              size_t bytecode_len, void (*callback)(void *),
+                              void *callback_arg) {
+  WINTERQ_LOG_DEBUG("--------add_bytecode_task_to_pool----------\n");
+  return add_bytecode_task_to_thread(pool, -1, bytecode, bytecode_len,
+                                     callback, callback_arg);
+}
+
+int add_blob_task_to_pool(ThreadPool *pool, ScriptBlob *blob,
+                          void (*callback)(void *), void *callback_arg) {
+  WINTERQ_LOG_DEBUG("--------add_blob_task_to_pool----------\n");
+  if (blob == NULL)
+    return -1;
+
+  TaskSpec spec = {
+      .blob = blob, .callback = callback, .callback_arg = callback_arg};
+  return add_task_to_pool(pool, &spec);
+}
+
+/**
+ * @brief 根据任务描述创建任务
+ * @param pool 线程池
+ * @param spec 任务描述
+ * @return 任务指针，参数错误或内存不足返回NULL
+ */
+static Task *create_task_from_spec(ThreadPool *pool, const TaskSpec *spec) {
+  Task *task = NULL;
+  if (spec->blob != NULL) {
+    task = (Task *)calloc(1, sizeof(Task));
+    if (task == NULL) {
+      WINTERQ_LOG_ERROR("Failed to allocate memory for task\n");
+      return NULL;
+    }
+    task_use_blob(task, script_blob_retain(spec->blob));
+    task->task_id = atomic_fetch_add(&pool->total_tasks, 1);
+    task->callback = spec->callback;
+    task->callback_arg = spec->callback_arg;
+  } else if (spec->script != NULL) {
+    task = create_script_task(pool, spec->script, spec->callback,
+                              spec->callback_arg);
+  } else if (spec->bytecode != NULL && spec->bytecode_len > 0) {
+    task = create_bytecode_task(pool, (uint8_t *)spec->bytecode,
+                                spec->bytecode_len, spec->callback,
+                                spec->callback_arg);
+  }
+  if (task == NULL)
+    return NULL;
+
+  task->priority = task_priority_sanitize(spec->priority);
+  task->deadline = spec->deadline;
+  task->completion = spec->completion;
+  task->cq = spec->cq;
+  task->payload = Worker_RetainSharedBuffer(spec->payload);
+  if (spec->affinity_key != NULL) {
+    uint32_t hash = (uint32_t)(lane_hash(spec->affinity_key) >> 32);
+    task->affinity_key_hash = hash != 0 ? hash : 1;
+  }
+  return task;
+}
+
+/**
+ * @brief 提交单个任务，handle 非NULL时任务持有它的一个引用
+ * @param pool 线程池
+ * @param spec 任务描述
+ * @param timeout_ms 队列满时的最长等待时间(毫秒)
+ * @param handle 任务句柄，可以为NULL
+ * @return SubmitStatus
+ */
+static SubmitStatus submit_task_internal(ThreadPool *pool, const TaskSpec *spec,
+                                         int timeout_ms, TaskHandle *handle) {
+  if (pool == NULL || spec == NULL)
+    return SUBMIT_ERROR;
+  if (spec->tenant_id != 0 &&
+      (spec->ordering_key != NULL || spec->tenant_id < 0 ||
+       spec->tenant_id >= TASK_MAX_TENANTS))
+    return SUBMIT_ERROR;
+  if (spec->dedup_key != NULL &&
+      (spec->ordering_key != NULL || spec->cq != NULL || handle != NULL))
+    return SUBMIT_ERROR;
+  if (spec->memoize && (spec->cq != NULL || handle != NULL))
+    return SUBMIT_ERROR;
+  if (atomic_load(&pool->shutdown))
+    return SUBMIT_SHUTDOWN;
+
+  // 速率限制在分配任务和复制脚本之前检查
+  if (spec->tenant_id != 0 &&
+      !token_bucket_acquire(&pool->rate_limits[spec->tenant_id])) {
+    atomic_fetch_add(&pool->rate_limited_tasks, 1);
+    return SUBMIT_RATE_LIMITED;
+  }
+
+  // 结果缓存命中时直接回答，不分配任务也不经过工作线程
+  MemoKey memo_key;
+  bool memoize = spec->memoize && pool->memo_shards != NULL;
+  if (memoize) {
+    memo_key_from_spec(spec, &memo_key);
+    MemoEntry *entry = memo_lookup(pool, &memo_key);
+    if (entry != NULL) {
+      memo_answer(spec, entry);
+      memo_entry_release(entry);
+      return SUBMIT_OK;
+    }
+  }
+
+  // 同一个键的任务正在排队或执行时附加到它上面，不创建任务也不占用名额；
+  // 只有创建了新 flight 的提交需要经过下面的准入检查
+  FlightEntry *flight = NULL;
+  if (spec->dedup_key != NULL) {
+    int joined = flight_join(pool, spec, &flight);
+    if (joined != 0)
+      return joined > 0 ? SUBMIT_OK : SUBMIT_ERROR;
+  }
+
+  // 没有名额时在复制脚本之前就拒绝；本地队列中的任务同样占用名额
+  SubmitStatus status = SUBMIT_OK;
+  if (timeout_ms <= 0 && atomic_load(&pool->credits) <= 0)
+    status = SUBMIT_QUEUE_FULL;
+  // 完成队列的槽位在提交时预留，投递时不会失败
+  else if (spec->cq != NULL && !completion_queue_reserve(spec->cq))
+    status = SUBMIT_QUEUE_FULL;
+  if (status != SUBMIT_OK) {
+    atomic_fetch_add(&pool->rejected_tasks, 1);
+    if (flight != NULL)
+      flight_fail(flight, -1);
+    return status;
+  }
+
+  Task *task = create_task_from_spec(pool, spec);
+  if (task == NULL) {
+    if (spec->cq != NULL)
+      completion_queue_unreserve(spec->cq, 1);
+    if (flight != NULL)
+      flight_fail(flight, -1);
+    return SUBMIT_ERROR;
+  }
+  task->flight = flight;
+  if (memoize) {
+    task->memoize = true;
+    task->memo_key = memo_key;
+  }
+  if (handle != NULL) {
+    atomic_fetch_add(&handle->refs, 1);
+    handle->task_id = task->task_id;
+    task->handle = handle;
+  }
+
+  if (spec->ordering_key != NULL)
+    status = submit_ordered_task(pool, task, spec->ordering_key, timeout_ms);
+  else if (spec->tenant_id != 0)
+    status = submit_tenant_task(pool, task, spec->tenant_id, timeout_ms);
+  else
+    status = dispatch_task(pool, task, -1, timeout_ms);
+  if (status != SUBMIT_OK) {
+    // 提交失败不投递完成记录
+    task->cq = NULL;
+    if (spec->cq != NULL)
+      completion_queue_unreserve(spec->cq, 1);
+    if (flight != NULL) {
+      task->flight = NULL;
+      flight_fail(flight, task->task_id);
     }
+    free_task(task); // 同时释放任务持有的引用
+  }
+  if (status == SUBMIT_QUEUE_FULL)
+    atomic_fetch_add(&pool->rejected_tasks, 1);
+  return status;
+}
+
+SubmitStatus submit_task(ThreadPool *pool, const TaskSpec *spec,
+                         int timeout_ms) {
+  WINTERQ_LOG_DEBUG("--------submit_task----------\n");
+  return submit_task_internal(pool, spec, timeout_ms, NULL);
+}
+
+SubmitStatus submit_task_with_handle(ThreadPool *pool, const TaskSpec *spec,
+                                     int timeout_ms, TaskHandle **handle) {
+  WINTERQ_LOG_DEBUG("--------submit_task_with_handle----------\n");
+  if (handle == NULL)
+    return SUBMIT_ERROR;
+  *handle = NULL;
+
+  TaskHandle *h = (TaskHandle *)calloc(1, sizeof(TaskHandle));
+  if (h == NULL) {
+    WINTERQ_LOG_ERROR("Failed to allocate memory for task handle\n");
+    return SUBMIT_ERROR;
+  }
+  atomic_init(&h->refs, 1);
+  h->task_id = -1;
+  atomic_init(&h->state, TASK_HANDLE_PENDING);
+  atomic_init(&h->cancel, false);
+  atomic_init(&h->thread_data, NULL);
+  h->io.cancel = &h->cancel;
+  pthread_mutex_init(&h->mutex, NULL);
+  pthread_cond_init(&h->done_cond, NULL);
+
+  SubmitStatus status = submit_task_internal(pool, spec, timeout_ms, h);
+  if (status != SUBMIT_OK) {
+    task_handle_release(h);
+    return status;
+  }
+  *handle = h;
+  return SUBMIT_OK;
+}
+
+/**
+ * @brief 记录任务结果并通知等待者，释放任务持有的句柄引用
+ * @param handle 任务句柄
+ * @param result 任务结果
+ */
+static void task_handle_finish(TaskHandle *handle, const TaskResult *result) {
+  pthread_mutex_lock(&handle->mutex);
+  handle->result = *result;
+  atomic_store(&handle->state, TASK_HANDLE_DONE);
+  pthread_cond_broadcast(&handle->done_cond);
+  pthread_mutex_unlock(&handle->mutex);
+  task_handle_release(handle);
+}
+
+int task_handle_id(const TaskHandle *handle) {
+  return handle != NULL ? handle->task_id : -1;
+}
+
+TaskHandleState task_handle_poll(TaskHandle *handle, TaskResult *result) {
+  if (handle == NULL)
+    return TASK_HANDLE_DONE;
+  TaskHandleState state = (TaskHandleState)atomic_load(&handle->state);
+  if (state == TASK_HANDLE_DONE && result != NULL) {
+    pthread_mutex_lock(&handle->mutex);
+    *result = handle->result;
+    pthread_mutex_unlock(&handle->mutex);
+  }
+  return state;
+}
 
-    // 当所有线程都忙碌且任务队列不为空时，增加线程
-    if (idle_count == 0 && pool->queue.size > 0) {
-      // 尝试增加一个线程
-      WINTERQ_LOG_INFO("Increasing thread pool size from %d to %d\n",
-                       total_count, total_count + 1);
-      resize_thread_pool(pool, total_count + 1);
+int task_handle_wait(TaskHandle *handle, int timeout_ms, TaskResult *result) {
+  if (handle == NULL)
+    return -1;
+
+  struct timespec ts;
+  if (timeout_ms > 0) {
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += timeout_ms / 1000;
+    ts.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+    if (ts.tv_nsec >= 1000000000) {
+      ts.tv_sec += 1;
+      ts.tv_nsec -= 1000000000;
     }
+  }
+
+  int rc = 0;
+  pthread_mutex_lock(&handle->mutex);
+  while (atomic_load(&handle->state) != TASK_HANDLE_DONE && rc != ETIMEDOUT) {
+    if (timeout_ms > 0)
+      rc = pthread_cond_timedwait(&handle->done_cond, &handle->mutex, &ts);
+    else
+      pthread_cond_wait(&handle->done_cond, &handle->mutex);
+  }
+  bool done = atomic_load(&handle->state) == TASK_HANDLE_DONE;
+  if (done && result != NULL)
+    *result = handle->result;
+  pthread_mutex_unlock(&handle->mutex);
+
+  return done ? 0 : 1;
+}
+
+bool task_handle_cancel(TaskHandle *handle) {
+  if (handle == NULL || atomic_load(&handle->state) == TASK_HANDLE_DONE)
+    return false;
+
+  atomic_store(&handle->cancel, true);
+
+  // 已经在执行：唤醒执行线程，由它中断脚本并释放上下文；
+  // 还在排队：出队时直接结束
+  ThreadData *thread_data = atomic_load(&handle->thread_data);
+  if (thread_data != NULL) {
+    atomic_store(&thread_data->reap_cancelled, true);
+    worker_send_wakeup(thread_data);
+  }
+  return true;
+}
+
+void task_handle_release(TaskHandle *handle) {
+  if (handle == NULL || atomic_fetch_sub(&handle->refs, 1) != 1)
+    return;
+  pthread_mutex_destroy(&handle->mutex);
+  pthread_cond_destroy(&handle->done_cond);
+  free(handle->io.output);
+  free(handle);
+}
+
+size_t thread_pool_available_slots(ThreadPool *pool) {
+  if (pool == NULL)
+    return 0;
+  long credits = atomic_load(&pool->credits);
+  return credits > 0 ? (size_t)credits : 0;
+}
+
+int add_ordered_script_task_to_pool(ThreadPool *pool, const char *key,
+                                    const char *script,
+                                    void (*callback)(void *),
+                                    void *callback_arg) {
+  WINTERQ_LOG_DEBUG("--------add_ordered_script_task_to_pool----------\n");
+  if (key == NULL || script == NULL)
+    return -1;
+  TaskSpec spec = {
+      .script = script,
+      .callback = callback,
+      .callback_arg = callback_arg,
+      .ordering_key = key,
+  };
+  return add_task_to_pool(pool, &spec);
+}
+
+int add_tenant_script_task_to_pool(ThreadPool *pool, int tenant_id,
+                                   const char *script,
+                                   void (*callback)(void *),
+                                   void *callback_arg) {
+  WINTERQ_LOG_DEBUG("--------add_tenant_script_task_to_pool----------\n");
+  if (tenant_id <= 0 || script == NULL)
+    return -1;
+  TaskSpec spec = {
+      .script = script,
+      .callback = callback,
+      .callback_arg = callback_arg,
+      .tenant_id = tenant_id,
+  };
+  return add_task_to_pool(pool, &spec);
+}
+
+int add_task_to_pool(ThreadPool *pool, const TaskSpec *spec) {
+  WINTERQ_LOG_DEBUG("--------add_task_to_pool----------\n");
+  SubmitStatus status = submit_task(pool, spec, TASK_ENQUEUE_TIMEOUT_MS);
+  if (status == SUBMIT_QUEUE_FULL)
+    WINTERQ_LOG_ERROR("Failed to add task to pool queue\n");
+  if (status == SUBMIT_RATE_LIMITED)
+    return SUBMIT_RATE_LIMITED;
+  return status == SUBMIT_OK ? 0 : -1;
+}
+
+int add_script_task_to_thread(ThreadPool *pool, int thread_id,
+                              const char *script, void (*callback)(void *),
+                              void *callback_arg) {
+  WINTERQ_LOG_DEBUG("--------add_script_task_to_thread----------\n");
+  if (pool == NULL || script == NULL)
+    return -1;
+
+  Task *task = create_script_task(pool, script, callback, callback_arg);
+  if (task == NULL)
+    return -1;
 
-    // 防止调整过于频繁，添加延迟
-    sleep(1);
+  if (dispatch_task(pool, task, thread_id, TASK_ENQUEUE_TIMEOUT_MS) !=
+      SUBMIT_OK) {
+    free_task(task);
+    return -1;
   }
 
-  WINTERQ_LOG_INFO("Pool adjuster thread exiting\n");
-  return NULL;
+  return 0;
 }
 
-/**
- * @brief 创建工作线程
- * @param pool 线程池
- * @param thread_id 线程ID
- * @return 成功返回0，失败返回-1
- */
-static int create_worker_thread(ThreadPool *pool, int thread_id) {
-  WINTERQ_LOG_DEBUG("--------create_worker_thread----------\n");
-  if (pool == NULL || thread_id < 0 || thread_id >= pool->thread_count)
+int add_bytecode_task_to_thread(ThreadPool *pool, int thread_id,
+                                uint8_t *bytecode, size_t bytecode_len,
+                                void (*callback)(void *), void *callback_arg) {
+  WINTERQ_LOG_DEBUG("--------add_bytecode_task_to_thread----------\n");
+  if (pool == NULL || bytecode == NULL || bytecode_len == 0)
     return -1;
 
-  ThreadData *thread_data = &pool->thread_data[thread_id];
-
-  // 初始化线程数据
-  thread_data->thread_id = thread_id;
-  thread_data->pool = pool;
-  thread_data->max_contexts = pool->config.max_contexts;
-  thread_data->runtime = NULL;
-  thread_data->idle_start = 0;
-  atomic_store(&thread_data->idle, true);
-  atomic_store(&thread_data->tasks_processed, 0);
-  atomic_store(&thread_data->idle_time, 0);
-  atomic_store(&thread_data->busy_time, 0);
-
-  // 初始化线程本地队列
-  init_task_queue(&thread_data->local_queue, pool->config.local_queue_size);
+  Task *task = create_bytecode_task(pool, bytecode, bytecode_len, callback,
+                                    callback_arg);
+  if (task == NULL)
+    return -1;
 
-  // 创建线程
-  if (pthread_create(&pool->threads[thread_id], NULL, worker_thread,
-                     thread_data) != 0) {
-    WINTERQ_LOG_ERROR("Failed to create worker thread %d\n", thread_id);
+  if (dispatch_task(pool, task, thread_id, TASK_ENQUEUE_TIMEOUT_MS) !=
+      SUBMIT_OK) {
+    free_task(task);
     return -1;
   }
 
   return 0;
 }
 
-ThreadPool *init_thread_pool(ThreadPoolConfig config) {
-  WINTERQ_LOG_DEBUG("--------init_thread_pool----------\n");
-  ThreadPool *pool = NULL;
-  int i;
-
-  // 参数校验
-  if (config.thread_count <= 0) {
-    WINTERQ_LOG_ERROR("Invalid thread count: %d\n", config.thread_count);
-    return NULL;
+// 批量提交时在任务对工作线程可见之前确定接受数量和任务ID
+typedef struct TaskBatch {
+  ThreadPool *pool;
+  TaskBlock *block;
+  Task *tasks; // 当前这段相同优先级任务的起点
+} TaskBatch;
+
+static void task_batch_before_publish(void *arg, size_t accepted) {
+  TaskBatch *batch = (TaskBatch *)arg;
+  atomic_fetch_add(&batch->block->refs, (int)accepted);
+  int first_id = atomic_fetch_add(&batch->pool->total_tasks, (int)accepted);
+  uint64_t now = winterq_clock_hrtime();
+  for (size_t i = 0; i < accepted; i++) {
+    batch->tasks[i].task_id = first_id + (int)i;
+    batch->tasks[i].enqueue_time = now;
+    if (batch->tasks[i].blob != NULL)
+      script_blob_retain(batch->tasks[i].blob);
+    Worker_RetainSharedBuffer(batch->tasks[i].payload);
   }
+}
 
-  // 分配线程池结构体
-  pool = (ThreadPool *)calloc(1, sizeof(ThreadPool));
-  if (pool == NULL) {
-    WINTERQ_LOG_ERROR("Failed to allocate memory for thread pool\n");
-    return NULL;
+int add_tasks_to_pool_batch(ThreadPool *pool, const TaskSpec *specs,
+                            size_t n) {
+  WINTERQ_LOG_DEBUG("--------add_tasks_to_pool_batch----------\n");
+  if (pool == NULL || specs == NULL)
+    return SUBMIT_ERROR;
+  if (atomic_load(&pool->shutdown))
+    return SUBMIT_SHUTDOWN;
+  if (n == 0)
+    return 0;
+
+  // 计算整块内存大小：块头 + 任务数组 + 任务指针数组 + 脚本/字节码副本
+  size_t header = (sizeof(TaskBlock) + _Alignof(Task) - 1) /
+                  _Alignof(Task) * _Alignof(Task);
+  size_t payload = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (specs[i].ordering_key != NULL || specs[i].tenant_id != 0 ||
+        specs[i].dedup_key != NULL || specs[i].memoize ||
+        specs[i].affinity_key != NULL) {
+      WINTERQ_LOG_ERROR("Ordered, tenant, dedup, memoized or affine task at "
+                        "index %zu: use submit_task\n",
+                        i);
+      return SUBMIT_ERROR;
+    }
+    if (specs[i].blob != NULL) {
+      continue; // 共享内容不复制
+    } else if (specs[i].script != NULL) {
+      payload += strlen(specs[i].script) + 1;
+    } else if (specs[i].bytecode != NULL && specs[i].bytecode_len > 0) {
+      payload += specs[i].bytecode_len;
+    } else {
+      WINTERQ_LOG_ERROR("Invalid task spec at index %zu\n", i);
+      return SUBMIT_ERROR;
+    }
   }
 
-  // 初始化配置
-  pool->config = config;
-  pool->thread_count = config.thread_count;
-  atomic_init(&pool->shutdown, false);
+  // 一次获取所有可用名额，没有名额时不分配内存
+  size_t granted = credits_acquire(pool, n, 0);
+  if (granted < n)
+    atomic_fetch_add(&pool->rejected_tasks, (int)(n - granted));
+  if (granted == 0)
+    return 0;
+  n = granted;
+
+  // 预留完成队列槽位，某个完成队列的槽位用完时只提交前面的任务
+  for (size_t i = 0; i < n; i++) {
+    if (specs[i].cq != NULL && !completion_queue_reserve(specs[i].cq)) {
+      atomic_fetch_add(&pool->rejected_tasks, (int)(n - i));
+      credits_release(pool, n - i);
+      granted = n = i;
+      break;
+    }
+  }
+  if (n == 0)
+    return 0;
 
-  pool->max_tasks = 0;
-  atomic_init(&pool->completed_tasks, 0);
-  atomic_init(&pool->total_tasks, 0);
+  TaskBlock *block = (TaskBlock *)malloc(header + n * sizeof(Task) +
+                                         n * sizeof(Task *) + payload);
+  if (block == NULL) {
+    WINTERQ_LOG_ERROR("Failed to allocate memory for task batch\n");
+    credits_release(pool, granted);
+    for (size_t i = 0; i < n; i++) {
+      if (specs[i].cq != NULL)
+        completion_queue_unreserve(specs[i].cq, 1);
+    }
+    return SUBMIT_ERROR;
+  }
 
-  atomic_init(&pool->idle_thread_count, 0);
-  atomic_init(&pool->adjuster_running, false);
+  Task *tasks = (Task *)((char *)block + header);
+  Task **slots = (Task **)(tasks + n);
+  char *data = (char *)(slots + n);
+
+  for (size_t i = 0; i < n; i++) {
+    Task *task = &tasks[i];
+    memset(task, 0, sizeof(Task));
+    task->block = block;
+    task->priority = task_priority_sanitize(specs[i].priority);
+    task->deadline = specs[i].deadline;
+    task->completion = specs[i].completion;
+    task->callback = specs[i].callback;
+    task->callback_arg = specs[i].callback_arg;
+    task->cq = specs[i].cq;
+    task->payload = specs[i].payload;
+
+    if (specs[i].blob != NULL) {
+      // 引用在确定被接受后才增加（负载同样）
+      task_use_blob(task, specs[i].blob);
+    } else if (specs[i].script != NULL) {
+      size_t len = strlen(specs[i].script) + 1;
+      memcpy(data, specs[i].script, len);
+      task->is_script = 1;
+      task->script = data;
+      data += len;
+    } else {
+      memcpy(data, specs[i].bytecode, specs[i].bytecode_len);
+      task->is_script = 0;
+      task->bytecode = (uint8_t *)data;
+      task->bytecode_len = specs[i].bytecode_len;
+      data += specs[i].bytecode_len;
+    }
+    slots[i] = task;
+  }
 
-  // 初始化互斥锁和条件变量
-  if (pthread_mutex_init(&pool->pool_mutex, NULL) != 0 ||
-      pthread_mutex_init(&pool->wait_mutex, NULL) != 0 ||
-      pthread_mutex_init(&pool->idle_mutex, NULL) != 0 ||
-      pthread_cond_init(&pool->wait_cond, NULL) != 0 ||
-      pthread_cond_init(&pool->idle_cond, NULL) != 0) {
-    WINTERQ_LOG_ERROR("Failed to initialize mutex or condition variable\n");
-    free(pool);
-    return NULL;
+  // 提交期间持有一个引用，避免已接受的任务在循环中执行完并释放整块内存
+  atomic_init(&block->refs, 1);
+
+  // 每段连续的相同优先级任务一次预留，遇到队列满时停止
+  size_t accepted = 0;
+  while (accepted < n) {
+    TaskPriority priority = tasks[accepted].priority;
+    size_t run = 1;
+    while (accepted + run < n && tasks[accepted + run].priority == priority)
+      run++;
+
+    TaskBatch batch = {.pool = pool, .block = block, .tasks = &tasks[accepted]};
+    size_t reserved =
+        global_enqueue_batch(pool, priority, slots + accepted, run,
+                             task_batch_before_publish, &batch);
+    accepted += reserved;
+    if (reserved < run)
+      break;
   }
 
-  // 初始化全局任务队列
-  init_task_queue(&pool->queue, config.global_queue_size);
-
-  // 分配线程数组
-  pool->threads = (pthread_t *)calloc(config.thread_count, sizeof(pthread_t));
-  if (pool->threads == NULL) {
-    WINTERQ_LOG_ERROR("Failed to allocate memory for threads\n");
-    destroy_task_queue(&pool->queue);
-    free(pool);
-    return NULL;
+  // 归还没有用上的名额和完成队列槽位
+  credits_release(pool, granted - accepted);
+  for (size_t i = accepted; i < n; i++) {
+    if (specs[i].cq != NULL)
+      completion_queue_unreserve(specs[i].cq, 1);
   }
 
-  // 分配线程数据数组
-  pool->thread_data =
-      (ThreadData *)calloc(config.thread_count, sizeof(ThreadData));
-  if (pool->thread_data == NULL) {
-    WINTERQ_LOG_ERROR("Failed to allocate memory for thread data\n");
-    free(pool->threads);
-    destroy_task_queue(&pool->queue);
-    free(pool);
-    return NULL;
+  if (atomic_fetch_sub(&block->refs, 1) == 1)
+    free(block); // 没有任务被接受，或者已接受的任务都已执行完
+  if (accepted == 0)
+    return 0;
+  if (accepted < n) {
+    WINTERQ_LOG_WARNING("Pool queue full, accepted %zu of %zu tasks\n",
+                        accepted, n);
   }
 
-  // 创建工作线程
-  for (i = 0; i < config.thread_count; i++) {
-    if (create_worker_thread(pool, i) != 0) {
-      WINTERQ_LOG_ERROR("Failed to create worker thread %d\n", i);
-      // 清理已创建的线程
-      atomic_store(&pool->shutdown, true);
-      for (int j = 0; j < i; j++) {
-        pthread_join(pool->threads[j], NULL);
-      }
-      free(pool->thread_data);
-      free(pool->threads);
-      destroy_task_queue(&pool->queue);
-      free(pool);
-      return NULL;
+  wake_idle_workers(pool, accepted);
+  return (int)accepted;
+}
+
+/**
+ * @brief 释放任务图的一个引用，最后一个引用释放时回收节点、未派发的任务和输出
+ * @param graph 任务图
+ */
+static void graph_release(TaskGraph *graph) {
+  if (atomic_fetch_sub(&graph->refs, 1) != 1)
+    return;
+
+  for (int i = 0; i < graph->node_count; i++) {
+    TaskGraphNode *node = &graph->nodes[i];
+    if (node->task != NULL) {
+      node->task->node = NULL;
+      free_task(node->task);
     }
+    free(node->deps);
+    free(node->succs);
+    free(node->inputs);
+    free(node->io.output);
   }
+  free(graph->nodes);
+  free(graph);
+}
 
-  // 启动调整线程
-  if (config.dynamic_sizing) {
-    atomic_store(&pool->adjuster_running, true);
-    if (pthread_create(&pool->adjuster_thread, NULL, pool_adjuster_thread,
-                       pool) != 0) {
-      WINTERQ_LOG_ERROR("Failed to create pool adjuster thread\n");
-      atomic_store(&pool->adjuster_running, false);
-      // 线程池仍然可以工作，只是没有动态调整功能
-    }
+/**
+ * @brief 所有依赖都已结束的节点：有依赖失败时跳过，否则放入队列
+ *
+ * 放入当前工作线程的本地队列，依赖的输出还在缓存中时接着执行
+ * @param pool 线程池
+ * @param node 就绪的节点
+ * @param share 是否唤醒空闲线程来窃取（同一批就绪的第一个节点留给当前线程）
+ */
+static void graph_node_ready(ThreadPool *pool, TaskGraphNode *node,
+                             bool share) {
+  // 线程池关闭时不再派发，任务随任务图一起释放
+  if (atomic_load(&pool->shutdown))
+    return;
+
+  TaskGraph *graph = node->graph;
+  Task *task = node->task;
+  node->task = NULL;
+  atomic_fetch_add(&graph->refs, 1); // 由 graph_node_finish 释放
+
+  if (atomic_load(&node->dep_failed)) {
+    finish_unexecuted_task(pool, task, TASK_STATUS_SKIPPED);
+    return;
   }
 
-  WINTERQ_LOG_INFO("Thread pool initialized with %d threads\n",
-                   config.thread_count);
-  return pool;
+  // 依赖的输出在任务图释放前不会改变，直接引用
+  for (int i = 0; i < node->dep_count; i++) {
+    const WorkerTaskIO *dep = &graph->nodes[node->deps[i]].io;
+    node->inputs[i] = (WorkerBuffer){dep->output, dep->output_len};
+  }
+  node->io.inputs = node->inputs;
+  node->io.input_count = node->dep_count;
+
+  if (requeue_task(pool, task, share) != 0) {
+    WINTERQ_LOG_ERROR("Dropping graph task %d: queue full\n", task->task_id);
+    task->node = NULL;
+    free_task(task);
+    graph_node_finish(pool, node, TASK_STATUS_FAILED);
+  }
 }
 
 /**
- * @brief 添加脚本任务到线程池
+ * @brief 节点结束：通知后继，最后一个节点结束时调用 on_complete
+ *
+ * 释放节点派发时持有的任务图引用
  * @param pool 线程池
- * @param script JavaScript脚本
- * @param callback 回调函数
- * @param callback_arg 回调函数参数
- * @return 成功返回0，失败返回-1
+ * @param node 结束的节点
+ * @param status 结束状态
  */
-int add_script_task_to_pool(ThreadPool *pool, const char *script,
-                            void (*callback)(void *), void *callback_arg) {
-  WINTERQ_LOG_DEBUG("--------add_script_task_to_pool----------\n");
-  if (pool == NULL || script == NULL)
-    return -1;
+static void graph_node_finish(ThreadPool *pool, TaskGraphNode *node,
+                              TaskStatus status) {
+  TaskGraph *graph = node->graph;
+  node->status = status;
+
+  // 输出在递减计数之前写入，后继就绪时一定能看到
+  bool ok = status == TASK_STATUS_COMPLETED && !node->io.error;
+  int ready = 0;
+  for (int i = 0; i < node->succ_count; i++) {
+    TaskGraphNode *succ = &graph->nodes[node->succs[i]];
+    if (!ok)
+      atomic_store(&succ->dep_failed, true);
+    if (atomic_fetch_sub(&succ->pending, 1) == 1)
+      graph_node_ready(pool, succ, ready++ > 0);
+  }
 
-  // 分配任务结构体
-  Task *task = (Task *)calloc(1, sizeof(Task));
-  if (task == NULL) {
-    WINTERQ_LOG_ERROR("Failed to allocate memory for task\n");
-    return -1;
+  if (atomic_fetch_sub(&graph->remaining, 1) == 1 && graph->on_complete)
+    graph->on_complete(graph, graph->on_complete_arg);
+  graph_release(graph);
+}
+
+TaskGraph *task_graph_create(ThreadPool *pool) {
+  if (pool == NULL)
+    return NULL;
+  TaskGraph *graph = (TaskGraph *)calloc(1, sizeof(TaskGraph));
+  if (graph == NULL) {
+    WINTERQ_LOG_ERROR("Failed to allocate memory for task graph\n");
+    return NULL;
   }
+  graph->pool = pool;
+  atomic_init(&graph->remaining, 0);
+  atomic_init(&graph->refs, 1);
+  return graph;
+}
 
-  // 分配并复制脚本
-  task->script = strdup(script);
-  if (task->script == NULL) {
-    WINTERQ_LOG_ERROR("Failed to allocate memory for script\n");
-    free(task);
+int task_graph_add(TaskGraph *graph, const TaskSpec *spec, const int *deps,
+                   int dep_count) {
+  if (graph == NULL || spec == NULL || graph->submitted || dep_count < 0 ||
+      (dep_count > 0 && deps == NULL))
+    return -1;
+  if (spec->ordering_key != NULL || spec->cq != NULL ||
+      spec->dedup_key != NULL) {
+    WINTERQ_LOG_ERROR("Ordered, deduplicated and completion queue tasks are "
+                      "not supported in task graphs\n");
     return -1;
   }
 
-  // 初始化任务字段
-  task->is_script = 1;
-  task->task_id = atomic_fetch_add(&pool->total_tasks, 1);
-  task->callback = callback;
-  task->callback_arg = callback_arg;
+  int index = graph->node_count;
+  for (int i = 0; i < dep_count; i++) {
+    if (deps[i] < 0 || deps[i] >= index) {
+      WINTERQ_LOG_ERROR("Invalid dependency %d for graph node %d\n", deps[i],
+                        index);
+      return -1;
+    }
+  }
 
-  // 尝试添加到全局队列
-  if (enqueue_task(&pool->queue, task) != 0) {
-    WINTERQ_LOG_ERROR("Failed to add task to pool queue\n");
-    free((void *)task->script);
-    free(task);
-    return -1;
+  if (graph->node_count == graph->node_capacity) {
+    int capacity = graph->node_capacity > 0 ? graph->node_capacity * 2 : 8;
+    TaskGraphNode *nodes = (TaskGraphNode *)realloc(
+        graph->nodes, capacity * sizeof(TaskGraphNode));
+    if (nodes == NULL) {
+      WINTERQ_LOG_ERROR("Failed to allocate memory for graph nodes\n");
+      return -1;
+    }
+    graph->nodes = nodes;
+    graph->node_capacity = capacity;
   }
 
-  return 0;
+  TaskGraphNode *node = &graph->nodes[index];
+  memset(node, 0, sizeof(TaskGraphNode));
+  node->graph = graph;
+  node->dep_count = dep_count;
+  if (dep_count > 0) {
+    node->deps = (int *)malloc(dep_count * sizeof(int));
+    node->inputs = (WorkerBuffer *)calloc(dep_count, sizeof(WorkerBuffer));
+  }
+  node->task = create_task_from_spec(graph->pool, spec);
+  if (node->task == NULL || (dep_count > 0 && (!node->deps || !node->inputs)))
+    goto fail;
+  if (dep_count > 0)
+    memcpy(node->deps, deps, dep_count * sizeof(int));
+
+  // 登记为依赖的后继，失败时撤销已经登记的部分
+  for (int i = 0; i < dep_count; i++) {
+    TaskGraphNode *dep = &graph->nodes[deps[i]];
+    int *succs =
+        (int *)realloc(dep->succs, (dep->succ_count + 1) * sizeof(int));
+    if (succs == NULL) {
+      for (int j = 0; j < i; j++)
+        graph->nodes[deps[j]].succ_count--;
+      goto fail;
+    }
+    succs[dep->succ_count++] = index;
+    dep->succs = succs;
+  }
+
+  graph->node_count++;
+  return index;
+
+fail:
+  WINTERQ_LOG_ERROR("Failed to add graph node %d\n", index);
+  if (node->task != NULL)
+    free_task(node->task);
+  free(node->deps);
+  free(node->inputs);
+  return -1;
 }
 
-/**
- * @brief 添加字节码任务到线程池
- * @param pool 线程池
- * @param bytecode JavaScript字节码
- * @param bytecode_len 字节码长度
- * @param callback 回调函数
- * @param callback_arg 回调函数参数
- * @return 成功返回0，失败返回-1
- */
-int add_bytecode_task_to_pool(ThreadPool *pool, uint8_t *bytecode,
-                              size_t bytecode_len, void (*callback)(void *),
-                              void *callback_arg) {
-  WINTERQ_LOG_DEBUG("--------add_bytecode_task_to_pool----------\n");
-  if (pool == NULL || bytecode == NULL || bytecode_len == 0)
-    return -1;
+SubmitStatus task_graph_submit(TaskGraph *graph,
+                               void (*on_complete)(TaskGraph *graph, void *arg),
+                               void *arg, int timeout_ms) {
+  WINTERQ_LOG_DEBUG("--------task_graph_submit----------\n");
+  if (graph == NULL || graph->submitted || graph->node_count == 0)
+    return SUBMIT_ERROR;
+  ThreadPool *pool = graph->pool;
+  if (atomic_load(&pool->shutdown))
+    return SUBMIT_SHUTDOWN;
+
+  size_t roots = 0;
+  for (int i = 0; i < graph->node_count; i++) {
+    if (graph->nodes[i].dep_count == 0)
+      roots++;
+  }
+  if (roots > pool->queue_capacity) {
+    WINTERQ_LOG_ERROR("Task graph has more roots than queue capacity\n");
+    return SUBMIT_ERROR;
+  }
 
-  // 分配任务结构体
-  Task *task = (Task *)calloc(1, sizeof(Task));
-  if (task == NULL) {
-    WINTERQ_LOG_ERROR("Failed to allocate memory for task\n");
-    return -1;
+  // 没有依赖的节点一次性占用名额，要么全部开始要么都不开始
+  size_t acquired = credits_acquire(pool, roots, timeout_ms);
+  if (acquired < roots) {
+    credits_release(pool, acquired);
+    atomic_fetch_add(&pool->rejected_tasks, 1);
+    return atomic_load(&pool->shutdown) ? SUBMIT_SHUTDOWN : SUBMIT_QUEUE_FULL;
   }
 
-  // 分配并复制字节码
-  task->bytecode = (uint8_t *)malloc(bytecode_len);
-  if (task->bytecode == NULL) {
-    WINTERQ_LOG_ERROR("Failed to allocate memory for bytecode\n");
-    free(task);
-    return -1;
+  graph->submitted = true;
+  graph->on_complete = on_complete;
+  graph->on_complete_arg = arg;
+  atomic_store(&graph->remaining, graph->node_count);
+  for (int i = 0; i < graph->node_count; i++) {
+    TaskGraphNode *node = &graph->nodes[i];
+    atomic_store(&node->pending, node->dep_count);
+    node->task->node = node;
   }
-  memcpy(task->bytecode, bytecode, bytecode_len);
 
-  // 初始化任务字段
-  task->is_script = 0;
-  task->bytecode_len = bytecode_len;
-  task->task_id = atomic_fetch_add(&pool->total_tasks, 1);
-  task->callback = callback;
-  task->callback_arg = callback_arg;
+  for (int i = 0; i < graph->node_count; i++) {
+    TaskGraphNode *node = &graph->nodes[i];
+    if (node->dep_count > 0)
+      continue;
+    Task *task = node->task;
+    node->task = NULL;
+    atomic_fetch_add(&graph->refs, 1);
+    if (global_enqueue(pool, task, 0) != 0) {
+      credits_release(pool, 1);
+      task->node = NULL;
+      free_task(task);
+      graph_node_finish(pool, node, TASK_STATUS_FAILED);
+    }
+  }
 
-  // 尝试添加到全局队列
-  if (enqueue_task(&pool->queue, task) != 0) {
-    WINTERQ_LOG_ERROR("Failed to add task to pool queue\n");
-    free(task->bytecode);
-    free(task);
-    return -1;
+  wake_idle_workers(pool, roots);
+  return SUBMIT_OK;
+}
+
+TaskStatus task_graph_node_status(const TaskGraph *graph, int node) {
+  if (graph == NULL || node < 0 || node >= graph->node_count)
+    return TASK_STATUS_FAILED;
+  return graph->nodes[node].status;
+}
+
+const uint8_t *task_graph_node_output(const TaskGraph *graph, int node,
+                                      size_t *len) {
+  if (graph == NULL || node < 0 || node >= graph->node_count) {
+    if (len != NULL)
+      *len = 0;
+    return NULL;
   }
+  const WorkerTaskIO *io = &graph->nodes[node].io;
+  if (len != NULL)
+    *len = io->output_len;
+  return io->output;
+}
 
-  return 0;
+void task_graph_release(TaskGraph *graph) {
+  if (graph != NULL)
+    graph_release(graph);
 }
 
 // 关闭线程池
@@ -815,37 +4958,64 @@ void shutdown_thread_pool(ThreadPool *pool) {
 
   WINTERQ_LOG_INFO("Shutting down thread pool\n");
 
-  // 设置关闭标志
+  // 设置关闭标志，并唤醒等待名额的提交者
   atomic_store(&pool->shutdown, true);
+  pthread_mutex_lock(&pool->credit_mutex);
+  pthread_cond_broadcast(&pool->credit_cond);
+  pthread_mutex_unlock(&pool->credit_mutex);
+
+  // 唤醒所有工作线程（包括正在缩容退出的线程），使其退出事件循环
+  for (int i = 0; i < pool->max_threads; i++) {
+    if (pool->thread_data[i] != NULL)
+      worker_send_wakeup(pool->thread_data[i]);
+  }
 
   // 停止调整线程
   if (atomic_load(&pool->adjuster_running)) {
+    pthread_mutex_lock(&pool->idle_mutex);
     atomic_store(&pool->adjuster_running, false);
     pthread_cond_signal(&pool->idle_cond);
+    pthread_mutex_unlock(&pool->idle_mutex);
     pthread_join(pool->adjuster_thread, NULL);
   }
 
-  // 等待所有工作线程结束
-  for (int i = 0; i < pool->thread_count; i++) {
-    pthread_join(pool->threads[i], NULL);
-    destroy_task_queue(&pool->thread_data[i].local_queue);
+  // 等待进行中的调整完成，然后等待所有工作线程（包括缩容后尚未回收的）结束
+  pthread_mutex_lock(&pool->resize_mutex);
+  for (int i = 0; i < pool->max_threads; i++) {
+    ThreadData *thread_data = pool->thread_data[i];
+    if (thread_data != NULL && thread_data->joinable) {
+      pthread_join(thread_data->thread, NULL);
+      thread_data->joinable = false;
+    }
   }
+  pthread_mutex_unlock(&pool->resize_mutex);
 
   // 输出线程池统计信息
   WINTERQ_LOG_INFO("Thread pool stats: completed tasks: %d\n",
-                   atomic_load(&pool->completed_tasks));
+                   (int)sum_thread_counters(pool).completed);
 
   // 清理资源
-  destroy_task_queue(&pool->queue);
+  destroy_lanes(pool);
+  destroy_tenants(pool);
+  for (int i = 0; i < pool->max_threads; i++) {
+    if (pool->thread_data[i] != NULL)
+      destroy_thread_slot(pool->thread_data[i]);
+  }
+  destroy_global_queues(pool);
+  destroy_flights(pool); // 排队中的任务释放时已经删除了它们的记录
+  destroy_memo_cache(pool);
+  destroy_cpu_placement(pool);
   free(pool->thread_data);
-  free(pool->threads);
 
   // 销毁同步原语
   pthread_mutex_destroy(&pool->pool_mutex);
   pthread_mutex_destroy(&pool->wait_mutex);
   pthread_mutex_destroy(&pool->idle_mutex);
+  pthread_mutex_destroy(&pool->resize_mutex);
   pthread_cond_destroy(&pool->wait_cond);
   pthread_cond_destroy(&pool->idle_cond);
+  pthread_mutex_destroy(&pool->credit_mutex);
+  pthread_cond_destroy(&pool->credit_cond);
 
   free(pool);
 
@@ -865,39 +5035,78 @@ ThreadPoolStats get_thread_pool_stats(ThreadPool *pool) {
     return stats;
   }
 
-  // 锁定线程池
-  pthread_mutex_lock(&pool->pool_mutex);
+  // 不加锁：各计数器独立读取，结果是近似的快照
+  PoolCounters counters = sum_thread_counters(pool);
 
   // 收集基本统计信息
-  stats.active_threads =
-      pool->thread_count - atomic_load(&pool->idle_thread_count);
-  stats.idle_threads = atomic_load(&pool->idle_thread_count);
-  stats.queued_tasks = pool->queue.size;
-  stats.completed_tasks = atomic_load(&pool->completed_tasks);
-
-  // 计算平均执行时间和等待时间
-  double total_exec_time = 0.0;
-  double total_idle_time = 0.0;
-  double total_busy_time = 0.0;
-
-  for (int i = 0; i < pool->thread_count; i++) {
-    total_idle_time += atomic_load(&pool->thread_data[i].idle_time);
-    total_busy_time += atomic_load(&pool->thread_data[i].busy_time);
+  int idle_count = atomic_load(&pool->idle_thread_count);
+  int thread_count = pool->thread_count;
+  stats.active_threads = thread_count > idle_count ? thread_count - idle_count
+                                                   : 0;
+  stats.idle_threads = idle_count;
+  stats.queued_tasks = (int)global_queue_size(pool);
+  stats.completed_tasks = (int)counters.completed;
+
+  // 按优先级统计排队数和平均等待时间
+  uint64_t total_dequeued = 0;
+  uint64_t total_wait_ns = 0;
+  for (int i = 0; i < TASK_PRIORITY_COUNT; i++) {
+    uint64_t dequeued = counters.dequeued[i];
+    uint64_t wait_ns = counters.wait_ns[i];
+    stats.queued_by_priority[i] = (int)global_queue_class_size(pool, i);
+    if (dequeued > 0)
+      stats.avg_wait_time_by_priority[i] = (double)wait_ns / dequeued / 1e6;
+    total_dequeued += dequeued;
+    total_wait_ns += wait_ns;
+  }
+  if (total_dequeued > 0)
+    stats.avg_wait_time = (double)total_wait_ns / total_dequeued / 1e6;
+  stats.shed_tasks = atomic_load(&pool->shed_tasks);
+  stats.late_tasks = atomic_load(&pool->late_tasks);
+  stats.cancelled_tasks = atomic_load(&pool->cancelled_tasks);
+  stats.available_slots = (int)thread_pool_available_slots(pool);
+  stats.rejected_tasks = atomic_load(&pool->rejected_tasks);
+  stats.rate_limited_tasks = atomic_load(&pool->rate_limited_tasks);
+  stats.active_lanes = atomic_load(&pool->active_lanes);
+  stats.active_flights = atomic_load(&pool->active_flights);
+  stats.coalesced_tasks = atomic_load(&pool->coalesced_tasks);
+  stats.memo_hits = atomic_load(&pool->memo_hits);
+  stats.memo_misses = atomic_load(&pool->memo_misses);
+  if (stats.memo_hits + stats.memo_misses > 0)
+    stats.memo_hit_rate = (double)stats.memo_hits /
+                          (stats.memo_hits + stats.memo_misses) * 100.0;
+  if (pool->memo_shards != NULL) {
+    for (int i = 0; i < MEMO_CACHE_SHARDS; i++) {
+      stats.memo_bytes += atomic_load_explicit(&pool->memo_shards[i].bytes,
+                                               memory_order_relaxed);
+      stats.memo_entries += atomic_load_explicit(
+          &pool->memo_shards[i].entries, memory_order_relaxed);
+    }
   }
+  stats.affinity_hits = (int)counters.affinity_hits;
+  stats.affinity_misses = (int)counters.affinity_misses;
+  if (counters.affinity_hits + counters.affinity_misses > 0)
+    stats.affinity_hit_rate =
+        (double)counters.affinity_hits /
+        (counters.affinity_hits + counters.affinity_misses) * 100.0;
+  stats.spin_hits = (int)counters.idle_hits[WORKER_IDLE_STAGE_SPIN];
+  stats.yield_hits = (int)counters.idle_hits[WORKER_IDLE_STAGE_YIELD];
+  stats.park_hits = (int)counters.idle_hits[WORKER_IDLE_STAGE_PARK];
 
   // 计算线程利用率
+  double total_idle_time = (double)counters.idle_time;
+  double total_busy_time = (double)counters.busy_time;
   if (total_idle_time + total_busy_time > 0) {
     stats.thread_utilization =
         (total_busy_time / (total_idle_time + total_busy_time)) * 100.0;
   }
 
   // 计算平均执行时间
-  if (stats.completed_tasks > 0) {
-    stats.avg_execution_time = total_exec_time / stats.completed_tasks;
+  if (counters.completed > 0) {
+    stats.avg_execution_time =
+        (double)counters.exec_time / counters.completed / 1e6;
   }
 
-  pthread_mutex_unlock(&pool->pool_mutex);
-
   return stats;
 }
 
@@ -929,7 +5138,7 @@ int wait_for_idle(ThreadPool *pool, int timeout_ms) {
   pthread_mutex_lock(&pool->wait_mutex);
 
   // 当还有未完成的任务时等待
-  while (pool->queue.size > 0 ||
+  while (global_queue_size(pool) > 0 ||
          atomic_load(&pool->idle_thread_count) < pool->thread_count) {
     if (timeout_ms > 0) {
       // 带超时的等待
@@ -960,77 +5169,107 @@ int resize_thread_pool(ThreadPool *pool, int new_thread_count) {
   if (pool == NULL || new_thread_count <= 0) {
     return -1;
   }
+  if (new_thread_count > pool->max_threads) {
+    WINTERQ_LOG_ERROR("Thread count %d exceeds max_threads %d\n",
+                      new_thread_count, pool->max_threads);
+    return -1;
+  }
 
-  pthread_mutex_lock(&pool->pool_mutex);
+  pthread_mutex_lock(&pool->resize_mutex);
+  if (atomic_load(&pool->shutdown)) {
+    pthread_mutex_unlock(&pool->resize_mutex);
+    return -1;
+  }
 
+  reap_retired_threads(pool);
   int current_count = pool->thread_count;
 
   if (new_thread_count == current_count) {
     // 无需调整
-    pthread_mutex_unlock(&pool->pool_mutex);
+    pthread_mutex_unlock(&pool->resize_mutex);
     return 0;
   }
 
   if (new_thread_count > current_count) {
-    // 增加线程
-    pthread_t *new_threads = (pthread_t *)realloc(
-        pool->threads, new_thread_count * sizeof(pthread_t));
-    ThreadData *new_thread_data = (ThreadData *)realloc(
-        pool->thread_data, new_thread_count * sizeof(ThreadData));
-
-    if (new_threads == NULL || new_thread_data == NULL) {
-      WINTERQ_LOG_ERROR("Failed to allocate memory for additional threads\n");
-      pthread_mutex_unlock(&pool->pool_mutex);
-      return -1;
-    }
-
-    pool->threads = new_threads;
-    pool->thread_data = new_thread_data;
-
-    // 创建新线程
+    // 增加线程：槽位创建完成后再计入线程数，其他线程才会访问它
     for (int i = current_count; i < new_thread_count; i++) {
+      ThreadData *thread_data = pool->thread_data[i];
+      if (thread_data != NULL && thread_data->joinable) {
+        if (revive_retiring_thread(pool, thread_data)) {
+          atomic_store(&pool->thread_count, i + 1);
+          continue;
+        }
+        // 已经确定退出的线程没有存活的上下文，很快结束，回收后复用槽位
+        pthread_join(thread_data->thread, NULL);
+        thread_data->joinable = false;
+        migrate_thread_tasks(pool, thread_data);
+      }
       if (create_worker_thread(pool, i) != 0) {
         WINTERQ_LOG_ERROR("Failed to create new worker thread %d\n", i);
-        // 回滚到原始大小
-        pool->thread_count = current_count;
-        pthread_mutex_unlock(&pool->pool_mutex);
+        // 保留已经创建的线程
+        pthread_mutex_unlock(&pool->resize_mutex);
         return -1;
       }
+      atomic_store(&pool->thread_count, i + 1);
     }
-
-    // 更新线程计数
-    pool->thread_count = new_thread_count;
   } else {
-    // 减少线程（这里实现更复杂，需要安全地移除线程）
-
-    // 1. 标记需要退出的线程
-    for (int i = new_thread_count; i < current_count; i++) {
-      // 使用一个特殊标记来通知线程退出
-      pool->thread_data[i].thread_id = -1; // 负值表示线程应当退出
-    }
-
+    // 减少线程：先从线程数中移除，不再接收指定线程的任务，也不再被唤醒
+    pthread_mutex_lock(&pool->pool_mutex);
+    atomic_store(&pool->thread_count, new_thread_count);
     pthread_mutex_unlock(&pool->pool_mutex);
 
-    // 2. 等待这些线程完成
+    // 通知被移除的线程退出，它们会交出本地队列和收件箱中的任务；
+    // 不等待它们退出，已经开始的上下文（例如 setInterval）可能一直不结束。
+    // 退出的线程在之后的调整或关闭时回收，槽位和队列保留，之后扩容时复用
     for (int i = new_thread_count; i < current_count; i++) {
-      pthread_join(pool->threads[i], NULL);
-      destroy_task_queue(&pool->thread_data[i].local_queue);
+      ThreadData *thread_data = pool->thread_data[i];
+      atomic_store(&thread_data->retiring, true);
+      worker_send_wakeup(thread_data);
     }
+  }
 
-    pthread_mutex_lock(&pool->pool_mutex);
+  pthread_mutex_unlock(&pool->resize_mutex);
 
-    // 3. 更新线程计数
-    pool->thread_count = new_thread_count;
+  WINTERQ_LOG_INFO("Thread pool resized from %d to %d threads\n", current_count,
+                   new_thread_count);
+  return 0;
+}
 
-    // 注意：我们不释放线程数组和线程数据数组，因为这会使内存管理复杂化
-    // 在下一次增加线程池大小时，我们会重用这些空间
+/**
+ * @brief 回收缩容后已经退出的线程，调用方持有 resize_mutex
+ * @param pool 线程池
+ */
+static void reap_retired_threads(ThreadPool *pool) {
+  for (int i = pool->thread_count; i < pool->max_threads; i++) {
+    ThreadData *thread_data = pool->thread_data[i];
+    if (thread_data == NULL || !thread_data->joinable ||
+        !atomic_load(&thread_data->exited))
+      continue;
+    pthread_join(thread_data->thread, NULL);
+    thread_data->joinable = false;
+    // 退出后才投递到收件箱的任务，由这里转移到全局队列
+    migrate_thread_tasks(pool, thread_data);
   }
+}
 
+/**
+ * @brief 扩容时重新启用还在等待上下文结束的退出中线程
+ * @param pool 线程池
+ * @param thread_data 缩容时被移除、尚未回收的线程
+ * @return 重新启用返回true；线程已经确定退出返回false，由调用方回收
+ */
+static bool revive_retiring_thread(ThreadPool *pool, ThreadData *thread_data) {
+  pthread_mutex_lock(&pool->pool_mutex);
+  bool revived = !thread_data->exiting;
+  if (revived)
+    atomic_store(&thread_data->retiring, false);
   pthread_mutex_unlock(&pool->pool_mutex);
 
-  WINTERQ_LOG_INFO("Thread pool resized from %d to %d threads\n", current_count,
-                   new_thread_count);
-  return 0;
+  if (revived) {
+    WINTERQ_LOG_INFO("Worker thread %d revived\n", thread_data->thread_id);
+    worker_send_wakeup(thread_data);
+  }
+  return revived;
 }
 
 /**
@@ -1048,7 +5287,7 @@ int get_thread_stats(ThreadPool *pool, int thread_id, ThreadData *stats) {
   }
 
   // 复制线程数据
-  memcpy(stats, &pool->thread_data[thread_id], sizeof(ThreadData));
+  memcpy(stats, pool->thread_data[thread_id], sizeof(ThreadData));
 
   return 0;
 }
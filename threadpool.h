@@ -4,14 +4,99 @@
 #include <pthread.h>
 #include <stdatomic.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "runtime.h"
 
+/**
+ * @brief 不可变、引用计数的脚本或字节码缓冲区
+ *
+ * 注册一次后可以被任意多个任务引用，提交任务只增加引用计数而不复制内容；
+ * 最后一个引用（包括创建者持有的引用）释放时回收内存
+ */
+typedef struct ScriptBlob {
+  atomic_int refs; // 引用计数
+  bool is_script;  // true 表示脚本字符串（以 '\0' 结尾），false 表示字节码
+  size_t len;      // 内容长度（脚本不含结尾的 '\0'）
+  // 内容不可变：结果缓存使用的内容哈希在第一次用到时计算并保存
+  atomic_uint_least64_t memo_hash;
+  atomic_bool memo_hashed;
+  uint8_t data[]; // 内容
+} ScriptBlob;
+
+/**
+ * @brief 任务优先级
+ *
+ * 0 为默认的 NORMAL，便于零初始化的 TaskSpec 使用默认优先级；
+ * 出队顺序为 HIGH > NORMAL > LOW，低优先级等待过久时通过老化提前执行
+ */
+typedef enum TaskPriority {
+  TASK_PRIORITY_NORMAL = 0, // 普通任务
+  TASK_PRIORITY_HIGH,       // 交互式请求，优先执行
+  TASK_PRIORITY_LOW,        // 批处理任务
+  TASK_PRIORITY_COUNT
+} TaskPriority;
+
+// 低优先级队列超过这个时间(毫秒)没有被服务时提前执行一个任务，防止饿死
+#define TASK_PRIORITY_AGING_MS 50
+
+/**
+ * @brief 提交任务的结果
+ */
+typedef enum SubmitStatus {
+  SUBMIT_OK = 0,           // 已接受
+  SUBMIT_ERROR = -1,       // 参数错误或内存不足
+  SUBMIT_QUEUE_FULL = -2,  // 队列已满（背压），可以稍后重试
+  SUBMIT_SHUTDOWN = -3,    // 线程池正在关闭
+  SUBMIT_RATE_LIMITED = -4, // 租户超过提交速率限制，在分配任务之前拒绝
+} SubmitStatus;
+
+/**
+ * @brief 任务结束状态
+ */
+typedef enum TaskStatus {
+  TASK_STATUS_COMPLETED = 0, // 脚本已执行完毕（包括脚本抛出异常）
+  TASK_STATUS_FAILED,        // 未能开始执行（例如无法创建上下文）
+  TASK_STATUS_EXPIRED,       // 出队时已超过截止时间，未执行
+  TASK_STATUS_SKIPPED,       // 任务图中有依赖未成功完成，未执行
+  TASK_STATUS_CANCELLED,     // 被取消：出队时未执行，或执行被中断
+} TaskStatus;
+
+/**
+ * @brief 结果缓存的键
+ *
+ * 哈希是进程内随机密钥的 SipHash-2-4，不能从外部构造碰撞；查找时同时比较长度
+ */
+typedef struct MemoKey {
+  uint64_t code_hash;  // 脚本或字节码内容（含类型）的哈希
+  uint64_t input_hash; // 输入负载及其内容类型的哈希
+  size_t code_len;     // 脚本或字节码长度
+  size_t input_len;    // 输入负载长度
+} MemoKey;
+
+/**
+ * @brief 传给任务完成函数的结果
+ */
+typedef struct TaskResult {
+  int task_id;           // 任务唯一 id
+  TaskStatus status;     // 结束状态
+  bool late;             // 是否在截止时间之后才完成
+  double execution_time; // 执行时间(秒)，未执行时为 0
+
+  // 脚本通过 winterq.setOutput 设置的输出，只在完成函数调用期间有效；
+  // 投递到完成队列的任务输出由 TaskCompletion.output 持有
+  const uint8_t *output;
+  size_t output_len;
+} TaskResult;
+
 /**
  * @brief 表示一个将要执行的JavaScript任务
  */
 typedef struct Task {
-  int task_id; // 任务唯一 id
+  int task_id;           // 任务唯一 id
+  TaskPriority priority; // 优先级
+  uint64_t enqueue_time; // 进入全局队列的时间(单调时钟纳秒)
+  uint64_t deadline; // 绝对截止时间(winterq_clock_hrtime 纳秒)，0 表示没有
 
   // JavaScript源代码或字节码(二选一)
   bool is_script;      // true 表示是脚本字符串，false 表示是字节码
@@ -25,61 +110,562 @@ typedef struct Task {
   // 回调机制
   void (*callback)(void *); // 任务完成后的回调函数
   void *callback_arg;       // 回调函数的参数
+  // 带结果的完成函数，设置时代替 callback 调用，参数为 callback_arg
+  void (*completion)(const TaskResult *result, void *arg);
+
+  struct TaskBlock *block; // 批量提交时所属的内存块，NULL 表示单独分配
+  ScriptBlob *blob; // 引用的共享脚本/字节码，非NULL时 script/bytecode 指向其内容
+
+  struct KeyLane *lane;   // 所属的按键串行通道，NULL 表示不需要排序
+  struct Task *lane_next; // 通道中等待的下一个任务
+
+  struct TaskGraphNode *node; // 所属的任务图节点，NULL 表示独立任务
+  struct TaskHandle *handle;  // 提交时返回给调用方的句柄，NULL 表示没有
+  struct CompletionQueue *cq; // 结束时投递完成记录的队列，NULL 表示调用回调
+  WorkerSharedBuffer *payload; // 输入负载的引用，NULL 表示没有
+
+  // 亲和路由：affinity_key_hash 为亲和键的哈希，0 表示按脚本标识计算；
+  // 按亲和路由过的任务记录首选线程，执行时统计命中率
+  uint32_t affinity_key_hash;
+  bool affine;         // 是否按亲和路由过
+  int affinity_thread; // 首选线程ID
+
+  struct Tenant *tenant;    // 所属租户，NULL 表示不参与公平调度
+  struct Task *tenant_next; // 租户队列中的下一个任务
+
+  struct FlightEntry *flight; // 去重键对应的执行记录，NULL 表示不去重
+
+  bool memoize;         // 成功结束后是否把输出写入结果缓存
+  MemoKey memo_key;     // 结果缓存的键
 } Task;
 
 /**
- * @brief 任务队列节点，用于链表实现的任务队列
+ * @brief 批量提交时一次分配的内存块，包含所有任务及其脚本/字节码副本
+ *
+ * 每个被接受的任务持有一个引用，最后一个任务释放时整块释放
  */
-typedef struct TaskNode {
+typedef struct TaskBlock {
+  atomic_int refs; // 尚未释放的任务数
+} TaskBlock;
+
+/**
+ * @brief 批量提交的任务描述，blob、script 与 bytecode 三选一
+ */
+typedef struct TaskSpec {
+  ScriptBlob *blob;         // 共享脚本/字节码，非NULL时只增加引用计数不复制
+  const char *script;       // JavaScript源代码，非NULL时为脚本任务
+  const uint8_t *bytecode;  // JavaScript字节码
+  size_t bytecode_len;      // 字节码长度
+  void (*callback)(void *); // 任务完成后的回调函数
+  void *callback_arg;       // 回调函数的参数
+  TaskPriority priority;    // 优先级，默认 TASK_PRIORITY_NORMAL
+
+  // 绝对截止时间(winterq_clock_hrtime 纳秒)，0 表示没有；
+  // 出队时已过期的任务不会执行：设置了 completion 时以 TASK_STATUS_EXPIRED
+  // 快速失败，否则直接丢弃
+  uint64_t deadline;
+  // 带结果的完成函数，设置时代替 callback 调用
+  void (*completion)(const TaskResult *result, void *arg);
+
+  // 排序键，非NULL时同一个键的任务按提交顺序逐个执行（前一个任务的回调返回后
+  // 才开始下一个），不同键之间并行；批量提交不支持
+  const char *ordering_key;
+
+  // 完成队列，非NULL时任务结束后向它投递完成记录（包括 winterq.setOutput 的输出），
+  // 不再在工作线程上调用 callback 和 completion；提交时占用队列的一个槽位
+  struct CompletionQueue *cq;
+
+  // 输入负载，非NULL时任务持有一个引用，脚本通过 winterq.payload 不复制地访问
+  WorkerSharedBuffer *payload;
+
+  // 亲和键（例如租户），config.affinity_routing 时同一个键的任务优先由同一个线程执行；
+  // NULL 表示按脚本标识（共享脚本的地址，或脚本/字节码内容）路由；批量提交不支持
+  const char *affinity_key;
+
+  // 租户ID（1 ~ TASK_MAX_TENANTS-1），非0时任务先进入租户队列，按权重轮询放出到
+  // 工作队列；0 表示不属于任何租户。不能与 ordering_key 同时使用，批量提交不支持
+  int tenant_id;
+
+  // 去重键，非NULL时同一个键的任务在排队或执行期间，后续提交不再创建任务，
+  // 而是附加到已有的任务上，结束时以相同的结果调用各自的 callback/completion。
+  // 只用于幂等任务；不能与 ordering_key、cq 或任务句柄同时使用，批量提交不支持
+  const char *dedup_key;
+
+  // 脚本是 (脚本, payload) 的确定性函数时设置：config.memo_cache_bytes 非0时，
+  // 缓存命中直接在提交路径上以缓存的输出调用 completion/callback，不经过工作线程；
+  // 命中时 TaskResult.task_id 为 -1。未命中时执行，成功结束（没有抛出异常）后缓存输出。
+  // 不能与 cq 或任务句柄同时使用，批量提交不支持
+  bool memoize;
+} TaskSpec;
+
+/**
+ * @brief 按键串行执行的通道
+ *
+ * 通道存在即表示该键有一个任务在执行（或在队列中），后续任务挂在通道上等待；
+ * 任务结束时放出下一个，没有等待的任务时通道被删除
+ */
+typedef struct KeyLane {
+  struct KeyLane *next; // 同一个桶中的下一个通道
+  uint64_t hash;        // 键的哈希
+  Task *head;           // 等待中的第一个任务
+  Task *tail;           // 等待中的最后一个任务
+  char key[];           // 排序键
+} KeyLane;
+
+// 排序通道哈希表的桶数，每个桶一把锁
+#define TASK_LANE_BUCKETS 256
+
+typedef struct LaneBucket {
+  pthread_mutex_t mutex; // 保护本桶的通道链表
+  KeyLane *lanes;        // 通道链表
+} LaneBucket;
+
+/**
+ * @brief 附加到同一个去重键上的后续提交
+ */
+typedef struct FlightWaiter {
+  struct FlightWaiter *next; // 下一个附加的提交
+  void (*callback)(void *);  // 任务完成后的回调函数
+  void (*completion)(const TaskResult *result, void *arg); // 带结果的完成函数
+  void *callback_arg;        // 回调函数的参数
+} FlightWaiter;
+
+/**
+ * @brief 去重键对应的执行记录
+ *
+ * 第一个提交创建任务并登记记录，任务结束前同一个键的提交都附加到记录上；
+ * 任务结束时记录从表中删除，附加的提交收到相同的结果
+ */
+typedef struct FlightEntry {
+  struct FlightEntry *next; // 同一个桶中的下一个记录
+  struct ThreadPool *pool;  // 所属线程池
+  uint64_t hash;            // 键的哈希
+  FlightWaiter *waiters;    // 附加的提交，按提交顺序
+  FlightWaiter *waiters_tail;
+  char key[];               // 去重键
+} FlightEntry;
+
+// 去重表的桶数，每个桶一把锁
+#define TASK_FLIGHT_BUCKETS 256
+
+typedef struct FlightBucket {
+  pthread_mutex_t mutex; // 保护本桶的记录链表
+  FlightEntry *entries;  // 记录链表
+} FlightBucket;
+
+/**
+ * @brief 结果缓存条目
+ *
+ * 缓存持有一个引用，命中的提交在调用完成函数期间持有一个引用，
+ * 条目被淘汰后最后一个引用释放时回收
+ */
+typedef struct MemoEntry {
+  struct MemoEntry *next;     // 同一个桶中的下一个条目
+  struct MemoEntry *lru_prev; // 更近使用的条目
+  struct MemoEntry *lru_next; // 更久未使用的条目
+  atomic_int refs;            // 引用计数
+  MemoKey key;                // 键
+  uint64_t expires;           // 过期时间(单调时钟纳秒)，0表示不过期
+  size_t size;                // 占用的字节数，计入字节预算
+  size_t output_len;          // 输出长度
+  uint8_t output[];           // 脚本的输出
+} MemoEntry;
+
+// 结果缓存的分片数和每个分片的桶数
+#define MEMO_CACHE_SHARDS 16
+#define MEMO_SHARD_BUCKETS 256
+
+typedef struct MemoShard {
+  pthread_mutex_t mutex;                  // 保护本分片
+  MemoEntry *buckets[MEMO_SHARD_BUCKETS]; // 按键哈希的桶
+  MemoEntry *lru_head;                    // 最近使用的条目
+  MemoEntry *lru_tail;                    // 最久未使用的条目，优先淘汰
+  atomic_size_t bytes;                    // 已用字节数，只在持锁时修改
+  atomic_size_t entries;                  // 条目数，只在持锁时修改
+} MemoShard;
+
+// 租户ID上限，租户ID范围为 1 ~ TASK_MAX_TENANTS-1
+#define TASK_MAX_TENANTS 256
+
+/**
+ * @brief 公平调度的租户
+ *
+ * 租户的任务先在租户队列中等待，调度器按加权轮询（单位代价的 deficit round robin）
+ * 放出到工作队列；放出而未结束的任务总数不超过线程池的窗口，
+ * 突发提交的租户只会积压在自己的队列中。所有字段由 tenant_mutex 保护
+ */
+typedef struct Tenant {
+  int id;            // 租户ID
+  int weight;        // 权重，每轮最多放出的任务数
+  int max_in_flight; // 最多同时放出（排队或执行中）的任务数，0表示不限
+  int deficit;       // 本轮剩余额度
+  bool active;       // 是否在轮询链表中
+  struct Tenant *next_active; // 轮询链表中的下一个租户
+
+  Task *head;    // 等待放出的第一个任务
+  Task *tail;    // 等待放出的最后一个任务
+  int queued;    // 等待放出的任务数
+  int in_flight; // 已放出尚未结束的任务数
+
+  // 统计
+  uint64_t created;   // 创建时间(单调时钟纳秒)
+  uint64_t released;  // 已放出的任务数
+  uint64_t completed; // 已结束的任务数
+  uint64_t wait_ns;   // 放出的任务在租户队列中的累计等待时间(纳秒)
+} Tenant;
+
+/**
+ * @brief 单个租户的统计信息
+ */
+typedef struct TenantStats {
+  int weight;           // 权重
+  int max_in_flight;    // 同时放出的任务数上限，0表示不限
+  int queued;           // 租户队列中等待的任务数
+  int in_flight;        // 已放出尚未结束的任务数
+  uint64_t completed;   // 已结束的任务数
+  double throughput;    // 创建以来平均每秒结束的任务数
+  double avg_wait_time; // 在租户队列中的平均等待时间(毫秒)
+  uint64_t rate_limited; // 因超过提交速率被拒绝的次数
+} TenantStats;
+
+/**
+ * @brief 任务句柄的状态
+ */
+typedef enum TaskHandleState {
+  TASK_HANDLE_PENDING = 0, // 在队列中等待
+  TASK_HANDLE_RUNNING,     // 已经开始执行
+  TASK_HANDLE_DONE,        // 已经结束，结果可用
+} TaskHandleState;
+
+/**
+ * @brief 提交任务时返回的句柄，用于取消、轮询和等待单个任务
+ *
+ * 调用方持有一个引用，任务持有一个引用，都释放后回收
+ */
+typedef struct TaskHandle {
+  atomic_int refs;   // 引用计数
+  int task_id;       // 任务唯一 id
+  atomic_int state;  // TaskHandleState
+  atomic_bool cancel; // 是否已请求取消
+  struct ThreadData *_Atomic thread_data; // 执行任务的线程，开始执行前为 NULL
+  WorkerTaskIO io;   // 把取消标志传给运行时，用于中断执行
+  TaskResult result; // state 为 TASK_HANDLE_DONE 后有效
+
+  pthread_mutex_t mutex;     // 仅用于条件变量
+  pthread_cond_t done_cond;  // 任务结束时通知
+} TaskHandle;
+
+/**
+ * @brief 任务图中的一个节点
+ *
+ * 所有依赖完成后节点就绪，依赖的输出按声明顺序作为它的输入
+ */
+typedef struct TaskGraphNode {
+  struct TaskGraph *graph; // 所属的任务图
+  Task *task;              // 尚未派发的任务，派发后为 NULL
+  int *deps;               // 依赖的节点下标
+  int dep_count;           // 依赖数
+  int *succs;              // 后继节点下标
+  int succ_count;          // 后继数
+  atomic_int pending;      // 尚未结束的依赖数
+  atomic_bool dep_failed;  // 是否有依赖未成功完成
+  WorkerBuffer *inputs;    // 依赖输出的视图，就绪时填充
+  WorkerTaskIO io;         // 输入输出，输出保留到任务图释放
+  TaskStatus status;       // 结束状态
+} TaskGraphNode;
+
+/**
+ * @brief 有依赖关系的一组任务（有向无环图）
+ *
+ * 节点只能依赖先添加的节点，因此不会成环；提交后不能再添加节点。
+ * 调用方持有一个引用，每个派发出去的任务持有一个引用
+ */
+typedef struct TaskGraph {
+  struct ThreadPool *pool; // 所属线程池
+  TaskGraphNode *nodes;    // 节点数组
+  int node_count;          // 节点数
+  int node_capacity;       // 节点数组容量
+  bool submitted;          // 是否已经提交
+  atomic_int remaining;    // 尚未结束的节点数
+  atomic_int refs;         // 引用计数
+
+  // 所有节点结束后在最后一个结束的节点所在的工作线程上调用
+  void (*on_complete)(struct TaskGraph *graph, void *arg);
+  void *on_complete_arg;
+} TaskGraph;
+
+// 缓存行大小，用于隔离被不同线程频繁写入的字段
+#define THREADPOOL_CACHE_LINE 64
+
+/**
+ * @brief 无锁令牌桶，按 GCRA（理论到达时间）实现
+ *
+ * 每个令牌对应 interval 纳秒，桶满时允许连续提交 burst 个；
+ * 状态只有一个理论到达时间，提交时用 CAS 推进，不需要锁。
+ * interval 和 tolerance 可以在运行时修改，修改期间的个别判断可能混用新旧参数
+ */
+typedef struct TokenBucket {
+  _Alignas(THREADPOOL_CACHE_LINE) atomic_uint_least64_t tat; // 理论到达时间(纳秒)
+  atomic_uint_least64_t interval;  // 补充一个令牌的间隔(纳秒)，0表示不限速
+  atomic_uint_least64_t tolerance; // 突发容忍时间，(burst - 1) * interval
+  atomic_uint_least64_t rejected;  // 因超过速率被拒绝的提交次数
+} TokenBucket;
+
+// global_queue_size 为 0 时全局环形队列的默认容量
+#define TASK_RING_DEFAULT_CAPACITY 4096
+
+// local_queue_size 为 0 时线程本地队列和收件箱的默认容量
+#define TASK_DEQUE_DEFAULT_CAPACITY 256
+
+/**
+ * @brief 环形队列槽位，sequence 表示槽位当前可被哪一轮的生产者/消费者使用
+ */
+typedef struct TaskRingCell {
+  atomic_size_t sequence;
   Task *task;
-  struct TaskNode *next;
-} TaskNode;
+} TaskRingCell;
 
 /**
- * @brief 线程安全的任务队列
+ * @brief 无锁有界多生产者多消费者环形队列（Vyukov MPMC）
+ *
+ * 容量为 2 的幂，入队和出队都不分配内存；队列满时的阻塞等待由
+ * not_full 条件变量实现，只在有生产者等待时消费者才会加锁通知
  */
-typedef struct TaskQueue {
-  TaskNode *head;  // 队列头
-  TaskNode *tail;  // 队列尾
-  int size;        // 队列中任务数量
-  size_t max_size; // 队列最大容量，0表示无限制
+typedef struct TaskRing {
+  TaskRingCell *cells; // 槽位数组
+  size_t mask;         // 容量 - 1
+  size_t capacity;     // 容量（2 的幂）
 
-  // 同步机制
-  pthread_mutex_t mutex;    // 队列互斥锁
-  pthread_cond_t not_empty; // 队列非空条件变量
+  char pad0[THREADPOOL_CACHE_LINE];
+  atomic_size_t enqueue_pos; // 生产者位置
+  char pad1[THREADPOOL_CACHE_LINE - sizeof(atomic_size_t)];
+  atomic_size_t dequeue_pos; // 消费者位置
+  char pad2[THREADPOOL_CACHE_LINE - sizeof(atomic_size_t)];
+
+  // 队列满时的阻塞等待
+  atomic_int full_waiters;  // 等待空位的生产者数
+  pthread_mutex_t mutex;    // 仅用于条件变量
   pthread_cond_t not_full;  // 队列未满条件变量
-} TaskQueue;
+} TaskRing;
+
+/**
+ * @brief 工作窃取双端队列（Chase-Lev）
+ *
+ * 只有所属线程在 bottom 端无锁地 push/pop（LIFO，缓存友好），
+ * 其他线程从 top 端通过 CAS 窃取（FIFO）。容量固定为 2 的幂，
+ * 满时由调用方回退到全局队列
+ */
+typedef struct TaskDeque {
+  Task *_Atomic *buffer; // 任务槽位数组
+  size_t mask;           // 容量 - 1
+  size_t capacity;       // 容量（2 的幂）
+
+  char pad0[THREADPOOL_CACHE_LINE];
+  _Atomic int64_t top; // 窃取端
+  char pad1[THREADPOOL_CACHE_LINE - sizeof(int64_t)];
+  _Atomic int64_t bottom; // 所属线程端
+  char pad2[THREADPOOL_CACHE_LINE - sizeof(int64_t)];
+} TaskDeque;
+
+/**
+ * @brief 按截止时间排序的最小堆，用于最早截止时间优先(EDF)调度
+ *
+ * 没有截止时间的任务排在所有有截止时间的任务之后，相同截止时间按优先级和入队时间排序
+ */
+typedef struct TaskHeap {
+  Task **items;                                // 堆数组
+  size_t capacity;                             // 容量
+  atomic_size_t size;                          // 任务数
+  atomic_size_t class_size[TASK_PRIORITY_COUNT]; // 各优先级任务数
+
+  pthread_mutex_t mutex;   // 堆互斥锁
+  pthread_cond_t not_full; // 堆未满条件变量
+} TaskHeap;
+
+// completion_queue_create 容量为 0 时完成队列的默认容量
+#define COMPLETION_QUEUE_DEFAULT_CAPACITY 1024
+
+/**
+ * @brief 完成队列中的一条完成记录
+ */
+typedef struct TaskCompletion {
+  TaskResult result;     // 任务 id、结束状态和执行时间
+  void *user_data;       // 提交时的 callback_arg
+  uint64_t enqueue_time; // 进入全局队列的时间(单调时钟纳秒)，未经过全局队列时为 0
+  uint64_t start_time;   // 开始执行的时间，未执行时为 0
+  uint64_t end_time;     // 结束的时间
+  uint8_t *output;       // winterq.setOutput 的输出，由调用方 free，没有时为 NULL
+  size_t output_len;     // 输出长度
+} TaskCompletion;
+
+typedef struct CompletionCell {
+  atomic_size_t sequence; // 与 TaskRingCell 相同的轮次编号
+  TaskCompletion entry;
+} CompletionCell;
+
+/**
+ * @brief 完成队列：工作线程投递完成记录，提交者批量收割
+ *
+ * 多生产者单消费者环形队列。提交时为任务预留一个槽位，收割后归还，
+ * 所以投递永远不会失败也不会阻塞工作线程；槽位用完时提交返回 SUBMIT_QUEUE_FULL。
+ * 有新记录时 eventfd 变为可读，可以加入 epoll 等待
+ */
+typedef struct CompletionQueue {
+  CompletionCell *cells; // 槽位数组
+  size_t mask;           // 容量 - 1
+  size_t capacity;       // 容量（2 的幂）
+  int eventfd;           // 有新记录时可读
+
+  char pad0[THREADPOOL_CACHE_LINE];
+  atomic_size_t enqueue_pos; // 工作线程投递位置
+  char pad1[THREADPOOL_CACHE_LINE - sizeof(atomic_size_t)];
+  size_t dequeue_pos; // 收割位置，只有消费者访问
+  char pad2[THREADPOOL_CACHE_LINE - sizeof(size_t)];
+
+  atomic_long slots;     // 未被预留的槽位数
+  atomic_bool signaled;  // 上次收割后是否已经写过 eventfd
+} CompletionQueue;
+
+/**
+ * @brief 工作线程的 CPU 绑定方式
+ */
+typedef enum ThreadAffinity {
+  THREAD_AFFINITY_NONE = 0, // 不绑定，由内核调度
+  THREAD_AFFINITY_COMPACT,  // 先占满一个 NUMA 节点的 CPU，再使用下一个节点
+  THREAD_AFFINITY_SCATTER,  // 依次轮流分布到各个 NUMA 节点
+  THREAD_AFFINITY_LIST,     // 按 cpu_list 给出的 CPU 顺序绑定
+} ThreadAffinity;
+
+/**
+ * @brief 工作线程没有任务时的等待方式
+ */
+typedef enum WorkerIdlePolicy {
+  WORKER_IDLE_PARK = 0, // 立即在事件循环中等待，由提交者唤醒
+  WORKER_IDLE_SPIN,     // 先自旋检查队列，再让出 CPU 几次，最后才在事件循环中等待
+} WorkerIdlePolicy;
+
+/**
+ * @brief 工作线程等到下一个任务时所处的阶段
+ */
+typedef enum WorkerIdleStage {
+  WORKER_IDLE_STAGE_SPIN = 0, // 自旋中
+  WORKER_IDLE_STAGE_YIELD,    // 让出 CPU 中
+  WORKER_IDLE_STAGE_PARK,     // 在事件循环中等待
+} WorkerIdleStage;
+
+/**
+ * @brief 工作线程的放置顺序，第 i 个线程绑定到 cpus[i % count]
+ */
+typedef struct CpuPlacement {
+  int *cpus;      // CPU 编号
+  int *nodes;     // 对应的 NUMA 节点
+  int count;      // CPU 数，0表示不绑定
+  int node_count; // NUMA 节点数
+} CpuPlacement;
 
 // Thread pool configuration
 typedef struct ThreadPoolConfig {
-  int thread_count; // 线程数量
+  int thread_count; // 线程数量，0表示按可用 CPU 和容器配额自动确定
   int max_contexts; // 每个运行时的最大上下文数
 
-  size_t global_queue_size; // 全局队列大小，0表示无限
-  size_t local_queue_size;  // 本地队列大小，0表示无限
+  size_t global_queue_size; // 全局队列容量，向上取整为 2 的幂，0表示默认容量
+  size_t local_queue_size;  // 本地队列和收件箱容量，向上取整为 2 的幂，0表示默认容量
 
   bool enable_work_stealing; // 是否启用工作窃取
-  int idle_threshold;        // 空闲线程阈值，用于动态调整线程数
+  int idle_threshold;        // 已废弃：动态调整改为依据排队等待时间和利用率
   bool dynamic_sizing;       // 是否动态调整线程池大小
+  int min_threads;        // 动态调整的最小线程数，0表示1
+  int max_threads;        // 线程数上限，0表示 max(thread_count, 2 * 可用 CPU 数)
+  int target_wait_ms;     // 动态调整的目标排队等待时间(毫秒)，0表示默认值
+  int adjust_interval_ms; // 动态调整的采样周期(毫秒)，0表示默认值
+  bool edf_scheduling; // 全局队列按最早截止时间优先出队，代替严格优先级
+
+  // 亲和路由：未指定线程的任务按脚本标识或亲和键哈希到首选线程的亲和队列，
+  // 让同一个脚本落在同一个运行时上，保持编译结果、inline cache 等缓存的热度；
+  // 亲和队列满时退回全局队列；批量提交和排序通道放出的任务不参与。
+  // 只路由普通优先级、没有截止时间的任务，亲和队列中的任务同样占用准入名额；
+  // 不能与 edf_scheduling 同时使用
+  bool affinity_routing;
+  // 亲和队列积压超过这个数时才允许其他线程窃取，越小越偏向负载均衡，
+  // 0表示默认值，负数表示总是允许窃取
+  int affinity_steal_threshold;
+
+  // 租户任务同时放出到工作队列（排队或执行中）的上限，
+  // 0表示 线程数 × max_contexts，即线程池能同时执行的上下文数
+  int tenant_window;
+
+  // 结果缓存：按 脚本哈希 + 输入哈希 缓存 memoize 任务的输出，分片加锁，
+  // 超过字节预算时按最近最少使用淘汰；0表示不启用
+  size_t memo_cache_bytes;
+  int memo_ttl_ms; // 缓存条目的有效期(毫秒)，0表示不过期
+
+  // 空闲策略：自旋预算根据观察到的任务到达间隔自动调整，不超过 idle_spin_us；
+  // 有存活上下文（定时器、Promise 等）的线程不自旋，避免推迟事件循环
+  WorkerIdlePolicy idle_policy;
+  int idle_spin_us; // 自旋预算上限(微秒)，0表示默认值
+
+  ThreadAffinity affinity; // 工作线程绑核方式
+  const int *cpu_list;     // THREAD_AFFINITY_LIST 使用的 CPU 列表
+  int cpu_list_len;        // cpu_list 长度
+
+  // 可选：任务结束时接收脚本的 performance mark/measure 条目，在工作线程上调用
+  void (*performance_observer)(int task_id, void *callback_arg,
+                               const PerformanceEntry *entries, int count);
 } ThreadPoolConfig;
 
 /**
  * @brief 每个工作线程的数据
+ *
+ * 按缓存行分组：其他线程会写的唤醒状态、只有本线程写的状态和统计各占独立的缓存行，
+ * 槽位按缓存行对齐分配，相邻线程的计数器不会落在同一缓存行上
  */
 typedef struct ThreadData {
   int thread_id;           // 线程ID
   struct ThreadPool *pool; // 所属线程池指针
+  pthread_t thread;        // 工作线程
+  bool joinable;           // 线程已创建、尚未回收，受 resize_mutex 保护
+  bool exiting;            // 缩容退出已经确定，不能再被扩容重新启用，受 pool_mutex 保护
+  atomic_bool exited;      // 线程函数已经返回，可以无阻塞地回收
 
   int max_contexts;       // 最大JS上下文数
   WorkerRuntime *runtime; // WorkerRuntime 指针
-  TaskQueue local_queue;  // 线程本地任务队列
+  int cpu;                // 绑定的 CPU，-1表示未绑定
+  int numa_node;          // 所在的 NUMA 节点
+  TaskDeque local_queue;  // 线程本地工作窃取队列，只有本线程可以 push
+  TaskRing inbox;         // 指定由本线程执行的任务，任意线程可以投递
+  TaskRing affinity_queue; // 亲和路由到本线程的任务，积压时可以被窃取
+
+  // 事件驱动：工作线程阻塞在自己的事件循环中，提交任务时通过 wakeup 唤醒
+  _Alignas(THREADPOOL_CACHE_LINE) uv_async_t *_Atomic
+      wakeup;           // 唤醒句柄，事件循环就绪后才非空，退出前清空
+  atomic_int wakers;    // 正在向 wakeup 发送唤醒的线程数
+  atomic_bool sleeping; // 是否在事件循环中等待新任务
+  atomic_bool retiring; // 缩容时置位，线程交出任务并在上下文结束后退出
+  atomic_bool reap_cancelled; // 有正在执行的任务被取消，需要释放其上下文
 
-  // 性能统计
+  // 以下只有本线程写入，其他线程只读取汇总
+  _Alignas(THREADPOOL_CACHE_LINE) bool draining; // 是否正在批量执行任务
+  bool throttled; // 是否因上下文数达到上限而暂停取任务
+
+  // 空闲策略
+  uint64_t idle_since;        // 开始等待下一个任务的时间(纳秒)，0表示不在等待
+  WorkerIdleStage idle_stage; // 当前的等待阶段
+  uint64_t idle_gap_ewma;     // 等待到下一个任务的间隔的指数平均(纳秒)
+  uint64_t spin_ns;           // 当前的自旋预算(纳秒)
+
+  // 性能统计（累计值，槽位复用时保留）
   atomic_bool idle;                // 线程是否空闲
   atomic_int tasks_processed;      // 该线程处理的任务数量
+  atomic_int tasks_completed;      // 该线程上完成的任务数量
   uint64_t idle_start;             // 开始计时时间
   atomic_uint_least64_t idle_time; // 线程空闲的累计时间(毫秒)
   atomic_uint_least64_t busy_time; // 线程忙碌的累计时间(毫秒)
+  atomic_uint_least64_t exec_time; // 任务累计执行时间(纳秒)
+  atomic_uint_least64_t dequeued[TASK_PRIORITY_COUNT]; // 从全局队列取出的任务数
+  atomic_uint_least64_t wait_ns[TASK_PRIORITY_COUNT]; // 这些任务的累计排队时间(纳秒)
+  atomic_uint_least64_t affinity_hits;   // 在首选线程上执行的亲和路由任务数
+  atomic_uint_least64_t affinity_misses; // 被其他线程执行的亲和路由任务数
+  atomic_uint_least64_t idle_hits[WORKER_IDLE_STAGE_PARK + 1]; // 各等待阶段等到的任务数
 } ThreadData;
 
 /**
@@ -93,35 +679,111 @@ typedef struct ThreadPoolStats {
   double avg_wait_time;      // 平均等待时间(毫秒)
   double avg_execution_time; // 平均执行时间(毫秒)
   double thread_utilization; // 线程利用率(百分比)
+
+  // 按优先级统计，下标为 TaskPriority
+  int queued_by_priority[TASK_PRIORITY_COUNT];       // 各优先级排队任务数
+  double avg_wait_time_by_priority[TASK_PRIORITY_COUNT]; // 各优先级平均等待时间(毫秒)
+
+  // 截止时间
+  int shed_tasks; // 出队时已过期而未执行的任务数
+  int late_tasks; // 执行了但在截止时间之后才完成的任务数
+  int available_slots; // 全局队列剩余名额
+  int rejected_tasks;  // 因队列满被拒绝的提交次数
+  int rate_limited_tasks; // 因租户超过提交速率被拒绝的次数
+  int active_lanes;    // 有任务在执行或等待的排序键数
+  int active_flights;  // 有任务在排队或执行的去重键数
+  int coalesced_tasks; // 附加到已有任务上、没有单独执行的提交数
+
+  // 结果缓存
+  int memo_hits;           // 命中次数
+  int memo_misses;         // 未命中次数
+  double memo_hit_rate;    // 命中率(百分比)
+  size_t memo_bytes;       // 已用字节数
+  size_t memo_entries;     // 条目数
+  int cancelled_tasks; // 被取消的任务数（出队时丢弃或执行被中断）
+
+  // 亲和路由
+  int affinity_hits;        // 在首选线程上执行的任务数
+  int affinity_misses;      // 被窃取或溢出到全局队列后由其他线程执行的任务数
+  double affinity_hit_rate; // 命中率(百分比)
+
+  // 空闲策略：线程空闲后等到的下一个任务是在哪个阶段等到的
+  int spin_hits;  // 自旋时等到
+  int yield_hits; // 让出 CPU 时等到
+  int park_hits;  // 在事件循环中等待后被唤醒
 } ThreadPoolStats;
 
 /**
  * @brief 线程池主结构
  */
 typedef struct ThreadPool {
-  pthread_t *threads;      // 线程数组
-  ThreadData *thread_data; // 线程数据数组
-  int thread_count;        // 线程数
-  atomic_bool shutdown;    // 关闭标志
+  // 线程注册表：按 max_threads 一次分配，槽位创建后地址不变，直到线程池关闭；
+  // 缩容退出的槽位保留队列供之后扩容复用，并发的窃取者和提交者可以安全访问
+  ThreadData *_Atomic *thread_data; // 线程数据槽位
+  int max_threads;                  // 注册表容量
+  atomic_int thread_count;  // 线程数，下标小于它的槽位在运行
+  pthread_mutex_t resize_mutex; // 串行化线程数调整
+  atomic_bool shutdown;         // 关闭标志
 
-  // 任务统计
-  int max_tasks;              // 最大任务数量
-  atomic_int completed_tasks; // 已执行任务计数
-  atomic_int total_tasks;     // 总任务计数
+  // 任务统计；完成数、执行时间和排队时间按线程累计，读取时汇总
+  int max_tasks; // 最大任务数量
+  _Alignas(THREADPOOL_CACHE_LINE) atomic_int total_tasks; // 总任务计数，分配任务ID
 
   // 同步机制
   pthread_mutex_t pool_mutex; // 线程池互斥锁
   pthread_mutex_t wait_mutex; // 等待互斥锁
   pthread_cond_t wait_cond;   // 等待条件变量
 
-  TaskQueue queue; // 全局任务队列
+  TaskRing queues[TASK_PRIORITY_COUNT]; // 按优先级划分的全局任务队列
+  TaskHeap edf_queue; // config.edf_scheduling 时代替 queues 的全局任务队列
+  atomic_int shed_tasks; // 过期丢弃的任务数
+  atomic_int late_tasks; // 超过截止时间完成的任务数
+  atomic_int cancelled_tasks; // 被取消的任务数
+
+  // 准入控制：全局队列的剩余名额，任务进入全局、本地或亲和队列时占用，被工作线程取出时归还
+  size_t queue_capacity;       // 全局队列容量
+  _Alignas(THREADPOOL_CACHE_LINE) atomic_long credits; // 剩余名额
+  atomic_int credit_waiters;   // 等待名额的提交者数
+  atomic_int rejected_tasks;   // 因队列满被拒绝的提交次数
+  pthread_mutex_t credit_mutex; // 仅用于条件变量
+  pthread_cond_t credit_cond;   // 有名额归还或线程池关闭时通知
+
+  // 按排序键串行执行的通道
+  LaneBucket lanes[TASK_LANE_BUCKETS];
+  atomic_int active_lanes; // 当前通道数
+
+  // 按去重键合并相同的在途任务
+  FlightBucket flights[TASK_FLIGHT_BUCKETS];
+  atomic_int active_flights;  // 当前记录数
+  atomic_int coalesced_tasks; // 被合并的提交数
+
+  // 结果缓存，config.memo_cache_bytes 为0时为NULL
+  MemoShard *memo_shards;
+  atomic_int memo_hits;   // 命中次数
+  atomic_int memo_misses; // 未命中次数
+
+  // 租户公平调度
+  pthread_mutex_t tenant_mutex;       // 保护租户表和轮询链表
+  Tenant *tenants[TASK_MAX_TENANTS];  // 按租户ID索引，第一次使用时创建
+  Tenant *active_tenants;             // 轮询链表头，即当前轮到的租户
+  Tenant *active_tenants_tail;        // 轮询链表尾
+  int tenant_in_flight;               // 已放出尚未结束的租户任务数
+  TokenBucket rate_limits[TASK_MAX_TENANTS]; // 按租户ID索引的提交速率限制
+  atomic_int rate_limited_tasks;      // 因超过速率被拒绝的提交次数
+
+  // 按优先级的老化状态，出队统计在 ThreadData 中按线程累计
+  _Alignas(THREADPOOL_CACHE_LINE) struct {
+    atomic_uint_least64_t last_served; // 上次出队时间(毫秒)
+  } class_stats[TASK_PRIORITY_COUNT];
 
   ThreadPoolConfig config; // 线程池配置
+  CpuPlacement placement;  // 工作线程绑核顺序
 
   // 用于管理空闲线程的数据结构
-  atomic_int idle_thread_count; // 空闲线程计数
-  pthread_mutex_t idle_mutex;   // 空闲线程互斥锁
-  pthread_cond_t idle_cond;     // 空闲线程条件变量
+  _Alignas(THREADPOOL_CACHE_LINE) atomic_int idle_thread_count; // 空闲线程计数
+  atomic_int spinning_workers; // 正在自旋或让出 CPU 等待任务的线程数
+  pthread_mutex_t idle_mutex;   // 调整线程休眠用的互斥锁
+  pthread_cond_t idle_cond;     // 关闭时唤醒调整线程
 
   // 用于动态调整线程池大小
   pthread_t adjuster_thread;    // 调整线程
@@ -130,6 +792,12 @@ typedef struct ThreadPool {
 
 // API declarations
 
+/**
+ * @brief 默认线程数：当前进程可用的 CPU 数，受 cgroup CPU 配额限制
+ * @return 线程数，至少为1
+ */
+int thread_pool_default_size(void);
+
 /**
  * @brief 初始化线程池
  * @param config 线程池配置
@@ -148,6 +816,38 @@ ThreadPool *init_thread_pool(ThreadPoolConfig config);
 int add_script_task_to_pool(ThreadPool *pool, const char *script,
                             void (*callback)(void *), void *callback_arg);
 
+/**
+ * @brief 添加按键串行执行的脚本任务到线程池
+ *
+ * 同一个 key 的任务按提交顺序逐个执行，不同 key 之间并行
+ * @param pool 线程池
+ * @param key 排序键，例如租户或会话ID
+ * @param script JavaScript脚本字符串
+ * @param callback 任务完成后的回调函数
+ * @param callback_arg 回调函数参数
+ * @return 成功返回0，失败返回-1
+ */
+int add_ordered_script_task_to_pool(ThreadPool *pool, const char *key,
+                                    const char *script,
+                                    void (*callback)(void *),
+                                    void *callback_arg);
+
+/**
+ * @brief 以租户身份添加脚本任务到线程池
+ *
+ * 先检查租户的提交速率，再按权重参与公平调度
+ * @param pool 线程池
+ * @param tenant_id 租户ID，1 ~ TASK_MAX_TENANTS-1
+ * @param script JavaScript脚本字符串
+ * @param callback 任务完成后的回调函数
+ * @param callback_arg 回调函数参数
+ * @return 成功返回0，超过速率返回 SUBMIT_RATE_LIMITED，其他失败返回-1
+ */
+int add_tenant_script_task_to_pool(ThreadPool *pool, int tenant_id,
+                                   const char *script,
+                                   void (*callback)(void *),
+                                   void *callback_arg);
+
 /**
  * @brief 添加字节码任务到线程池
  * @param pool 线程池
@@ -161,6 +861,324 @@ int add_bytecode_task_to_pool(ThreadPool *pool, uint8_t *bytecode,
                               size_t bytecode_len, void (*callback)(void *),
                               void *callback_arg);
 
+/**
+ * @brief 添加JavaScript脚本任务到指定线程
+ *
+ * 任务进入该线程的收件箱，只会由该线程执行，不会被其他线程窃取
+ * @param pool 线程池
+ * @param thread_id 目标线程ID
+ * @param script JavaScript脚本字符串
+ * @param callback 任务完成后的回调函数
+ * @param callback_arg 回调函数参数
+ * @return 成功返回0，失败返回-1
+ */
+int add_script_task_to_thread(ThreadPool *pool, int thread_id,
+                              const char *script, void (*callback)(void *),
+                              void *callback_arg);
+
+/**
+ * @brief 添加字节码任务到指定线程
+ * @param pool 线程池
+ * @param thread_id 目标线程ID
+ * @param bytecode JavaScript字节码
+ * @param bytecode_len 字节码长度
+ * @param callback 回调函数
+ * @param callback_arg 回调函数参数
+ * @return 成功返回0，失败返回-1
+ */
+int add_bytecode_task_to_thread(ThreadPool *pool, int thread_id,
+                                uint8_t *bytecode, size_t bytecode_len,
+                                void (*callback)(void *), void *callback_arg);
+
+/**
+ * @brief 注册脚本，复制一次内容并返回引用计数为 1 的 ScriptBlob
+ * @param script JavaScript脚本字符串
+ * @return ScriptBlob 指针，失败返回NULL
+ */
+ScriptBlob *script_blob_create_script(const char *script);
+
+/**
+ * @brief 注册字节码，复制一次内容并返回引用计数为 1 的 ScriptBlob
+ * @param bytecode JavaScript字节码
+ * @param bytecode_len 字节码长度
+ * @return ScriptBlob 指针，失败返回NULL
+ */
+ScriptBlob *script_blob_create_bytecode(const uint8_t *bytecode,
+                                        size_t bytecode_len);
+
+/**
+ * @brief 增加引用计数
+ * @param blob ScriptBlob
+ * @return 传入的 blob
+ */
+ScriptBlob *script_blob_retain(ScriptBlob *blob);
+
+/**
+ * @brief 释放一个引用，最后一个引用释放时回收内存
+ * @param blob ScriptBlob
+ */
+void script_blob_release(ScriptBlob *blob);
+
+/**
+ * @brief 添加引用共享脚本/字节码的任务到线程池，不复制内容
+ *
+ * 任务持有 blob 的一个引用，任务完成后释放；调用方持有的引用不受影响
+ * @param pool 线程池
+ * @param blob 共享脚本/字节码
+ * @param callback 任务完成后的回调函数
+ * @param callback_arg 回调函数参数
+ * @return 成功返回0，失败返回-1
+ */
+int add_blob_task_to_pool(ThreadPool *pool, ScriptBlob *blob,
+                          void (*callback)(void *), void *callback_arg);
+
+/**
+ * @brief 提交单个任务，返回明确的准入结果
+ *
+ * timeout_ms 为 0 时不阻塞：没有名额立即返回 SUBMIT_QUEUE_FULL，工作线程上提交的任务也一样；
+ * 大于 0 时最多等待 timeout_ms 毫秒
+ * @param pool 线程池
+ * @param spec 任务描述，内容会被复制（blob 只增加引用计数）
+ * @param timeout_ms 队列满时的最长等待时间(毫秒)
+ * @return SubmitStatus
+ */
+SubmitStatus submit_task(ThreadPool *pool, const TaskSpec *spec,
+                         int timeout_ms);
+
+/**
+ * @brief 提交单个任务并返回任务句柄
+ *
+ * 与 submit_task 相同，成功时 *handle 为调用方持有一个引用的句柄，
+ * 用完后调用 task_handle_release；失败时 *handle 为 NULL
+ * @param pool 线程池
+ * @param spec 任务描述
+ * @param timeout_ms 队列满时的最长等待时间(毫秒)
+ * @param handle 输出任务句柄
+ * @return SubmitStatus
+ */
+SubmitStatus submit_task_with_handle(ThreadPool *pool, const TaskSpec *spec,
+                                     int timeout_ms, TaskHandle **handle);
+
+/**
+ * @brief 任务的唯一 id
+ * @param handle 任务句柄
+ * @return 任务 id，参数无效时返回-1
+ */
+int task_handle_id(const TaskHandle *handle);
+
+/**
+ * @brief 非阻塞地查询任务状态
+ * @param handle 任务句柄
+ * @param result 非NULL且任务已结束时写入结果
+ * @return TaskHandleState
+ */
+TaskHandleState task_handle_poll(TaskHandle *handle, TaskResult *result);
+
+/**
+ * @brief 等待任务结束
+ *
+ * 不能在执行该任务的工作线程上调用（例如在同一线程的其他任务回调中），否则会死锁
+ * @param handle 任务句柄
+ * @param timeout_ms 超时时间(毫秒)，0表示无限等待
+ * @param result 非NULL时写入结果
+ * @return 任务已结束返回0，超时返回1，参数无效返回-1
+ */
+int task_handle_wait(TaskHandle *handle, int timeout_ms, TaskResult *result);
+
+/**
+ * @brief 取消任务
+ *
+ * 排队中的任务在出队时直接结束，不再执行；正在执行的任务被中断，
+ * 它的定时器和调度任务被取消，上下文随后释放。两种情况都以
+ * TASK_STATUS_CANCELLED 结束（设置了 completion 时照常调用）。
+ * 取消请求与任务正常结束竞争时，以先发生的为准
+ * @param handle 任务句柄
+ * @return 任务尚未结束、取消请求已登记返回true，已经结束返回false
+ */
+bool task_handle_cancel(TaskHandle *handle);
+
+/**
+ * @brief 释放调用方持有的句柄引用，不会取消任务
+ * @param handle 任务句柄
+ */
+void task_handle_release(TaskHandle *handle);
+
+/**
+ * @brief 创建完成队列
+ * @param capacity 容量，向上取整为 2 的幂，0表示默认容量
+ * @return 完成队列，失败返回NULL
+ */
+CompletionQueue *completion_queue_create(size_t capacity);
+
+/**
+ * @brief 完成队列的 eventfd，有未收割的记录时可读
+ * @param cq 完成队列
+ * @return 文件描述符
+ */
+int completion_queue_fd(const CompletionQueue *cq);
+
+/**
+ * @brief 非阻塞地批量收割完成记录，同一时刻只能有一个线程调用
+ *
+ * 同时清除 eventfd 的可读状态，之后投递的记录会再次触发
+ * @param cq 完成队列
+ * @param out 输出数组
+ * @param max 最多收割的记录数
+ * @return 收割的记录数
+ */
+size_t completion_queue_reap(CompletionQueue *cq, TaskCompletion *out,
+                             size_t max);
+
+/**
+ * @brief 等待完成队列中有记录（不使用 epoll 时）
+ * @param cq 完成队列
+ * @param timeout_ms 超时时间(毫秒)，-1表示无限等待
+ * @return 有记录返回0，超时返回1，失败返回-1
+ */
+int completion_queue_wait(CompletionQueue *cq, int timeout_ms);
+
+/**
+ * @brief 销毁完成队列，释放未收割记录的输出
+ *
+ * 引用它的任务必须都已结束（或线程池已经关闭）
+ * @param cq 完成队列
+ */
+void completion_queue_destroy(CompletionQueue *cq);
+
+/**
+ * @brief 设置租户的权重和同时放出的任务数上限
+ *
+ * 没有设置过的租户在第一次提交时以权重 1、不限并发创建
+ * @param pool 线程池
+ * @param tenant_id 租户ID，1 ~ TASK_MAX_TENANTS-1
+ * @param weight 权重，每轮最多放出的任务数，至少为 1
+ * @param max_in_flight 同时放出的任务数上限，0表示不限
+ * @return 成功返回0，参数错误或内存不足返回-1
+ */
+int thread_pool_set_tenant(ThreadPool *pool, int tenant_id, int weight,
+                           int max_in_flight);
+
+/**
+ * @brief 设置租户的提交速率限制，可以在运行时随时修改
+ *
+ * 超过速率的提交在分配任务、复制脚本之前以 SUBMIT_RATE_LIMITED 拒绝
+ * @param pool 线程池
+ * @param tenant_id 租户ID，1 ~ TASK_MAX_TENANTS-1
+ * @param rate 每秒补充的令牌数，0表示不限速
+ * @param burst 桶容量，即允许连续提交的任务数，至少为 1
+ * @return 成功返回0，参数错误返回-1
+ */
+int thread_pool_set_tenant_rate(ThreadPool *pool, int tenant_id, double rate,
+                                int burst);
+
+/**
+ * @brief 获取单个租户的统计信息
+ * @param pool 线程池
+ * @param tenant_id 租户ID
+ * @param stats 输出统计信息
+ * @return 成功返回0，租户不存在返回-1
+ */
+int thread_pool_get_tenant_stats(ThreadPool *pool, int tenant_id,
+                                 TenantStats *stats);
+
+/**
+ * @brief 全局队列当前的剩余名额
+ *
+ * 生产者可以在解析请求等昂贵操作之前先检查，名额为 0 时直接拒绝；
+ * 返回值只是快照，随后的提交仍可能返回 SUBMIT_QUEUE_FULL
+ * @param pool 线程池
+ * @return 剩余名额
+ */
+size_t thread_pool_available_slots(ThreadPool *pool);
+
+/**
+ * @brief 按任务描述添加单个任务到线程池
+ *
+ * 队列满时最多等待 100ms，与 add_script_task_to_pool 行为一致；设置了 tenant_id
+ * 且租户超过提交速率时不等待，立即返回 SUBMIT_RATE_LIMITED。
+ * 需要区分其他背压和错误时使用 submit_task
+ * @param pool 线程池
+ * @param spec 任务描述，内容会被复制（blob 只增加引用计数）
+ * @return 成功返回0，超过速率返回 SUBMIT_RATE_LIMITED(-4)，其他失败返回-1
+ */
+int add_task_to_pool(ThreadPool *pool, const TaskSpec *spec);
+
+/**
+ * @brief 批量添加任务到线程池
+ *
+ * 所有任务及其脚本/字节码副本在一块内存中分配，每段连续的相同优先级任务在对应
+ * 的全局队列中一次性预留连续槽位，并按接受的任务数一次唤醒空闲线程。
+ * 队列空间不足时不会等待，只接受前面能放下的部分任务，
+ * 调用方可以稍后重新提交 specs[返回值..n)
+ * @param pool 线程池
+ * @param specs 任务描述数组
+ * @param n 任务数
+ * @return 被接受的任务数（specs 的前缀长度）；参数错误或内存不足返回
+ * SUBMIT_ERROR，线程池正在关闭返回 SUBMIT_SHUTDOWN
+ */
+int add_tasks_to_pool_batch(ThreadPool *pool, const TaskSpec *specs, size_t n);
+
+/**
+ * @brief 创建空的任务图
+ * @param pool 线程池
+ * @return 任务图，调用方持有一个引用，失败返回NULL
+ */
+TaskGraph *task_graph_create(ThreadPool *pool);
+
+/**
+ * @brief 向任务图添加节点
+ *
+ * 节点的任务在所有依赖结束后执行，winterq.inputs[i] 为 deps[i] 的输出
+ * （没有调用 winterq.setOutput 时为空）；就绪的后继优先在完成依赖的同一个工作线程
+ * 上执行。依赖被丢弃、过期或脚本抛出异常时后继不执行，以 TASK_STATUS_SKIPPED 结束
+ * @param graph 任务图，不能已经提交
+ * @param spec 任务描述，不支持 ordering_key
+ * @param deps 依赖的节点下标，必须小于新节点的下标
+ * @param dep_count 依赖数
+ * @return 新节点的下标，失败返回-1
+ */
+int task_graph_add(TaskGraph *graph, const TaskSpec *spec, const int *deps,
+                   int dep_count);
+
+/**
+ * @brief 提交任务图，所有没有依赖的节点进入全局队列
+ *
+ * 没有依赖的节点一次性占用名额，名额不足时整个任务图都不会执行；
+ * 线程池关闭时尚未执行的节点被丢弃，on_complete 不会被调用
+ * @param graph 任务图
+ * @param on_complete 所有节点结束后的回调，可以为 NULL
+ * @param arg 回调参数
+ * @param timeout_ms 队列满时的最长等待时间(毫秒)
+ * @return SubmitStatus
+ */
+SubmitStatus task_graph_submit(TaskGraph *graph,
+                               void (*on_complete)(TaskGraph *graph, void *arg),
+                               void *arg, int timeout_ms);
+
+/**
+ * @brief 节点的结束状态，只在节点结束后（例如 on_complete 中）有意义
+ * @param graph 任务图
+ * @param node 节点下标
+ * @return 结束状态
+ */
+TaskStatus task_graph_node_status(const TaskGraph *graph, int node);
+
+/**
+ * @brief 节点的输出，在任务图释放前有效
+ * @param graph 任务图
+ * @param node 节点下标
+ * @param len 输出长度
+ * @return 输出内容，节点没有输出时返回NULL
+ */
+const uint8_t *task_graph_node_output(const TaskGraph *graph, int node,
+                                      size_t *len);
+
+/**
+ * @brief 释放调用方持有的引用，执行中的任务图在所有任务结束后释放
+ * @param graph 任务图
+ */
+void task_graph_release(TaskGraph *graph);
+
 /**
  * @brief 关闭线程池并释放资源
  * @param pool 线程池
@@ -184,8 +1202,12 @@ int wait_for_idle(ThreadPool *pool, int timeout_ms);
 
 /**
  * @brief 动态调整线程池大小
+ *
+ * 缩容时被移除的线程把本地队列和收件箱中的任务交给全局队列，
+ * 等已经开始执行的上下文结束后退出；调用不等待这些线程，它们退出后在之后的
+ * 调整或关闭线程池时回收。扩容时还没退出的线程直接重新启用
  * @param pool 线程池
- * @param new_thread_count 新的线程数量
+ * @param new_thread_count 新的线程数量，不超过 max_threads
  * @return 成功返回0，失败返回-1
  */
 int resize_thread_pool(ThreadPool *pool, int new_thread_count);